@@ -0,0 +1,227 @@
+#include "fake_driver.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace sqlcc {
+namespace bench {
+
+FakeConfig ParseFakeDSN(const std::string& dsn) {
+    FakeConfig cfg;
+    std::istringstream params(dsn);
+    std::string param;
+    while (std::getline(params, param, '&')) {
+        std::size_t eq = param.find('=');
+        if (eq == param.npos) {
+            continue;
+        }
+        std::string k = param.substr(0, eq);
+        std::string v = param.substr(eq + 1);
+        if (k == "rows") {
+            cfg.rows = std::stoul(v);
+        } else if (k == "types") {
+            cfg.types = v;
+        } else if (k == "latency_us") {
+            cfg.latency = std::chrono::microseconds(std::stol(v));
+        } else {
+            throw std::invalid_argument("invalid fake dsn param: " + k);
+        }
+    }
+    return cfg;
+}
+
+namespace {
+
+// longer than the small string buffer, like most real text columns
+const std::string kStringValue = "fake driver string value";
+
+void Wait(const FakeConfig& cfg) {
+    if (cfg.latency.count() > 0) {
+        std::this_thread::sleep_for(cfg.latency);
+    }
+}
+
+class FakeResult : public driver::SQLResult {
+public:
+    int64_t LastInsertID() override { return 1; }
+    int64_t RowsAffected() override { return 1; }
+};
+
+class FakeRows : public driver::SQLRows {
+public:
+    FakeRows(const FakeConfig& cfg) : cfg_(cfg), row_(0) {
+        for (std::size_t i = 0; i < cfg_.types.size(); i++) {
+            columns_.push_back("c" + std::to_string(i));
+        }
+    }
+    const std::vector<std::string>& Columns() const override {
+        return columns_;
+    }
+    bool Next() override {
+        if (row_ >= cfg_.rows) {
+            return false;
+        }
+        row_++;
+        return true;
+    }
+    void Scan(std::vector<driver::Value>& dest) override {
+        int64_t row = row_;
+        for (std::size_t i = 0; i < dest.size() && i < cfg_.types.size(); i++) {
+            switch (cfg_.types[i]) {
+                case 'i':
+                    dest[i] = row;
+                    break;
+                case 'u':
+                    dest[i] = uint64_t(row);
+                    break;
+                case 'd':
+                    dest[i] = double(row);
+                    break;
+                case 's':
+                    dest[i] = kStringValue;
+                    break;
+                case 'n':
+                    dest[i] = row % 2 ? driver::NullInt64(row) : driver::NullInt64();
+                    break;
+            }
+        }
+    }
+    void ScanTyped(const driver::ScanType* types, void* const* dest,
+                   std::size_t size) override {
+        int64_t row = row_;
+        for (std::size_t i = 0; i < size; i++) {
+            switch (types[i]) {
+                case driver::ScanType::kInt32:
+                    *static_cast<int32_t*>(dest[i]) = int32_t(row);
+                    break;
+                case driver::ScanType::kInt64:
+                    *static_cast<int64_t*>(dest[i]) = row;
+                    break;
+                case driver::ScanType::kUInt64:
+                    *static_cast<uint64_t*>(dest[i]) = uint64_t(row);
+                    break;
+                case driver::ScanType::kDouble:
+                    *static_cast<double*>(dest[i]) = double(row);
+                    break;
+                case driver::ScanType::kString:
+                    *static_cast<std::string*>(dest[i]) = kStringValue;
+                    break;
+                case driver::ScanType::kNullInt64: {
+                    auto* value = static_cast<driver::NullInt64*>(dest[i]);
+                    *value = row % 2 ? driver::NullInt64(row) : driver::NullInt64();
+                    break;
+                }
+                default:
+                    throw std::runtime_error("fake driver: unsupported scan type");
+            }
+        }
+    }
+    void ScanCells(driver::Cell* dest, std::size_t size) override {
+        int64_t row = row_;
+        for (std::size_t i = 0; i < size && i < cfg_.types.size(); i++) {
+            switch (cfg_.types[i]) {
+                case 'i':
+                    dest[i] = driver::Cell::Int64(row);
+                    break;
+                case 'u':
+                    dest[i] = driver::Cell::UInt64(uint64_t(row));
+                    break;
+                case 'd':
+                    dest[i] = driver::Cell::Double(double(row));
+                    break;
+                case 's':
+                    dest[i] = driver::Cell::String(kStringValue.data(),
+                                                   kStringValue.size());
+                    break;
+                case 'n':
+                    dest[i] = row % 2 ? driver::Cell::Int64(row)
+                                      : driver::Cell::Null(driver::Cell::Type::kInt64);
+                    break;
+            }
+        }
+    }
+    std::size_t NextBatch(driver::Batch& batch, std::size_t n) override {
+        n = std::min(n, cfg_.rows - row_);
+        batch.rows = n;
+        batch.columns.resize(cfg_.types.size());
+        for (std::size_t i = 0; i < cfg_.types.size(); i++) {
+            driver::Column& column = batch.columns[i];
+            column.name = columns_[i];
+            char type = cfg_.types[i];
+            column.Reset(type == 'd'   ? driver::Column::Type::kDouble
+                         : type == 's' ? driver::Column::Type::kString
+                                       : driver::Column::Type::kInt64,
+                         n);
+            for (std::size_t r = row_; r < row_ + n; r++) {
+                switch (type) {
+                    case 'd':
+                        column.AppendDouble(double(r + 1), true);
+                        break;
+                    case 's':
+                        column.AppendString(kStringValue.data(),
+                                            kStringValue.size(), true);
+                        break;
+                    default:
+                        column.AppendInt64(int64_t(r + 1),
+                                           type != 'n' || (r + 1) % 2);
+                        break;
+                }
+            }
+        }
+        row_ += n;
+        return n;
+    }
+
+private:
+    const FakeConfig& cfg_;
+    std::size_t row_;
+    std::vector<std::string> columns_;
+};
+
+class FakeStmt : public driver::Stmt {
+public:
+    FakeStmt(const FakeConfig& cfg, const std::string& query)
+        : cfg_(cfg),
+          num_input_(std::count(query.begin(), query.end(), '?')) {}
+    std::size_t NumInput() override { return num_input_; }
+    std::shared_ptr<driver::SQLResult> Exec(
+        const std::vector<driver::Value>& args) override {
+        Wait(cfg_);
+        return std::make_shared<FakeResult>();
+    }
+    std::shared_ptr<driver::SQLRows> Query(
+        const std::vector<driver::Value>& args) override {
+        Wait(cfg_);
+        return std::make_shared<FakeRows>(cfg_);
+    }
+
+private:
+    const FakeConfig& cfg_;
+    std::size_t num_input_;
+};
+
+class FakeConn : public driver::Conn {
+public:
+    FakeConn(const FakeConfig& cfg) : cfg_(cfg) {}
+    std::shared_ptr<driver::Stmt> Prepare(const std::string& query) override {
+        return std::make_shared<FakeStmt>(cfg_, query);
+    }
+    std::shared_ptr<driver::Tx> Begin() override { return nullptr; }
+    void EnterThread() override {}
+    void LeaveThread() override {}
+
+private:
+    // statements and rows refer to it, they never outlive the connection
+    FakeConfig cfg_;
+};
+
+} // namespace
+
+std::shared_ptr<driver::Conn> FakeDriver::Open(const std::string& dsn) {
+    return std::make_shared<FakeConn>(ParseFakeDSN(dsn));
+}
+
+} // namespace bench
+} // namespace sqlcc
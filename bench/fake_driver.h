@@ -0,0 +1,33 @@
+#pragma once
+
+#include "sqlcc/driver/driver.h"
+
+#include <chrono>
+#include <string>
+
+namespace sqlcc {
+namespace bench {
+
+// FakeConfig is parsed from the DSN of the fake driver,
+// rows=N&types=isd&latency_us=N
+struct FakeConfig {
+    // rows returned by every query
+    std::size_t rows = 100;
+    // one letter per column: i int64, u uint64, d double, s string,
+    // n int64 that is null on every other row
+    std::string types = "isd";
+    // time every Exec and Query takes
+    std::chrono::microseconds latency{0};
+};
+
+FakeConfig ParseFakeDSN(const std::string& dsn);
+
+// FakeDriver serves generated rows from memory, so benchmarks measure the
+// sqlcc layer and not a server.
+class FakeDriver : public driver::Driver {
+public:
+    std::shared_ptr<driver::Conn> Open(const std::string& dsn) override;
+};
+
+} // namespace bench
+} // namespace sqlcc
@@ -0,0 +1,674 @@
+#include "loopback_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <system_error>
+
+namespace sqlcc {
+namespace bench {
+
+namespace {
+
+// protocol constants, see the MySQL client/server protocol documentation
+const uint32_t kClientLongPassword = 1;
+const uint32_t kClientLongFlag = 4;
+const uint32_t kClientConnectWithDB = 8;
+const uint32_t kClientProtocol41 = 0x200;
+const uint32_t kClientTransactions = 0x2000;
+const uint32_t kClientSecureConnection = 0x8000;
+const uint32_t kClientMultiStatements = 0x10000;
+const uint32_t kClientMultiResults = 0x20000;
+const uint32_t kClientPSMultiResults = 0x40000;
+const uint32_t kClientPluginAuth = 0x80000;
+const uint32_t kCapabilities =
+    kClientLongPassword | kClientLongFlag | kClientConnectWithDB |
+    kClientProtocol41 | kClientTransactions | kClientSecureConnection |
+    kClientMultiStatements | kClientMultiResults | kClientPSMultiResults |
+    kClientPluginAuth;
+
+const uint16_t kStatusAutocommit = 0x0002;
+const uint16_t kStatusMoreResults = 0x0008;
+const uint16_t kStatusCursorExists = 0x0040;
+const uint16_t kStatusLastRowSent = 0x0080;
+
+const uint8_t kComQuit = 0x01;
+const uint8_t kComInitDB = 0x02;
+const uint8_t kComQuery = 0x03;
+const uint8_t kComPing = 0x0e;
+const uint8_t kComStmtPrepare = 0x16;
+const uint8_t kComStmtExecute = 0x17;
+const uint8_t kComStmtSendLongData = 0x18;
+const uint8_t kComStmtClose = 0x19;
+const uint8_t kComStmtReset = 0x1a;
+const uint8_t kComSetOption = 0x1b;
+const uint8_t kComStmtFetch = 0x1c;
+const uint8_t kComResetConnection = 0x1f;
+
+const uint8_t kTypeDouble = 5;
+const uint8_t kTypeLongLong = 8;
+const uint8_t kTypeVarString = 253;
+
+const uint8_t kCursorTypeReadOnly = 1;
+
+const uint8_t kCharsetUtf8 = 33;
+const uint8_t kCharsetBinary = 63;
+
+const std::size_t kMaxPacket = 0xffffff;
+
+void PutInt(std::string* out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out->push_back(static_cast<char>(v >> (8 * i)));
+    }
+}
+
+void PutLenEncInt(std::string* out, uint64_t v) {
+    if (v < 251) {
+        PutInt(out, v, 1);
+    } else if (v < (1 << 16)) {
+        out->push_back('\xfc');
+        PutInt(out, v, 2);
+    } else if (v < (1 << 24)) {
+        out->push_back('\xfd');
+        PutInt(out, v, 3);
+    } else {
+        out->push_back('\xfe');
+        PutInt(out, v, 8);
+    }
+}
+
+void PutLenEncString(std::string* out, const std::string& s) {
+    PutLenEncInt(out, s.size());
+    out->append(s);
+}
+
+uint32_t GetInt(const std::string& in, std::size_t pos, int bytes) {
+    uint32_t v = 0;
+    for (int i = 0; i < bytes && pos + i < in.size(); i++) {
+        v |= uint32_t(uint8_t(in[pos + i])) << (8 * i);
+    }
+    return v;
+}
+
+bool IsQuery(const std::string& sql) {
+    std::size_t i = 0;
+    while (i < sql.size() && std::isspace(uint8_t(sql[i]))) {
+        i++;
+    }
+    auto starts = [&](const char* word) {
+        std::size_t n = std::strlen(word);
+        if (sql.size() - i < n) {
+            return false;
+        }
+        for (std::size_t j = 0; j < n; j++) {
+            if (std::tolower(uint8_t(sql[i + j])) != word[j]) {
+                return false;
+            }
+        }
+        return true;
+    };
+    return starts("select") || starts("show");
+}
+
+// SplitStatements splits a multi-statement query on the semicolons outside
+// quotes
+std::vector<std::string> SplitStatements(const std::string& sql) {
+    std::vector<std::string> statements;
+    std::string current;
+    char quote = 0;
+    for (std::size_t i = 0; i < sql.size(); i++) {
+        char c = sql[i];
+        if (quote) {
+            current.push_back(c);
+            if (c == '\\' && quote != '`' && i + 1 < sql.size()) {
+                current.push_back(sql[++i]);
+            } else if (c == quote) {
+                quote = 0;
+            }
+        } else if (c == '\'' || c == '"' || c == '`') {
+            quote = c;
+            current.push_back(c);
+        } else if (c == ';') {
+            statements.push_back(std::move(current));
+            current.clear();
+        } else {
+            current.push_back(c);
+        }
+    }
+    if (!current.empty() || statements.empty()) {
+        statements.push_back(std::move(current));
+    }
+    return statements;
+}
+
+class Session {
+public:
+    Session(int fd, const LoopbackOptions& opts, uint32_t id)
+        : fd_(fd),
+          opts_(opts),
+          id_(id),
+          seq_(0),
+          insert_id_(0),
+          next_stmt_id_(1),
+          rng_(id) {}
+    void Run();
+
+private:
+    struct Statement {
+        bool query;
+        std::size_t cursor_row;
+        bool cursor_open;
+    };
+    bool ReadFull(char* buf, std::size_t n);
+    bool ReadPacket(std::string* payload);
+    void WritePacket(const std::string& payload);
+    bool Flush();
+    void Ok(uint64_t affected, uint64_t insert_id, uint16_t status);
+    void Eof(uint16_t status);
+    void Err(uint16_t code, const std::string& message);
+    void ColumnDefs();
+    void ColumnDef(const std::string& name, uint8_t type, uint32_t length,
+                   uint8_t charset);
+    void TextRow(std::size_t row);
+    void BinaryRow(std::size_t row);
+    void Handshake();
+    void Query(const std::string& sql);
+    void Prepare(const std::string& sql);
+    void Execute(const std::string& packet);
+    void Fetch(const std::string& packet);
+
+    int fd_;
+    const LoopbackOptions& opts_;
+    uint32_t id_;
+    uint8_t seq_;
+    uint64_t insert_id_;
+    uint32_t next_stmt_id_;
+    std::mt19937 rng_;
+    std::string out_;
+    std::map<uint32_t, Statement> stmts_;
+};
+
+bool Session::ReadFull(char* buf, std::size_t n) {
+    while (n > 0) {
+        ssize_t r = read(fd_, buf, n);
+        if (r <= 0) {
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += r;
+        n -= r;
+    }
+    return true;
+}
+
+bool Session::ReadPacket(std::string* payload) {
+    payload->clear();
+    for (;;) {
+        char header[4];
+        if (!ReadFull(header, sizeof(header))) {
+            return false;
+        }
+        std::size_t length = GetInt(std::string(header, 3), 0, 3);
+        seq_ = uint8_t(header[3]) + 1;
+        std::size_t offset = payload->size();
+        payload->resize(offset + length);
+        if (!ReadFull(&(*payload)[offset], length)) {
+            return false;
+        }
+        // a packet of the maximum size is continued by the next one
+        if (length < kMaxPacket) {
+            return true;
+        }
+    }
+}
+
+void Session::WritePacket(const std::string& payload) {
+    std::size_t offset = 0;
+    do {
+        std::size_t length = std::min(payload.size() - offset, kMaxPacket);
+        PutInt(&out_, length, 3);
+        out_.push_back(static_cast<char>(seq_++));
+        out_.append(payload, offset, length);
+        offset += length;
+        if (length < kMaxPacket) {
+            break;
+        }
+    } while (true);
+}
+
+bool Session::Flush() {
+    std::chrono::microseconds delay = opts_.latency;
+    if (opts_.jitter.count() > 0) {
+        std::uniform_int_distribution<int64_t> jitter(-opts_.jitter.count(),
+                                                      opts_.jitter.count());
+        delay += std::chrono::microseconds(jitter(rng_));
+    }
+    if (delay.count() > 0) {
+        std::this_thread::sleep_for(delay);
+    }
+    // bandwidth is paced in chunks of 16KiB
+    const std::size_t chunk = opts_.bandwidth ? 16 * 1024 : out_.size();
+    std::size_t offset = 0;
+    while (offset < out_.size()) {
+        std::size_t n = std::min(chunk, out_.size() - offset);
+        std::size_t written = 0;
+        while (written < n) {
+            ssize_t w = write(fd_, out_.data() + offset + written, n - written);
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                out_.clear();
+                return false;
+            }
+            written += w;
+        }
+        offset += n;
+        if (opts_.bandwidth) {
+            std::this_thread::sleep_for(
+                std::chrono::microseconds(n * 1000000 / opts_.bandwidth));
+        }
+    }
+    out_.clear();
+    return true;
+}
+
+void Session::Ok(uint64_t affected, uint64_t insert_id, uint16_t status) {
+    std::string p;
+    p.push_back('\x00');
+    PutLenEncInt(&p, affected);
+    PutLenEncInt(&p, insert_id);
+    PutInt(&p, status, 2);
+    PutInt(&p, 0, 2);
+    WritePacket(p);
+}
+
+void Session::Eof(uint16_t status) {
+    std::string p;
+    p.push_back('\xfe');
+    PutInt(&p, 0, 2);
+    PutInt(&p, status, 2);
+    WritePacket(p);
+}
+
+void Session::Err(uint16_t code, const std::string& message) {
+    std::string p;
+    p.push_back('\xff');
+    PutInt(&p, code, 2);
+    p.append("#HY000");
+    p.append(message);
+    WritePacket(p);
+}
+
+void Session::ColumnDef(const std::string& name, uint8_t type,
+                        uint32_t length, uint8_t charset) {
+    std::string p;
+    PutLenEncString(&p, "def");
+    PutLenEncString(&p, "testdb");
+    PutLenEncString(&p, "t");
+    PutLenEncString(&p, "t");
+    PutLenEncString(&p, name);
+    PutLenEncString(&p, name);
+    PutLenEncInt(&p, 0x0c);
+    PutInt(&p, charset, 2);
+    PutInt(&p, length, 4);
+    PutInt(&p, type, 1);
+    PutInt(&p, 0, 2);
+    PutInt(&p, 0, 1);
+    PutInt(&p, 0, 2);
+    WritePacket(p);
+}
+
+void Session::ColumnDefs() {
+    for (std::size_t i = 0; i < opts_.types.size(); i++) {
+        std::string name = "c" + std::to_string(i);
+        switch (opts_.types[i]) {
+            case 'd':
+                ColumnDef(name, kTypeDouble, 22, kCharsetBinary);
+                break;
+            case 's':
+                ColumnDef(name, kTypeVarString, 255, kCharsetUtf8);
+                break;
+            default:
+                ColumnDef(name, kTypeLongLong, 20, kCharsetBinary);
+                break;
+        }
+    }
+}
+
+std::string StringValue(std::size_t row) {
+    return "value " + std::to_string(row);
+}
+
+double DoubleValue(std::size_t row) { return row + 0.5; }
+
+bool IsNull(char type, std::size_t row) { return type == 'n' && row % 2 == 0; }
+
+void Session::TextRow(std::size_t row) {
+    std::string p;
+    for (char type : opts_.types) {
+        if (IsNull(type, row)) {
+            p.push_back('\xfb');
+            continue;
+        }
+        switch (type) {
+            case 'd': {
+                char buf[32];
+                std::snprintf(buf, sizeof(buf), "%.17g", DoubleValue(row));
+                PutLenEncString(&p, buf);
+                break;
+            }
+            case 's':
+                PutLenEncString(&p, StringValue(row));
+                break;
+            default:
+                PutLenEncString(&p, std::to_string(row));
+                break;
+        }
+    }
+    WritePacket(p);
+}
+
+void Session::BinaryRow(std::size_t row) {
+    std::string p;
+    p.push_back('\x00');
+    // the null bitmap of binary rows starts at bit 2
+    std::size_t bitmap = p.size();
+    p.append((opts_.types.size() + 7 + 2) / 8, '\x00');
+    for (std::size_t i = 0; i < opts_.types.size(); i++) {
+        char type = opts_.types[i];
+        if (IsNull(type, row)) {
+            p[bitmap + (i + 2) / 8] |= char(1 << ((i + 2) % 8));
+            continue;
+        }
+        switch (type) {
+            case 'd': {
+                double v = DoubleValue(row);
+                uint64_t bits;
+                std::memcpy(&bits, &v, sizeof(bits));
+                PutInt(&p, bits, 8);
+                break;
+            }
+            case 's':
+                PutLenEncString(&p, StringValue(row));
+                break;
+            default:
+                PutInt(&p, row, 8);
+                break;
+        }
+    }
+    WritePacket(p);
+}
+
+void Session::Handshake() {
+    std::string p;
+    p.push_back('\x0a');
+    p.append("5.7.99-sqlcc-loopback");
+    p.push_back('\0');
+    PutInt(&p, id_, 4);
+    // the scramble is never checked
+    p.append("abcdefgh");
+    p.push_back('\0');
+    PutInt(&p, kCapabilities & 0xffff, 2);
+    PutInt(&p, kCharsetUtf8, 1);
+    PutInt(&p, kStatusAutocommit, 2);
+    PutInt(&p, kCapabilities >> 16, 2);
+    PutInt(&p, 21, 1);
+    p.append(10, '\0');
+    p.append("ijklmnopqrst");
+    p.push_back('\0');
+    p.append("mysql_native_password");
+    p.push_back('\0');
+    WritePacket(p);
+}
+
+void Session::Query(const std::string& sql) {
+    std::vector<std::string> statements = SplitStatements(sql);
+    for (std::size_t i = 0; i < statements.size(); i++) {
+        uint16_t status = kStatusAutocommit;
+        if (i + 1 < statements.size()) {
+            status |= kStatusMoreResults;
+        }
+        if (!IsQuery(statements[i])) {
+            Ok(1, ++insert_id_, status);
+            continue;
+        }
+        std::string count;
+        PutLenEncInt(&count, opts_.types.size());
+        WritePacket(count);
+        ColumnDefs();
+        Eof(kStatusAutocommit);
+        for (std::size_t row = 1; row <= opts_.rows; row++) {
+            TextRow(row);
+        }
+        Eof(status);
+    }
+}
+
+void Session::Prepare(const std::string& sql) {
+    uint32_t stmt_id = next_stmt_id_++;
+    bool query = IsQuery(sql);
+    stmts_[stmt_id] = Statement{query, 0, false};
+    uint16_t params = std::count(sql.begin(), sql.end(), '?');
+    uint16_t columns = query ? opts_.types.size() : 0;
+
+    std::string p;
+    p.push_back('\x00');
+    PutInt(&p, stmt_id, 4);
+    PutInt(&p, columns, 2);
+    PutInt(&p, params, 2);
+    p.push_back('\x00');
+    PutInt(&p, 0, 2);
+    WritePacket(p);
+    if (params > 0) {
+        for (uint16_t i = 0; i < params; i++) {
+            ColumnDef("?", kTypeVarString, 0, kCharsetBinary);
+        }
+        Eof(kStatusAutocommit);
+    }
+    if (columns > 0) {
+        ColumnDefs();
+        Eof(kStatusAutocommit);
+    }
+}
+
+void Session::Execute(const std::string& packet) {
+    uint32_t stmt_id = GetInt(packet, 1, 4);
+    uint8_t flags = packet.size() > 5 ? uint8_t(packet[5]) : 0;
+    auto it = stmts_.find(stmt_id);
+    if (it == stmts_.end()) {
+        Err(1243, "Unknown prepared statement handler");
+        return;
+    }
+    Statement& stmt = it->second;
+    if (!stmt.query) {
+        Ok(1, ++insert_id_, kStatusAutocommit);
+        return;
+    }
+    std::string count;
+    PutLenEncInt(&count, opts_.types.size());
+    WritePacket(count);
+    ColumnDefs();
+    if (flags & kCursorTypeReadOnly) {
+        // rows are sent on COM_STMT_FETCH
+        stmt.cursor_row = 1;
+        stmt.cursor_open = true;
+        Eof(kStatusAutocommit | kStatusCursorExists);
+        return;
+    }
+    Eof(kStatusAutocommit);
+    for (std::size_t row = 1; row <= opts_.rows; row++) {
+        BinaryRow(row);
+    }
+    Eof(kStatusAutocommit);
+}
+
+void Session::Fetch(const std::string& packet) {
+    uint32_t stmt_id = GetInt(packet, 1, 4);
+    uint32_t n = GetInt(packet, 5, 4);
+    auto it = stmts_.find(stmt_id);
+    if (it == stmts_.end() || !it->second.cursor_open) {
+        Err(1421, "The statement has no open cursor");
+        return;
+    }
+    Statement& stmt = it->second;
+    for (uint32_t i = 0; i < n && stmt.cursor_row <= opts_.rows; i++) {
+        BinaryRow(stmt.cursor_row++);
+    }
+    uint16_t status = kStatusAutocommit | kStatusCursorExists;
+    if (stmt.cursor_row > opts_.rows) {
+        status |= kStatusLastRowSent;
+        stmt.cursor_open = false;
+    }
+    Eof(status);
+}
+
+void Session::Run() {
+    seq_ = 0;
+    Handshake();
+    if (!Flush()) {
+        return;
+    }
+    std::string packet;
+    // the handshake response is not checked, every user is welcome
+    if (!ReadPacket(&packet)) {
+        return;
+    }
+    Ok(0, 0, kStatusAutocommit);
+    if (!Flush()) {
+        return;
+    }
+    while (ReadPacket(&packet)) {
+        if (packet.empty()) {
+            continue;
+        }
+        seq_ = 1;
+        switch (uint8_t(packet[0])) {
+            case kComQuit:
+                return;
+            case kComInitDB:
+            case kComPing:
+            case kComResetConnection:
+                Ok(0, 0, kStatusAutocommit);
+                break;
+            case kComQuery:
+                Query(packet.substr(1));
+                break;
+            case kComStmtPrepare:
+                Prepare(packet.substr(1));
+                break;
+            case kComStmtExecute:
+                Execute(packet);
+                break;
+            case kComStmtFetch:
+                Fetch(packet);
+                break;
+            case kComStmtReset: {
+                auto it = stmts_.find(GetInt(packet, 1, 4));
+                if (it != stmts_.end()) {
+                    it->second.cursor_open = false;
+                }
+                Ok(0, 0, kStatusAutocommit);
+                break;
+            }
+            case kComStmtClose:
+                stmts_.erase(GetInt(packet, 1, 4));
+                continue;
+            case kComStmtSendLongData:
+                continue;
+            case kComSetOption:
+                Eof(kStatusAutocommit);
+                break;
+            default:
+                Err(1047, "Unknown command");
+                break;
+        }
+        if (!Flush()) {
+            return;
+        }
+    }
+}
+
+} // namespace
+
+LoopbackServer::LoopbackServer(const LoopbackOptions& opts)
+    : opts_(opts), listen_fd_(-1), port_(0), stop_(false) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw std::system_error(errno, std::system_category(), "socket");
+    }
+    int one = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(opts_.port);
+    socklen_t len = sizeof(addr);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+        listen(listen_fd_, 128) != 0 ||
+        getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+        int err = errno;
+        close(listen_fd_);
+        throw std::system_error(err, std::system_category(), "listen");
+    }
+    port_ = ntohs(addr.sin_port);
+    accept_thread_ = std::thread(&LoopbackServer::Accept, this);
+}
+
+LoopbackServer::~LoopbackServer() {
+    stop_ = true;
+    shutdown(listen_fd_, SHUT_RDWR);
+    accept_thread_.join();
+    close(listen_fd_);
+    std::lock_guard<std::mutex> lock(mu_);
+    for (int fd : fds_) {
+        shutdown(fd, SHUT_RDWR);
+    }
+    for (std::thread& session : sessions_) {
+        session.join();
+    }
+    for (int fd : fds_) {
+        close(fd);
+    }
+}
+
+std::string LoopbackServer::DSN() const {
+    return "root:toor@tcp(127.0.0.1:" + std::to_string(port_) + ")/testdb";
+}
+
+void LoopbackServer::Accept() {
+    uint32_t id = 0;
+    while (!stop_) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::lock_guard<std::mutex> lock(mu_);
+        fds_.push_back(fd);
+        sessions_.emplace_back([this, fd, id] {
+            Session session(fd, opts_, id);
+            session.Run();
+        });
+        id++;
+    }
+}
+
+} // namespace bench
+} // namespace sqlcc
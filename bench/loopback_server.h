@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sqlcc {
+namespace bench {
+
+struct LoopbackOptions {
+    // 0 picks a free port
+    uint16_t port = 0;
+    // rows of every result set
+    std::size_t rows = 100;
+    // one letter per column: i bigint, d double, s varchar, n bigint that
+    // is null on every other row
+    std::string types = "isd";
+    // added to every response, like a network round trip
+    std::chrono::microseconds latency{0};
+    // latency varies uniformly by up to this much either way
+    std::chrono::microseconds jitter{0};
+    // bytes per second written to a connection, 0 is unlimited
+    uint64_t bandwidth = 0;
+};
+
+// LoopbackServer speaks enough of the MySQL client/server protocol on
+// 127.0.0.1 to serve canned result sets to the mysql driver: handshake,
+// text queries including multi-statements, prepared statements with
+// binary rows and read only cursors. Statements starting with SELECT or
+// SHOW return the canned result set, any other statement affects one row.
+class LoopbackServer {
+public:
+    explicit LoopbackServer(const LoopbackOptions& opts = LoopbackOptions());
+    ~LoopbackServer();
+    LoopbackServer(const LoopbackServer&) = delete;
+    LoopbackServer& operator=(const LoopbackServer&) = delete;
+    uint16_t Port() const { return port_; }
+    // DSN returns a mysql driver DSN for the server
+    std::string DSN() const;
+
+private:
+    void Accept();
+    LoopbackOptions opts_;
+    int listen_fd_;
+    uint16_t port_;
+    std::atomic<bool> stop_;
+    std::thread accept_thread_;
+    // sessions are shut down and joined on destruction
+    std::mutex mu_;
+    std::vector<int> fds_;
+    std::vector<std::thread> sessions_;
+};
+
+} // namespace bench
+} // namespace sqlcc
@@ -0,0 +1,321 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "fake_driver.h"
+#include "loopback_server.h"
+#include "sqlcc/sqlcc.h"
+
+static std::atomic<int64_t> allocations{0};
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = std::malloc(size ? size : 1);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace sqlcc {
+namespace bench {
+
+static DB OpenFake(const std::string& dsn) {
+    static bool registered =
+        (driver::RegisterDriver("fake", std::make_shared<FakeDriver>()), true);
+    (void)registered;
+    return Open("fake", dsn);
+}
+
+// AllocationCounter reports the heap allocations per iteration of the
+// benchmark loop it lives across.
+class AllocationCounter {
+public:
+    AllocationCounter(benchmark::State& state)
+        : state_(state), start_(allocations.load()) {}
+    ~AllocationCounter() {
+        state_.counters["allocs"] =
+            benchmark::Counter(double(allocations.load() - start_),
+                               benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    benchmark::State& state_;
+    int64_t start_;
+};
+
+static void BM_MergeConstValues(benchmark::State& state) {
+    std::string name = "name";
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        std::vector<driver::Value> values =
+            MergeConstValues(int64_t(1), name, 3.5);
+        benchmark::DoNotOptimize(values.data());
+    }
+}
+BENCHMARK(BM_MergeConstValues);
+
+// per query overhead of DatabaseImpl::exec, arg is the simulated latency
+static void BM_Exec(benchmark::State& state) {
+    DB db = OpenFake("rows=0&latency_us=" + std::to_string(state.range(0)));
+    db->exec("insert into t (a, b) values(?, ?)", 1, "name");
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        Result result = db->exec("insert into t (a, b) values(?, ?)", 1, "name");
+        benchmark::DoNotOptimize(result.get());
+    }
+}
+BENCHMARK(BM_Exec)->Arg(0)->Arg(50)->UseRealTime();
+
+static void BM_StmtExec(benchmark::State& state) {
+    DB db = OpenFake("rows=0");
+    Stmt stmt = db->Prepare("insert into t (a, b) values(?, ?)");
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        Result result = stmt->Exec(1, "name");
+        benchmark::DoNotOptimize(result.get());
+    }
+}
+BENCHMARK(BM_StmtExec);
+
+// BM_StmtExec with arg no-op interceptors installed
+static void BM_StmtExecIntercepted(benchmark::State& state) {
+    DB db = OpenFake("rows=0");
+    for (int i = 0; i < state.range(0); i++) {
+        db->AddInterceptor(std::make_shared<Interceptor>());
+    }
+    Stmt stmt = db->Prepare("insert into t (a, b) values(?, ?)");
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        Result result = stmt->Exec(1, "name");
+        benchmark::DoNotOptimize(result.get());
+    }
+}
+BENCHMARK(BM_StmtExecIntercepted)->Arg(1)->Arg(4);
+
+// per query overhead of a single row query
+static void BM_Query(benchmark::State& state) {
+    DB db = OpenFake("rows=1&types=isd");
+    int64_t id;
+    std::string name;
+    double score;
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        Rows rows = db->query("select id, name, score from t where id = ?", 1);
+        while (rows->Next()) {
+            rows->scan(&id, &name, &score);
+        }
+    }
+    benchmark::DoNotOptimize(id);
+}
+BENCHMARK(BM_Query);
+
+// per row overhead of RowsImpl::Next
+static void BM_RowsNext(benchmark::State& state) {
+    DB db = OpenFake("rows=" + std::to_string(state.range(0)));
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        Rows rows = db->query("select id, name, score from t");
+        while (rows->Next()) {
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RowsNext)->Arg(1)->Arg(100)->Arg(10000);
+
+// acquire and release of a pooled connection from many threads, arg is
+// the pool mode: 0 the locked idle list, 1 thread affinity, 2 sharding
+static void BM_ConnAcquire(benchmark::State& state) {
+    static DB db;
+    if (state.thread_index() == 0) {
+        db = OpenFake("rows=0");
+        db->SetMaxIdleConns(256);
+        db->SetThreadAffinity(state.range(0) == 1);
+        db->SetSharding(state.range(0) == 2);
+    }
+    for (auto _ : state) {
+        std::shared_ptr<Connection> conn = db->Conn();
+        benchmark::DoNotOptimize(conn.get());
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        state.counters["conns"] = db->Stats().open_connections;
+        db.reset();
+    }
+}
+BENCHMARK(BM_ConnAcquire)
+    ->Arg(0)
+    ->Arg(1)
+    ->Arg(2)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+
+// per row overhead of Next and a typed scan
+static void BM_Scan(benchmark::State& state) {
+    DB db = OpenFake("rows=" + std::to_string(state.range(0)) + "&types=isdn");
+    int64_t id;
+    std::string name;
+    double score;
+    driver::NullInt64 parent;
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        Rows rows = db->query("select id, name, score, parent from t");
+        while (rows->Next()) {
+            rows->scan(&id, &name, &score, &parent);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    benchmark::DoNotOptimize(id);
+}
+BENCHMARK(BM_Scan)->Arg(1)->Arg(100)->Arg(10000);
+
+struct Item {
+    int64_t id;
+    std::string name;
+    double score;
+    driver::NullInt64 parent;
+};
+
+}  // namespace bench
+
+template <>
+struct RowMapping<bench::Item> {
+    static constexpr auto Fields() {
+        return std::make_tuple(MapField("c0", &bench::Item::id),
+                               MapField("c1", &bench::Item::name),
+                               MapField("c2", &bench::Item::score),
+                               MapField("c3", &bench::Item::parent));
+    }
+};
+
+namespace bench {
+
+// BM_Scan with the rows mapped into a vector of structs
+static void BM_QueryAll(benchmark::State& state) {
+    DB db = OpenFake("rows=" + std::to_string(state.range(0)) + "&types=isdn");
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        std::vector<Item> items =
+            db->QueryAll<Item>("select id, name, score, parent from t");
+        benchmark::DoNotOptimize(items.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_QueryAll)->Arg(1)->Arg(100)->Arg(10000);
+
+// per row overhead of Next and a borrowed cell scan
+static void BM_ScanCells(benchmark::State& state) {
+    DB db = OpenFake("rows=" + std::to_string(state.range(0)) + "&types=isdn");
+    std::vector<driver::Cell> cells;
+    int64_t sum = 0;
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        Rows rows = db->query("select id, name, score, parent from t");
+        while (rows->Next()) {
+            rows->ScanCells(cells);
+            sum += cells[0].AsInt64() + cells[1].AsString().size();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    benchmark::DoNotOptimize(sum);
+}
+BENCHMARK(BM_ScanCells)->Arg(1)->Arg(100)->Arg(10000);
+
+static void BM_NextBatch(benchmark::State& state) {
+    DB db = OpenFake("rows=" + std::to_string(state.range(0)) + "&types=isd");
+    driver::Batch batch;
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        Rows rows = db->query("select id, name, score from t");
+        while (rows->NextBatch(batch, 1024)) {
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_NextBatch)->Arg(100)->Arg(10000);
+
+// the mysql driver against LoopbackServer, arg is the latency per round
+// trip in microseconds
+
+static LoopbackOptions Loopback(int64_t latency_us, std::size_t rows) {
+    LoopbackOptions opts;
+    opts.rows = rows;
+    opts.types = "isd";
+    opts.latency = std::chrono::microseconds(latency_us);
+    return opts;
+}
+
+static void BM_MySQLStmtExec(benchmark::State& state) {
+    LoopbackServer server(Loopback(state.range(0), 0));
+    DB db = Open("mysql", server.DSN());
+    Stmt stmt = db->Prepare("insert into t (a, b) values(?, ?)");
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        Result result = stmt->Exec(1, "name");
+        benchmark::DoNotOptimize(result.get());
+    }
+}
+BENCHMARK(BM_MySQLStmtExec)->Arg(0)->Arg(100)->UseRealTime();
+
+// per row cost of a result set, arg is the result mode
+static void BM_MySQLQuery(benchmark::State& state) {
+    LoopbackServer server(Loopback(0, 1000));
+    DB db = Open("mysql", server.DSN());
+    driver::QueryOptions opts;
+    opts.mode = driver::ResultMode(state.range(0));
+    int64_t id;
+    std::string name;
+    double score;
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        Rows rows = db->query(opts, "select id, name, score from t");
+        while (rows->Next()) {
+            rows->scan(&id, &name, &score);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 1000);
+    benchmark::DoNotOptimize(id);
+}
+BENCHMARK(BM_MySQLQuery)
+    ->Arg(int(driver::ResultMode::kStream))
+    ->Arg(int(driver::ResultMode::kBuffered))
+    ->Arg(int(driver::ResultMode::kCursor))
+    ->UseRealTime();
+
+// ten inserts one by one, against BM_MySQLPipeline
+static void BM_MySQLSequential(benchmark::State& state) {
+    LoopbackServer server(Loopback(state.range(0), 0));
+    DB db = Open("mysql", server.DSN());
+    for (auto _ : state) {
+        for (int i = 0; i < 10; i++) {
+            db->exec("insert into t (a, b) values(?, ?)", i, "name");
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 10);
+}
+BENCHMARK(BM_MySQLSequential)->Arg(0)->Arg(100)->UseRealTime();
+
+static void BM_MySQLPipeline(benchmark::State& state) {
+    LoopbackServer server(Loopback(state.range(0), 0));
+    DB db = Open("mysql", server.DSN());
+    for (auto _ : state) {
+        std::shared_ptr<Pipeline> pipeline = db->NewPipeline();
+        for (int i = 0; i < 10; i++) {
+            pipeline->Add("insert into t (a, b) values(?, ?)", i, "name");
+        }
+        pipeline->Send();
+        while (pipeline->Next()) {
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 10);
+}
+BENCHMARK(BM_MySQLPipeline)->Arg(0)->Arg(100)->UseRealTime();
+
+} // namespace bench
+} // namespace sqlcc
+
+BENCHMARK_MAIN();
@@ -0,0 +1,393 @@
+#include "buffered_rows.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+
+namespace sqlcc {
+
+using driver::Cell;
+
+std::shared_ptr<const BufferedResult> Buffer(SQLRows& rows) {
+    std::shared_ptr<BufferedResult> result = std::make_shared<BufferedResult>();
+    result->columns = rows.Columns();
+    // string cells are pointed into text once it stops growing
+    std::vector<std::pair<std::size_t, std::size_t>> strings;
+    std::vector<Cell> row;
+    while (rows.Next()) {
+        rows.ScanCells(row);
+        for (const Cell& cell : row) {
+            if (cell.type() == Cell::Type::kString && !cell.IsNull()) {
+                std::string_view s = cell.AsString();
+                strings.emplace_back(result->cells.size(),
+                                     result->text.size());
+                result->text.append(s.data(), s.size());
+            }
+            result->cells.push_back(cell);
+        }
+        result->rows++;
+    }
+    for (std::size_t i = 0; i < strings.size(); i++) {
+        std::size_t end = i + 1 < strings.size() ? strings[i + 1].second
+                                                 : result->text.size();
+        result->cells[strings[i].first] =
+            Cell::String(result->text.data() + strings[i].second,
+                         end - strings[i].second);
+    }
+    return result;
+}
+
+namespace {
+
+// conversions of a buffered cell to the scanned types, they accept what
+// the scan of the driver rows does. Numbers in string cells are parsed
+// the way the MySQL text protocol sends them.
+
+const char* TypeName(const int64_t*) { return "int64_t"; }
+const char* TypeName(const uint64_t*) { return "uint64_t"; }
+const char* TypeName(const double*) { return "double"; }
+const char* TypeName(const std::string*) { return "string"; }
+const char* TypeName(const std::tm*) { return "tm"; }
+const char* TypeName(const driver::TimePoint*) { return "time_point"; }
+
+template <typename T>
+[[noreturn]] void CantConvert(const Cell& cell) {
+    std::string text = "can't bind to ";
+    text += TypeName(static_cast<T*>(nullptr));
+    if (cell.type() == Cell::Type::kString) {
+        text += ": ";
+        text += cell.AsString();
+    }
+    throw Exception(400, text);
+}
+
+// Parse reads a number that has to span the whole text
+template <typename T>
+T Parse(const Cell& cell) {
+    std::string_view text = cell.AsString();
+    T v{};
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), v);
+    if (ec != std::errc() || end != text.data() + text.size()) {
+        CantConvert<T>(cell);
+    }
+    return v;
+}
+
+template <typename T>
+T CellTo(const Cell& cell);
+
+template <>
+int64_t CellTo<int64_t>(const Cell& cell) {
+    switch (cell.type()) {
+        case Cell::Type::kString:
+            return Parse<int64_t>(cell);
+        case Cell::Type::kDouble:
+            CantConvert<int64_t>(cell);
+        default:
+            return cell.AsInt64();
+    }
+}
+
+template <>
+uint64_t CellTo<uint64_t>(const Cell& cell) {
+    switch (cell.type()) {
+        case Cell::Type::kString:
+            return Parse<uint64_t>(cell);
+        case Cell::Type::kDouble:
+            CantConvert<uint64_t>(cell);
+        default:
+            return cell.AsUInt64();
+    }
+}
+
+template <>
+double CellTo<double>(const Cell& cell) {
+    if (cell.type() == Cell::Type::kString) {
+        return Parse<double>(cell);
+    }
+    return cell.AsDouble();
+}
+
+template <>
+std::string CellTo<std::string>(const Cell& cell) {
+    if (cell.type() != Cell::Type::kString) {
+        CantConvert<std::string>(cell);
+    }
+    return std::string(cell.AsString());
+}
+
+// ParseTime reads YYYY-MM-DD[ hh:mm:ss[.ffffff]]
+std::tm ParseTime(const Cell& cell, int64_t* micros) {
+    std::string text(cell.AsString());
+    std::tm tm = {};
+    char fraction[8] = {};
+    int n = std::sscanf(text.c_str(), "%d-%d-%d %d:%d:%d.%6[0-9]",
+                        &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour,
+                        &tm.tm_min, &tm.tm_sec, fraction);
+    if (n < 3) {
+        throw Exception(400, "can't convert " + text + " to time");
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    *micros = 0;
+    // fraction is zero filled past its digits
+    for (int i = 0; i < 6; i++) {
+        *micros = *micros * 10 + (fraction[i] ? fraction[i] - '0' : 0);
+    }
+    return tm;
+}
+
+template <>
+std::tm CellTo<std::tm>(const Cell& cell) {
+    int64_t micros;
+    return ParseTime(cell, &micros);
+}
+
+template <>
+driver::TimePoint CellTo<driver::TimePoint>(const Cell& cell) {
+    int64_t micros;
+    std::tm tm = ParseTime(cell, &micros);
+    std::time_t seconds = timegm(&tm);
+    return driver::TimePoint(std::chrono::seconds(seconds) +
+                             std::chrono::microseconds(micros));
+}
+
+template <typename T>
+T NotNullTo(const Cell& cell) {
+    if (cell.IsNull()) {
+        throw Exception(400, std::string("can't bind null to ") +
+                                 TypeName(static_cast<T*>(nullptr)));
+    }
+    return CellTo<T>(cell);
+}
+
+template <typename T>
+driver::NullValue<T> NullTo(const Cell& cell) {
+    if (cell.IsNull()) {
+        return driver::NullValue<T>();
+    }
+    return driver::NullValue<T>(CellTo<T>(cell));
+}
+
+template <typename T>
+struct IsNullValue : std::false_type {};
+
+template <typename T>
+struct IsNullValue<driver::NullValue<T>> : std::true_type {
+    using type = T;
+};
+
+template <typename T>
+void Store(const Cell& cell, void* dest) {
+    *static_cast<T*>(dest) = NotNullTo<T>(cell);
+}
+
+// Fits tells whether v is in the range of T
+template <typename T, typename From>
+bool Fits(From v) {
+    if constexpr (!std::is_integral<T>::value) {
+        return true;
+    } else if constexpr (std::is_signed<From>::value) {
+        if (v < 0) {
+            return std::is_signed<T>::value &&
+                   v >= From(std::numeric_limits<T>::min());
+        }
+        return uint64_t(v) <= uint64_t(std::numeric_limits<T>::max());
+    } else {
+        return v <= uint64_t(std::numeric_limits<T>::max());
+    }
+}
+
+template <typename T, typename From>
+void StoreAs(const Cell& cell, void* dest) {
+    From v = NotNullTo<From>(cell);
+    if (!Fits<T>(v)) {
+        throw Exception(400, "can't bind integer out of range");
+    }
+    *static_cast<T*>(dest) = static_cast<T>(v);
+}
+
+template <typename T>
+void StoreNull(const Cell& cell, void* dest) {
+    *static_cast<driver::NullValue<T>*>(dest) = NullTo<T>(cell);
+}
+
+}  // namespace
+
+std::size_t BufferedRows::ReadColumn(std::size_t idx, uint64_t offset,
+                             char* buf, std::size_t size) {
+    if (idx >= result_->columns.size()) {
+        throw Exception(400, "sql: column index out of range");
+    }
+    const Cell& cell = Row()[idx];
+    if (cell.type() != Cell::Type::kString) {
+        throw Exception(400, "sql: can't read column " +
+                                 result_->columns[idx] + " in chunks");
+    }
+    if (cell.IsNull()) {
+        return 0;
+    }
+    std::string_view s = cell.AsString();
+    if (offset >= s.size()) {
+        return 0;
+    }
+    std::size_t n = std::min<std::size_t>(size, s.size() - offset);
+    std::memcpy(buf, s.data() + offset, n);
+    return n;
+}
+
+void BufferedRows::DoScan(std::vector<driver::Value>& dest) {
+    const Cell* row = Row();
+    std::size_t size = result_->columns.size();
+    if (dest.size() != size) {
+        throw Exception(400, "sql: expected " + std::to_string(size) +
+                                 " destination arguments in Scan, not " +
+                                 std::to_string(dest.size()));
+    }
+    for (std::size_t i = 0; i < size; i++) {
+        std::visit(
+            [&row, i](auto&& v) {
+                using V = std::decay_t<decltype(v)>;
+                if constexpr (IsNullValue<V>::value) {
+                    v = NullTo<typename IsNullValue<V>::type>(row[i]);
+                } else {
+                    v = NotNullTo<V>(row[i]);
+                }
+            },
+            dest[i]);
+    }
+}
+
+void BufferedRows::DoScanTyped(const driver::ScanType* types, void* const* dest,
+                             std::size_t size) {
+    using driver::ScanType;
+    const Cell* row = Row();
+    if (size != result_->columns.size()) {
+        throw Exception(400, "sql: expected " +
+                                 std::to_string(result_->columns.size()) +
+                                 " destination arguments in scan, not " +
+                                 std::to_string(size));
+    }
+    for (std::size_t i = 0; i < size; i++) {
+        const Cell& cell = row[i];
+        switch (types[i]) {
+            case ScanType::kBool:
+                *static_cast<bool*>(dest[i]) = NotNullTo<int64_t>(cell) != 0;
+                break;
+            case ScanType::kInt8:
+                StoreAs<int8_t, int64_t>(cell, dest[i]);
+                break;
+            case ScanType::kInt16:
+                StoreAs<int16_t, int64_t>(cell, dest[i]);
+                break;
+            case ScanType::kInt32:
+                StoreAs<int32_t, int64_t>(cell, dest[i]);
+                break;
+            case ScanType::kInt64:
+                Store<int64_t>(cell, dest[i]);
+                break;
+            case ScanType::kUInt8:
+                StoreAs<uint8_t, uint64_t>(cell, dest[i]);
+                break;
+            case ScanType::kUInt16:
+                StoreAs<uint16_t, uint64_t>(cell, dest[i]);
+                break;
+            case ScanType::kUInt32:
+                StoreAs<uint32_t, uint64_t>(cell, dest[i]);
+                break;
+            case ScanType::kUInt64:
+                Store<uint64_t>(cell, dest[i]);
+                break;
+            case ScanType::kFloat:
+                StoreAs<float, double>(cell, dest[i]);
+                break;
+            case ScanType::kDouble:
+                Store<double>(cell, dest[i]);
+                break;
+            case ScanType::kString:
+                Store<std::string>(cell, dest[i]);
+                break;
+            case ScanType::kTm:
+                Store<std::tm>(cell, dest[i]);
+                break;
+            case ScanType::kTimePoint:
+                Store<driver::TimePoint>(cell, dest[i]);
+                break;
+            case ScanType::kNullInt64:
+                StoreNull<int64_t>(cell, dest[i]);
+                break;
+            case ScanType::kNullUInt64:
+                StoreNull<uint64_t>(cell, dest[i]);
+                break;
+            case ScanType::kNullDouble:
+                StoreNull<double>(cell, dest[i]);
+                break;
+            case ScanType::kNullString:
+                StoreNull<std::string>(cell, dest[i]);
+                break;
+            case ScanType::kNullTm:
+                StoreNull<std::tm>(cell, dest[i]);
+                break;
+            case ScanType::kNullTimePoint:
+                StoreNull<driver::TimePoint>(cell, dest[i]);
+                break;
+        }
+    }
+}
+
+std::size_t BufferedRows::NextBatch(driver::Batch& batch, std::size_t n) {
+    using driver::Column;
+    std::size_t ncols = result_->columns.size();
+    std::size_t rows = std::min(n, result_->rows - std::min(next_,
+                                                            result_->rows));
+    batch.columns.resize(ncols);
+    for (std::size_t c = 0; c < ncols; c++) {
+        // the type of the first value decides, strings when all are null
+        Column::Type type = Column::Type::kString;
+        for (std::size_t r = 0; r < result_->rows; r++) {
+            const Cell& cell = result_->cells[r * ncols + c];
+            if (!cell.IsNull()) {
+                if (cell.type() == Cell::Type::kDouble) {
+                    type = Column::Type::kDouble;
+                } else if (cell.type() != Cell::Type::kString) {
+                    type = Column::Type::kInt64;
+                }
+                break;
+            }
+        }
+        Column& column = batch.columns[c];
+        column.name = result_->columns[c];
+        column.Reset(type, rows);
+        for (std::size_t r = next_; r < next_ + rows; r++) {
+            const Cell& cell = result_->cells[r * ncols + c];
+            bool valid = !cell.IsNull();
+            switch (type) {
+                case Column::Type::kInt64:
+                    column.AppendInt64(valid ? CellTo<int64_t>(cell) : 0,
+                                       valid);
+                    break;
+                case Column::Type::kDouble:
+                    column.AppendDouble(valid ? CellTo<double>(cell) : 0,
+                                        valid);
+                    break;
+                case Column::Type::kString: {
+                    std::string_view s =
+                        valid ? cell.AsString() : std::string_view();
+                    column.AppendString(s.data(), s.size(), valid);
+                    break;
+                }
+            }
+        }
+    }
+    next_ += rows;
+    row_ = nullptr;
+    batch.rows = rows;
+    return rows;
+}
+
+}  // namespace sqlcc
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "sqlcc/sqlcc.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sqlcc {
+
+// BufferedResult is a result set read in full, row major cells with their
+// strings in a single buffer
+struct BufferedResult {
+    std::vector<std::string> columns;
+    std::size_t rows = 0;
+    std::vector<driver::Cell> cells;
+    std::string text;
+
+    std::size_t Bytes() const {
+        std::size_t bytes = sizeof(*this) +
+                            cells.size() * sizeof(driver::Cell) + text.size();
+        for (const std::string& c : columns) {
+            bytes += sizeof(c) + c.size();
+        }
+        return bytes;
+    }
+};
+
+// Buffer reads the remaining rows of rows into a result
+std::shared_ptr<const BufferedResult> Buffer(SQLRows& rows);
+
+// BufferedRows iterates a buffered result without holding a connection,
+// many may share the result. Reaching the end does not close them, so a
+// result can be read again after Seek.
+class BufferedRows : public SQLRows {
+   public:
+    explicit BufferedRows(std::shared_ptr<const BufferedResult> result)
+        : result_(std::move(result)) {}
+    const std::vector<std::string>& Columns() const override {
+        return result_->columns;
+    }
+    bool Next() override {
+        if (next_ >= result_->rows) {
+            row_ = nullptr;
+            return false;
+        }
+        row_ = result_->cells.data() + next_ * result_->columns.size();
+        next_++;
+        return true;
+    }
+    void Close() override {
+        next_ = result_->rows;
+        row_ = nullptr;
+    }
+    int64_t RowCount() override { return result_->rows; }
+    void Seek(uint64_t row) override { next_ = row; }
+    std::size_t NextBatch(driver::Batch& batch, std::size_t n) override;
+    void ScanCells(std::vector<driver::Cell>& cells) override {
+        cells.assign(Row(), Row() + result_->columns.size());
+    }
+    std::size_t ReadColumn(std::size_t idx, uint64_t offset, char* buf,
+                           std::size_t size) override;
+
+   protected:
+    void DoScan(std::vector<driver::Value>& dest) override;
+    void DoScanTyped(const driver::ScanType* types, void* const* dest,
+                     std::size_t size) override;
+
+   private:
+    const driver::Cell* Row() const {
+        if (row_ == nullptr) {
+            throw Exception(400, "sql: no current row");
+        }
+        return row_;
+    }
+
+    std::shared_ptr<const BufferedResult> result_;
+    std::size_t next_ = 0;
+    const driver::Cell* row_ = nullptr;
+};
+
+}  // namespace sqlcc
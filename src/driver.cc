@@ -1,6 +1,8 @@
 #include "sqlcc/driver/driver.h"
 
 #include <map>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 
 namespace sqlcc {
@@ -9,30 +11,304 @@ namespace mysql {
     extern std::shared_ptr<Driver> CreateMySQLDriver();
 }
 
-static std::map<std::string, std::shared_ptr<Driver>> driver_map = {
-    {"mysql", mysql::CreateMySQLDriver()},
+namespace {
+
+using DriverMap = std::map<std::string, std::shared_ptr<Driver>>;
+
+// DriverRegistry is read on every Open and written about never. Readers
+// load the current map with a single atomic load, writers copy it under a
+// lock and publish the copy. A replaced map lives on while a reader still
+// holds it.
+class DriverRegistry {
+   public:
+    DriverRegistry() {
+        std::shared_ptr<DriverMap> drivers = std::make_shared<DriverMap>();
+        (*drivers)["mysql"] = mysql::CreateMySQLDriver();
+        std::atomic_store(&current_,
+                          std::shared_ptr<const DriverMap>(std::move(drivers)));
+    }
+    std::shared_ptr<const DriverMap> Load() const {
+        return std::atomic_load(&current_);
+    }
+    // Update publishes a copy of the current map changed by f, unless f
+    // returns false
+    template <typename F>
+    bool Update(F f) {
+        std::lock_guard<std::mutex> lock(mu_);
+        std::shared_ptr<DriverMap> drivers =
+            std::make_shared<DriverMap>(*Load());
+        if (!f(*drivers)) {
+            return false;
+        }
+        std::atomic_store(&current_,
+                          std::shared_ptr<const DriverMap>(std::move(drivers)));
+        return true;
+    }
+
+   private:
+    std::shared_ptr<const DriverMap> current_;
+    std::mutex mu_;
 };
 
+DriverRegistry& Registry() {
+    static DriverRegistry registry;
+    return registry;
+}
+
+class DefaultConnector : public Connector {
+   public:
+    DefaultConnector(std::shared_ptr<driver::Driver> driver,
+                     const std::string& name)
+        : driver_(driver), name_(name) {}
+    std::shared_ptr<Conn> Connect() override { return driver_->Open(name_); }
+    std::shared_ptr<driver::Driver> Driver() override { return driver_; }
+
+   private:
+    std::shared_ptr<driver::Driver> driver_;
+    std::string name_;
+};
+
+}  // namespace
+
 void RegisterDriver(const std::string& name, std::shared_ptr<Driver> driver) {
-    const auto& it = driver_map.find(name);
-    if (it != driver_map.end()) {
+    bool added = Registry().Update([&](DriverMap& drivers) {
+        return drivers.emplace(name, driver).second;
+    });
+    if (!added) {
         throw std::runtime_error("sql driver: " + name + " alreay register");
     }
-    driver_map[name] = driver;
 }
 
 bool UnregisterDriver(const std::string& name) {
-    const auto& it = driver_map.find(name);
-    if (it == driver_map.end()) {
-        return false;
+    return Registry().Update(
+        [&](DriverMap& drivers) { return drivers.erase(name) > 0; });
+}
+
+std::shared_ptr<Connector> Driver::OpenConnector(const std::string& name) {
+    return std::make_shared<DefaultConnector>(Self(), name);
+}
+
+std::shared_ptr<Driver> Driver::Self() {
+    std::shared_ptr<Driver> self = weak_from_this().lock();
+    if (!self) {
+        // aliasing an empty shared_ptr owns nothing
+        self = std::shared_ptr<Driver>(std::shared_ptr<Driver>(), this);
+    }
+    return self;
+}
+
+static Value ScanSeed(ScanType type) {
+    switch (type) {
+        case ScanType::kBool:
+        case ScanType::kInt8:
+        case ScanType::kInt16:
+        case ScanType::kInt32:
+        case ScanType::kInt64:
+            return int64_t(0);
+        case ScanType::kUInt8:
+        case ScanType::kUInt16:
+        case ScanType::kUInt32:
+        case ScanType::kUInt64:
+            return uint64_t(0);
+        case ScanType::kFloat:
+        case ScanType::kDouble:
+            return double(0);
+        case ScanType::kString:
+            return std::string();
+        case ScanType::kTm:
+            return std::tm();
+        case ScanType::kTimePoint:
+            return TimePoint();
+        case ScanType::kNullInt64:
+            return NullInt64();
+        case ScanType::kNullUInt64:
+            return NullUInt64();
+        case ScanType::kNullDouble:
+            return NullDouble();
+        case ScanType::kNullString:
+            return NullString();
+        case ScanType::kNullTm:
+            return NullTm();
+        case ScanType::kNullTimePoint:
+            return NullTimePoint();
+    }
+    throw std::runtime_error("unable to scan value");
+}
+
+template <typename T>
+static void AssignNumber(const Value &value, void *dest) {
+    std::visit(
+        [dest](auto &&v) {
+            using V = std::decay_t<decltype(v)>;
+            if constexpr (std::is_arithmetic_v<V>) {
+                *static_cast<T *>(dest) = static_cast<T>(v);
+            } else {
+                throw std::runtime_error("unable to scan value");
+            }
+        },
+        value);
+}
+
+template <typename T>
+static void Assign(const Value &value, void *dest) {
+    const T *v = std::get_if<T>(&value);
+    if (v == nullptr) {
+        throw std::runtime_error("unable to scan value");
+    }
+    *static_cast<T *>(dest) = *v;
+}
+
+void SQLRows::ScanTyped(const ScanType *types, void *const *dest,
+                        std::size_t size) {
+    std::vector<Value> values;
+    values.reserve(size);
+    for (std::size_t i = 0; i < size; i++) {
+        values.push_back(ScanSeed(types[i]));
+    }
+    Scan(values);
+    for (std::size_t i = 0; i < size; i++) {
+        switch (types[i]) {
+            case ScanType::kBool:
+                AssignNumber<bool>(values[i], dest[i]);
+                break;
+            case ScanType::kInt8:
+                AssignNumber<int8_t>(values[i], dest[i]);
+                break;
+            case ScanType::kInt16:
+                AssignNumber<int16_t>(values[i], dest[i]);
+                break;
+            case ScanType::kInt32:
+                AssignNumber<int32_t>(values[i], dest[i]);
+                break;
+            case ScanType::kInt64:
+                AssignNumber<int64_t>(values[i], dest[i]);
+                break;
+            case ScanType::kUInt8:
+                AssignNumber<uint8_t>(values[i], dest[i]);
+                break;
+            case ScanType::kUInt16:
+                AssignNumber<uint16_t>(values[i], dest[i]);
+                break;
+            case ScanType::kUInt32:
+                AssignNumber<uint32_t>(values[i], dest[i]);
+                break;
+            case ScanType::kUInt64:
+                AssignNumber<uint64_t>(values[i], dest[i]);
+                break;
+            case ScanType::kFloat:
+                AssignNumber<float>(values[i], dest[i]);
+                break;
+            case ScanType::kDouble:
+                AssignNumber<double>(values[i], dest[i]);
+                break;
+            case ScanType::kString:
+                Assign<std::string>(values[i], dest[i]);
+                break;
+            case ScanType::kTm:
+                Assign<std::tm>(values[i], dest[i]);
+                break;
+            case ScanType::kTimePoint:
+                Assign<TimePoint>(values[i], dest[i]);
+                break;
+            case ScanType::kNullInt64:
+                Assign<NullInt64>(values[i], dest[i]);
+                break;
+            case ScanType::kNullUInt64:
+                Assign<NullUInt64>(values[i], dest[i]);
+                break;
+            case ScanType::kNullDouble:
+                Assign<NullDouble>(values[i], dest[i]);
+                break;
+            case ScanType::kNullString:
+                Assign<NullString>(values[i], dest[i]);
+                break;
+            case ScanType::kNullTm:
+                Assign<NullTm>(values[i], dest[i]);
+                break;
+            case ScanType::kNullTimePoint:
+                Assign<NullTimePoint>(values[i], dest[i]);
+                break;
+        }
+    }
+}
+
+namespace {
+
+class BatchResult : public SQLResult {
+   public:
+    BatchResult(int64_t last_insert_id, int64_t rows_affected)
+        : last_insert_id_(last_insert_id), rows_affected_(rows_affected) {}
+    int64_t LastInsertID() override { return last_insert_id_; }
+    int64_t RowsAffected() override { return rows_affected_; }
+
+   private:
+    int64_t last_insert_id_;
+    int64_t rows_affected_;
+};
+
+}  // namespace
+
+std::shared_ptr<SQLResult> Stmt::ExecBatch(
+    const std::vector<std::vector<Value>> &args) {
+    int64_t last_insert_id = 0;
+    int64_t rows_affected = 0;
+    for (std::size_t i = 0; i < args.size(); i++) {
+        std::shared_ptr<SQLResult> result = Exec(args[i]);
+        if (i == 0) {
+            last_insert_id = result->LastInsertID();
+        }
+        rows_affected += result->RowsAffected();
+    }
+    return std::make_shared<BatchResult>(last_insert_id, rows_affected);
+}
+
+void Stmt::ExecAsync(const std::vector<Value> &args, ExecCallback cb) {
+    std::shared_ptr<SQLResult> result;
+    try {
+        result = Exec(args);
+    } catch (...) {
+        cb(nullptr, std::current_exception());
+        return;
     }
-    driver_map.erase(it);
-    return true;
+    cb(result, nullptr);
+}
+
+void Stmt::QueryAsync(const std::vector<Value> &args, QueryCallback cb) {
+    std::shared_ptr<SQLRows> rows;
+    try {
+        rows = Query(args);
+    } catch (...) {
+        cb(nullptr, std::current_exception());
+        return;
+    }
+    cb(rows, nullptr);
+}
+
+std::shared_ptr<Pipeline> Conn::NewPipeline() {
+    throw std::runtime_error("sql driver: pipelining not supported");
+}
+
+std::size_t SQLRows::NextBatch(Batch &batch, std::size_t n) {
+    throw std::runtime_error("sql driver: batch fetch not supported");
+}
+
+void SQLRows::ScanCells(Cell *dest, std::size_t size) {
+    throw std::runtime_error("sql driver: cell scan not supported");
+}
+
+std::size_t SQLRows::ReadColumn(std::size_t idx, uint64_t offset, char *buf,
+                                std::size_t size) {
+    throw std::runtime_error("sql driver: column streaming not supported");
+}
+
+void SQLRows::Seek(uint64_t row) {
+    throw std::runtime_error("sql driver: rows are not seekable");
 }
 
 std::shared_ptr<Driver> GetDriver(const std::string &name) {
-    const auto& it = driver_map.find(name);
-    if (it == driver_map.end()) {
+    std::shared_ptr<const DriverMap> drivers = Registry().Load();
+    const auto& it = drivers->find(name);
+    if (it == drivers->end()) {
         throw std::runtime_error("sql driver: " + name + " not exists");
     }
     return it->second;
@@ -0,0 +1,541 @@
+#include "driver/mysql/bind.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+#include "driver/mysql/datetime.h"
+#include "driver/mysql/exception.h"
+#include "sqlcc/exception.h"
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+void StdTmToMySQLTm(const std::tm &tm, MYSQL_TIME *mysql_tm) {
+    memset(mysql_tm, 0, sizeof(MYSQL_TIME));
+
+    mysql_tm->second = tm.tm_sec;
+    mysql_tm->minute = tm.tm_min;
+    mysql_tm->hour = tm.tm_hour;
+    mysql_tm->day = tm.tm_mday;
+    mysql_tm->month = tm.tm_mon + 1;
+    mysql_tm->year = tm.tm_year + 1900;
+    mysql_tm->time_type = MYSQL_TIMESTAMP_DATETIME;
+}
+
+void ParamBind::Reset(std::size_t size) {
+    bind_.assign(size, MYSQL_BIND());
+    params_.assign(size, Param());
+    for (std::size_t i = 0; i < size; i++) {
+        memset(&bind_[i], 0, sizeof(MYSQL_BIND));
+        bind_[i].length = &params_[i].length;
+        bind_[i].is_null = &params_[i].is_null;
+    }
+    dirty_ = true;
+}
+
+// SetBuffer updates the bind, returns true when mysql has to see it again
+static bool SetBuffer(MYSQL_BIND *bind, enum_field_types type, void *buffer,
+                      unsigned long buffer_length, my_bool is_unsigned) {
+    bool changed = bind->buffer_type != type || bind->buffer != buffer ||
+                   bind->is_unsigned != is_unsigned;
+    bind->buffer_type = type;
+    bind->buffer = buffer;
+    bind->buffer_length = buffer_length;
+    bind->is_unsigned = is_unsigned;
+    return changed;
+}
+
+bool ParamBind::BindParam(const Value &value, Param *param, MYSQL_BIND *bind) {
+    return std::visit(
+        [param, bind](auto &&arg) -> bool {
+            using T = std::decay_t<decltype(arg)>;
+            param->is_null = false;
+            if constexpr (std::is_same_v<T, int64_t>) {
+                param->i64 = arg;
+                param->length = sizeof(int64_t);
+                return SetBuffer(bind, MYSQL_TYPE_LONGLONG, &param->i64,
+                                 sizeof(int64_t), false);
+            } else if constexpr (std::is_same_v<T, uint64_t>) {
+                param->u64 = arg;
+                param->length = sizeof(uint64_t);
+                return SetBuffer(bind, MYSQL_TYPE_LONGLONG, &param->u64,
+                                 sizeof(uint64_t), true);
+            } else if constexpr (std::is_same_v<T, double>) {
+                param->f64 = arg;
+                param->length = sizeof(double);
+                return SetBuffer(bind, MYSQL_TYPE_DOUBLE, &param->f64,
+                                 sizeof(double), false);
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                // assign keeps the capacity, so the buffer only moves when
+                // a longer string than ever before is bound
+                param->str.assign(arg);
+                param->length = param->str.size();
+                return SetBuffer(bind, MYSQL_TYPE_STRING, &param->str[0],
+                                 param->str.capacity(), false);
+            } else if constexpr (std::is_same_v<T, std::tm>) {
+                StdTmToMySQLTm(arg, &param->time);
+                param->length = sizeof(MYSQL_TIME);
+                return SetBuffer(bind, MYSQL_TYPE_DATETIME, &param->time,
+                                 sizeof(MYSQL_TIME), false);
+            } else if constexpr (std::is_same_v<T, TimePoint>) {
+                TimePointToMySQLTime(arg, &param->time);
+                param->length = sizeof(MYSQL_TIME);
+                return SetBuffer(bind, MYSQL_TYPE_DATETIME, &param->time,
+                                 sizeof(MYSQL_TIME), false);
+            } else if constexpr (std::is_same_v<T, NullInt64>) {
+                param->is_null = (arg == nullptr);
+                param->i64 = arg ? *arg : 0;
+                param->length = sizeof(int64_t);
+                return SetBuffer(bind, MYSQL_TYPE_LONGLONG, &param->i64,
+                                 sizeof(int64_t), false);
+            } else if constexpr (std::is_same_v<T, NullUInt64>) {
+                param->is_null = (arg == nullptr);
+                param->u64 = arg ? *arg : 0;
+                param->length = sizeof(uint64_t);
+                return SetBuffer(bind, MYSQL_TYPE_LONGLONG, &param->u64,
+                                 sizeof(uint64_t), true);
+            } else if constexpr (std::is_same_v<T, NullDouble>) {
+                param->is_null = (arg == nullptr);
+                param->f64 = arg ? *arg : 0;
+                param->length = sizeof(double);
+                return SetBuffer(bind, MYSQL_TYPE_DOUBLE, &param->f64,
+                                 sizeof(double), false);
+            } else if constexpr (std::is_same_v<T, NullString>) {
+                param->is_null = (arg == nullptr);
+                if (arg) {
+                    param->str.assign(*arg);
+                } else {
+                    param->str.clear();
+                }
+                param->length = param->str.size();
+                return SetBuffer(bind, MYSQL_TYPE_STRING, &param->str[0],
+                                 param->str.capacity(), false);
+            } else if constexpr (std::is_same_v<T, NullTm>) {
+                param->is_null = (arg == nullptr);
+                if (arg) {
+                    StdTmToMySQLTm(*arg, &param->time);
+                }
+                param->length = sizeof(MYSQL_TIME);
+                return SetBuffer(bind, MYSQL_TYPE_DATETIME, &param->time,
+                                 sizeof(MYSQL_TIME), false);
+            } else if constexpr (std::is_same_v<T, NullTimePoint>) {
+                param->is_null = (arg == nullptr);
+                if (arg) {
+                    TimePointToMySQLTime(*arg, &param->time);
+                }
+                param->length = sizeof(MYSQL_TIME);
+                return SetBuffer(bind, MYSQL_TYPE_DATETIME, &param->time,
+                                 sizeof(MYSQL_TIME), false);
+            } else
+                static_assert(always_false_v<T>, "non-exhaustive visitor!");
+        },
+        value);
+}
+
+bool ParamBind::Bind(const std::vector<Value> &args) {
+    assert(args.size() == bind_.size());
+    bool changed = dirty_;
+    for (std::size_t i = 0; i < args.size(); i++) {
+        changed |= BindParam(args[i], &params_[i], &bind_[i]);
+    }
+    dirty_ = false;
+    return changed;
+}
+
+std::size_t BulkRowSize(const std::vector<Value> &row) {
+    std::size_t size = 0;
+    for (const Value &value : row) {
+        // one indicator byte per value
+        size += 1;
+        std::visit(
+            [&size](auto &&arg) {
+                using T = std::decay_t<decltype(arg)>;
+                if constexpr (std::is_same_v<T, std::string>) {
+                    size += 9 + arg.size();
+                } else if constexpr (std::is_same_v<T, NullString>) {
+                    size += arg ? 9 + (*arg).size() : 0;
+                } else if constexpr (std::is_same_v<T, std::tm> ||
+                                     std::is_same_v<T, NullTm> ||
+                                     std::is_same_v<T, TimePoint> ||
+                                     std::is_same_v<T, NullTimePoint>) {
+                    size += 12;
+                } else {
+                    size += 8;
+                }
+            },
+            value);
+    }
+    return size;
+}
+
+// BulkType returns the buffer type of value, setting is_null and
+// is_unsigned accordingly
+static enum_field_types BulkType(const Value &value, bool *is_null,
+                                 my_bool *is_unsigned) {
+    *is_null = false;
+    *is_unsigned = false;
+    return std::visit(
+        [is_null, is_unsigned](auto &&arg) -> enum_field_types {
+            using T = std::decay_t<decltype(arg)>;
+            if constexpr (std::is_same_v<T, int64_t>) {
+                return MYSQL_TYPE_LONGLONG;
+            } else if constexpr (std::is_same_v<T, uint64_t>) {
+                *is_unsigned = true;
+                return MYSQL_TYPE_LONGLONG;
+            } else if constexpr (std::is_same_v<T, double>) {
+                return MYSQL_TYPE_DOUBLE;
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                return MYSQL_TYPE_STRING;
+            } else if constexpr (std::is_same_v<T, std::tm> ||
+                                 std::is_same_v<T, TimePoint>) {
+                return MYSQL_TYPE_DATETIME;
+            } else if constexpr (std::is_same_v<T, NullInt64>) {
+                *is_null = arg == nullptr;
+                return MYSQL_TYPE_LONGLONG;
+            } else if constexpr (std::is_same_v<T, NullUInt64>) {
+                *is_null = arg == nullptr;
+                *is_unsigned = true;
+                return MYSQL_TYPE_LONGLONG;
+            } else if constexpr (std::is_same_v<T, NullDouble>) {
+                *is_null = arg == nullptr;
+                return MYSQL_TYPE_DOUBLE;
+            } else if constexpr (std::is_same_v<T, NullString>) {
+                *is_null = arg == nullptr;
+                return MYSQL_TYPE_STRING;
+            } else if constexpr (std::is_same_v<T, NullTm> ||
+                                 std::is_same_v<T, NullTimePoint>) {
+                *is_null = arg == nullptr;
+                return MYSQL_TYPE_DATETIME;
+            } else
+                static_assert(always_false_v<T>, "non-exhaustive visitor!");
+        },
+        value);
+}
+
+void BulkBind::Bind(const std::vector<std::vector<Value>> &rows,
+                    std::size_t begin, std::size_t end, std::size_t size) {
+    std::size_t count = end - begin;
+    bind_.resize(size);
+    columns_.resize(size);
+    for (std::size_t i = 0; i < size; i++) {
+        MYSQL_BIND *bind = &bind_[i];
+        Column &column = columns_[i];
+        memset(bind, 0, sizeof(MYSQL_BIND));
+        column.indicator.assign(count, STMT_INDICATOR_NONE);
+
+        enum_field_types type = MYSQL_TYPE_NULL;
+        for (std::size_t row = begin; row < end; row++) {
+            bool is_null = false;
+            my_bool is_unsigned = false;
+            enum_field_types t = BulkType(rows[row][i], &is_null, &is_unsigned);
+            if (type == MYSQL_TYPE_NULL) {
+                type = t;
+                bind->is_unsigned = is_unsigned;
+            } else if (t != type || is_unsigned != bind->is_unsigned) {
+                throw Exception(400, "sql: bulk parameter " +
+                                         std::to_string(i) +
+                                         " changes type between rows");
+            }
+            if (is_null) {
+                column.indicator[row - begin] = STMT_INDICATOR_NULL;
+            }
+        }
+        bind->buffer_type = type;
+        bind->u.indicator = column.indicator.data();
+
+        switch (type) {
+            case MYSQL_TYPE_LONGLONG:
+                column.i64.resize(count);
+                for (std::size_t row = begin; row < end; row++) {
+                    std::visit(
+                        [&column, row, begin](auto &&arg) {
+                            using T = std::decay_t<decltype(arg)>;
+                            if constexpr (std::is_same_v<T, int64_t> ||
+                                          std::is_same_v<T, uint64_t>) {
+                                column.i64[row - begin] = int64_t(arg);
+                            } else if constexpr (std::is_same_v<T, NullInt64> ||
+                                                 std::is_same_v<T, NullUInt64>) {
+                                column.i64[row - begin] = arg ? int64_t(*arg) : 0;
+                            }
+                        },
+                        rows[row][i]);
+                }
+                bind->buffer = column.i64.data();
+                break;
+            case MYSQL_TYPE_DOUBLE:
+                column.f64.resize(count);
+                for (std::size_t row = begin; row < end; row++) {
+                    std::visit(
+                        [&column, row, begin](auto &&arg) {
+                            using T = std::decay_t<decltype(arg)>;
+                            if constexpr (std::is_same_v<T, double>) {
+                                column.f64[row - begin] = arg;
+                            } else if constexpr (std::is_same_v<T, NullDouble>) {
+                                column.f64[row - begin] = arg ? *arg : 0;
+                            }
+                        },
+                        rows[row][i]);
+                }
+                bind->buffer = column.f64.data();
+                break;
+            case MYSQL_TYPE_STRING:
+                // column wise strings are an array of pointers
+                column.str.resize(count);
+                column.length.resize(count);
+                for (std::size_t row = begin; row < end; row++) {
+                    std::visit(
+                        [&column, row, begin](auto &&arg) {
+                            using T = std::decay_t<decltype(arg)>;
+                            const std::string *str = nullptr;
+                            if constexpr (std::is_same_v<T, std::string>) {
+                                str = &arg;
+                            } else if constexpr (std::is_same_v<T, NullString>) {
+                                str = arg ? &*arg : nullptr;
+                            }
+                            column.str[row - begin] = str ? str->data() : "";
+                            column.length[row - begin] = str ? str->size() : 0;
+                        },
+                        rows[row][i]);
+                }
+                bind->buffer = column.str.data();
+                bind->length = column.length.data();
+                break;
+            case MYSQL_TYPE_DATETIME:
+                // column wise temporals are an array of pointers as well
+                column.time.resize(count);
+                column.time_ptr.resize(count);
+                for (std::size_t row = begin; row < end; row++) {
+                    std::visit(
+                        [&column, row, begin](auto &&arg) {
+                            using T = std::decay_t<decltype(arg)>;
+                            MYSQL_TIME *time = &column.time[row - begin];
+                            memset(time, 0, sizeof(MYSQL_TIME));
+                            if constexpr (std::is_same_v<T, std::tm>) {
+                                StdTmToMySQLTm(arg, time);
+                            } else if constexpr (std::is_same_v<T, NullTm>) {
+                                if (arg) StdTmToMySQLTm(*arg, time);
+                            } else if constexpr (std::is_same_v<T, TimePoint>) {
+                                TimePointToMySQLTime(arg, time);
+                            } else if constexpr (std::is_same_v<
+                                                     T, NullTimePoint>) {
+                                if (arg) TimePointToMySQLTime(*arg, time);
+                            }
+                        },
+                        rows[row][i]);
+                    column.time_ptr[row - begin] = &column.time[row - begin];
+                }
+                bind->buffer = column.time_ptr.data();
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// buffer type and size used to fetch a column
+static enum_field_types ResultBufferType(const MYSQL_FIELD &field,
+                                         unsigned long *buffer_length) {
+    switch (field.type) {
+        case (MYSQL_TYPE_DECIMAL):
+        case (MYSQL_TYPE_TINY):
+        case (MYSQL_TYPE_SHORT):
+        case (MYSQL_TYPE_LONG):
+        case (MYSQL_TYPE_INT24):
+        case (MYSQL_TYPE_LONGLONG):
+            *buffer_length = sizeof(int64_t);
+            return MYSQL_TYPE_LONGLONG;
+        case (MYSQL_TYPE_FLOAT):
+        case (MYSQL_TYPE_DOUBLE):
+            *buffer_length = sizeof(double);
+            return MYSQL_TYPE_DOUBLE;
+        case (MYSQL_TYPE_DATE):
+        case (MYSQL_TYPE_NEWDATE):
+            *buffer_length = sizeof(MYSQL_TIME);
+            return MYSQL_TYPE_DATE;
+        case (MYSQL_TYPE_DATETIME):
+        case (MYSQL_TYPE_TIMESTAMP):
+        case (MYSQL_TYPE_TIME):
+            // decoded by the client library, no text to parse per row
+            *buffer_length = sizeof(MYSQL_TIME);
+            return field.type;
+        default:
+            *buffer_length =
+                std::min(field.length, ResultBind::kMaxColumnBuffer);
+            return MYSQL_TYPE_STRING;
+    }
+}
+
+static std::size_t AlignUp(std::size_t n) {
+    const std::size_t align = alignof(std::max_align_t);
+    return (n + align - 1) & ~(align - 1);
+}
+
+bool ResultBind::SameShape(const MYSQL_FIELD *fields, std::size_t size) const {
+    if (size != shape_.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < size; i++) {
+        if (fields[i].type != shape_[i].type ||
+            fields[i].length != shape_[i].length ||
+            fields[i].flags != shape_[i].flags ||
+            fields[i].decimals != shape_[i].decimals ||
+            columns_[i] != fields[i].name) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ResultBind::Prepare(const MYSQL_FIELD *fields, std::size_t size) {
+    if (arena_ != nullptr && SameShape(fields, size)) {
+        for (std::size_t i = 0; i < size; i++) {
+            *bind_[i].length = 0;
+            *bind_[i].is_null = 0;
+            *bind_[i].error = 0;
+        }
+        NextRow();
+        return false;
+    }
+
+    // [MYSQL_BIND * size][length * size][is_null * size][error * size]
+    // followed by the column buffers, each aligned like malloc would
+    std::size_t length_offset = sizeof(MYSQL_BIND) * size;
+    std::size_t is_null_offset = length_offset + sizeof(unsigned long) * size;
+    std::size_t error_offset = is_null_offset + sizeof(my_bool) * size;
+    std::size_t buffer_offset = AlignUp(error_offset + sizeof(my_bool) * size);
+    std::size_t arena_size = buffer_offset;
+    for (std::size_t i = 0; i < size; i++) {
+        unsigned long buffer_length = 0;
+        ResultBufferType(fields[i], &buffer_length);
+        arena_size += AlignUp(buffer_length);
+    }
+
+    arena_.reset(new unsigned char[arena_size]);
+    memset(arena_.get(), 0, buffer_offset);
+    bind_ = reinterpret_cast<MYSQL_BIND *>(arena_.get());
+    unsigned long *length =
+        reinterpret_cast<unsigned long *>(arena_.get() + length_offset);
+    my_bool *is_null =
+        reinterpret_cast<my_bool *>(arena_.get() + is_null_offset);
+    my_bool *error = reinterpret_cast<my_bool *>(arena_.get() + error_offset);
+    unsigned char *buffer = arena_.get() + buffer_offset;
+
+    shape_.resize(size);
+    columns_.resize(size);
+    time_text_.resize(size);
+    streamed_.clear();
+    loaded_ = false;
+    for (std::size_t i = 0; i < size; i++) {
+        shape_[i] = Shape{fields[i].type, fields[i].length, fields[i].flags,
+                          fields[i].decimals};
+        columns_[i] = fields[i].name;
+
+        MYSQL_BIND *bind = &bind_[i];
+        bind->length = &length[i];
+        bind->is_null = &is_null[i];
+        bind->error = &error[i];
+        bind->buffer_type = ResultBufferType(fields[i], &bind->buffer_length);
+        bind->is_unsigned = (fields[i].flags & UNSIGNED_FLAG) != 0;
+        bind->buffer = buffer;
+        buffer += AlignUp(bind->buffer_length);
+        if (bind->buffer_type == MYSQL_TYPE_STRING &&
+            fields[i].length > bind->buffer_length) {
+            streamed_.push_back(
+                Streamed{i, bind->buffer, bind->buffer_length, {}});
+        }
+    }
+    return true;
+}
+
+std::string_view ResultBind::TimeText(std::size_t i) {
+    char *text = time_text_[i].data();
+    std::size_t n = FormatMySQLTime(
+        *static_cast<const MYSQL_TIME *>(bind_[i].buffer), Decimals(i), text);
+    return std::string_view(text, n);
+}
+
+void ResultBind::NextRow() {
+    if (!loaded_) {
+        return;
+    }
+    for (Streamed &s : streamed_) {
+        bind_[s.column].buffer = s.buffer;
+        bind_[s.column].buffer_length = s.buffer_length;
+    }
+    loaded_ = false;
+}
+
+bool ResultBind::Truncated() const {
+    for (std::size_t i = 0; i < size(); i++) {
+        if (*bind_[i].error && (bind_[i].buffer_type != MYSQL_TYPE_STRING ||
+                                *bind_[i].length <= bind_[i].buffer_length)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// FetchColumn copies size bytes of column i from offset into buf
+static void FetchColumn(MYSQL_STMT *stmt, std::size_t i, uint64_t offset,
+                        void *buf, std::size_t size) {
+    MYSQL_BIND bind;
+    unsigned long length = 0;
+    my_bool is_null = 0;
+    my_bool error = 0;
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = buf;
+    bind.buffer_length = size;
+    bind.length = &length;
+    bind.is_null = &is_null;
+    bind.error = &error;
+    if (mysql_stmt_fetch_column(stmt, &bind, i, offset) != 0) {
+        throw ExceptionFromStmt(stmt);
+    }
+}
+
+void ResultBind::Load(MYSQL_STMT *stmt) {
+    if (loaded_ || streamed_.empty()) {
+        return;
+    }
+    for (Streamed &s : streamed_) {
+        MYSQL_BIND &bind = bind_[s.column];
+        if (*bind.is_null || *bind.length <= bind.buffer_length) {
+            continue;
+        }
+        // the truncated prefix is already in the arena
+        s.value.resize(*bind.length);
+        memcpy(&s.value[0], s.buffer, s.buffer_length);
+        FetchColumn(stmt, s.column, s.buffer_length, &s.value[s.buffer_length],
+                    *bind.length - s.buffer_length);
+        bind.buffer = &s.value[0];
+        bind.buffer_length = *bind.length;
+    }
+    loaded_ = true;
+}
+
+std::size_t ResultBind::Read(MYSQL_STMT *stmt, std::size_t i, uint64_t offset,
+                             char *buf, std::size_t size) {
+    const MYSQL_BIND &bind = bind_[i];
+    if (bind.buffer_type != MYSQL_TYPE_STRING) {
+        throw Exception(400, "sql: can't read column " + columns_[i] +
+                                 " in chunks");
+    }
+    if (*bind.is_null || offset >= *bind.length) {
+        return 0;
+    }
+    std::size_t n = std::min<uint64_t>(size, *bind.length - offset);
+    if (offset + n <= bind.buffer_length) {
+        memcpy(buf, static_cast<const char *>(bind.buffer) + offset, n);
+    } else {
+        FetchColumn(stmt, i, offset, buf, n);
+    }
+    return n;
+}
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
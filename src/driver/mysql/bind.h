@@ -0,0 +1,160 @@
+#pragma once
+
+#include "sqlcc/driver/driver.h"
+
+#include "driver/mysql/datetime.h"
+
+#include <mysql.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+// ParamBind owns the MYSQL_BIND array of a prepared statement together with
+// the scratch buffers of every parameter. Everything is allocated once when
+// the statement is prepared and reused by each execution.
+class ParamBind {
+public:
+    ParamBind() = default;
+    ParamBind(const ParamBind&) = delete;
+    ParamBind& operator=(const ParamBind&) = delete;
+    void Reset(std::size_t size);
+    // Bind copies args into the scratch buffers, returns true when the
+    // MYSQL_BIND array changed and has to be passed to mysql_stmt_bind_param
+    // again.
+    bool Bind(const std::vector<Value>& args);
+    // Invalidate forces the next Bind to report a change, used when
+    // mysql_stmt_bind_param failed.
+    void Invalidate() { dirty_ = true; }
+    MYSQL_BIND* data() { return bind_.data(); }
+    std::size_t size() const { return bind_.size(); }
+
+private:
+    struct Param {
+        union {
+            int64_t i64;
+            uint64_t u64;
+            double f64;
+        };
+        MYSQL_TIME time;
+        std::string str;
+        unsigned long length;
+        my_bool is_null;
+    };
+    bool BindParam(const Value& value, Param* param, MYSQL_BIND* bind);
+    std::vector<MYSQL_BIND> bind_;
+    std::vector<Param> params_;
+    // set until the first successful mysql_stmt_bind_param
+    bool dirty_ = true;
+};
+
+// BulkBind lays out a range of parameter rows column by column for
+// MariaDB array binding (STMT_ATTR_ARRAY_SIZE). String values are
+// referenced, not copied, so the rows must outlive the execution.
+class BulkBind {
+public:
+    BulkBind() = default;
+    BulkBind(const BulkBind&) = delete;
+    BulkBind& operator=(const BulkBind&) = delete;
+    // Bind lays out rows [begin, end), every row having size values of the
+    // same type per column.
+    void Bind(const std::vector<std::vector<Value>>& rows, std::size_t begin,
+              std::size_t end, std::size_t size);
+    MYSQL_BIND* data() { return bind_.data(); }
+
+private:
+    struct Column {
+        std::vector<int64_t> i64;
+        std::vector<double> f64;
+        std::vector<const char*> str;
+        std::vector<unsigned long> length;
+        std::vector<MYSQL_TIME> time;
+        std::vector<MYSQL_TIME*> time_ptr;
+        std::vector<char> indicator;
+    };
+    std::vector<MYSQL_BIND> bind_;
+    std::vector<Column> columns_;
+};
+
+// BulkRowSize estimates the bytes a parameter row takes in a bulk execute
+// packet.
+std::size_t BulkRowSize(const std::vector<Value>& row);
+
+// ResultBind lays out the MYSQL_BIND array of a result set together with the
+// length, null and error flags and the buffers of every column in a single
+// arena. The arena is kept by the statement and reused as long as the
+// column shape of the result set does not change.
+//
+// Column buffers are capped at kMaxColumnBuffer, a LONGBLOB would otherwise
+// take 4 GiB of arena. Longer values of such streamed columns are fetched
+// truncated and read with mysql_stmt_fetch_column, in chunks by Read or
+// whole by Load.
+class ResultBind {
+public:
+    static constexpr unsigned long kMaxColumnBuffer = 16 << 10;
+
+    ResultBind() = default;
+    ResultBind(const ResultBind&) = delete;
+    ResultBind& operator=(const ResultBind&) = delete;
+    // Prepare sets up the binds for fields, reusing the arena when fields
+    // have the same shape as the previous result set. Returns true when the
+    // shape changed.
+    bool Prepare(const MYSQL_FIELD* fields, std::size_t size);
+    MYSQL_BIND* data() { return bind_; }
+    MYSQL_BIND& operator[](std::size_t i) { return bind_[i]; }
+    std::size_t size() const { return shape_.size(); }
+    const std::vector<std::string>& Columns() const { return columns_; }
+    // Decimals is the number of fractional digits of column i
+    unsigned int Decimals(std::size_t i) const { return shape_[i].decimals; }
+    // TimeText formats the MYSQL_TIME of the temporal column i like the text
+    // protocol, the text stays valid until the next call for the column.
+    std::string_view TimeText(std::size_t i);
+    // NextRow must be called after every fetch, it points the streamed
+    // columns back at their arena buffers.
+    void NextRow();
+    // Truncated reports whether every column truncated by the last fetch
+    // is a streamed one, which is not an error.
+    bool Truncated() const;
+    // Load reads the truncated values of the current row whole, after it
+    // every bind holds its complete value until the next fetch.
+    void Load(MYSQL_STMT* stmt);
+    // Read copies up to size bytes of the string column i from offset into
+    // buf, straight from the row when the value is longer than its buffer.
+    std::size_t Read(MYSQL_STMT* stmt, std::size_t i, uint64_t offset,
+                     char* buf, std::size_t size);
+
+private:
+    struct Shape {
+        enum_field_types type;
+        unsigned long length;
+        unsigned int flags;
+        unsigned int decimals;
+    };
+    struct Streamed {
+        std::size_t column;
+        void* buffer;
+        unsigned long buffer_length;
+        // the whole value once loaded
+        std::string value;
+    };
+    bool SameShape(const MYSQL_FIELD* fields, std::size_t size) const;
+    std::vector<Shape> shape_;
+    std::vector<std::string> columns_;
+    std::vector<Streamed> streamed_;
+    std::vector<std::array<char, kMaxTimeText>> time_text_;
+    bool loaded_ = false;
+    std::unique_ptr<unsigned char[]> arena_;
+    MYSQL_BIND* bind_ = nullptr;
+};
+
+void StdTmToMySQLTm(const std::tm& tm, MYSQL_TIME* mysql_tm);
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
@@ -1,13 +1,50 @@
 #include "driver/mysql/conn.h"
 
+#include "driver/mysql/exception.h"
+#include "driver/mysql/pipeline.h"
 #include "driver/mysql/stmt.h"
+#include "driver/mysql/tx.h"
 
+#include <errmsg.h>
+
+#include <algorithm>
+#include <cstdlib>
 #include <stdexcept>
 
 namespace sqlcc {
 namespace driver {
 namespace mysql {
 
+namespace {
+
+// ThreadState runs mysql_thread_init the first time a thread uses the
+// client library, and mysql_thread_end when the thread exits
+struct ThreadState {
+    ~ThreadState() {
+        if (initialized) {
+            mysql_thread_end();
+        }
+    }
+    void Enter() {
+        if (!initialized) {
+            mysql_thread_init();
+            initialized = true;
+        }
+    }
+    void Leave() {
+        if (initialized) {
+            mysql_thread_end();
+            initialized = false;
+        }
+    }
+
+    bool initialized = false;
+};
+
+thread_local ThreadState thread_state;
+
+}  // namespace
+
 static void SetMySQLOptions(const Config& cfg, MYSQL* mysql) {
     int ret = 0;
     ret = mysql_optionsv(mysql, MYSQL_OPT_CONNECT_TIMEOUT, &cfg.timeout);
@@ -29,7 +66,8 @@ static void SetMySQLOptions(const Config& cfg, MYSQL* mysql) {
     }
 }
 
-MySQLConn::MySQLConn(const Config& cfg): cfg_(cfg) {
+MySQLConn::MySQLConn(const Config& cfg): cfg_(cfg), supports_bulk_(false), max_allowed_packet_(0), server_max_allowed_packet_(0), nonblock_(false), multi_statements_(false), metrics_(nullptr), thread_id_(0) {
+    thread_state.Enter();
     mysql_init(&mysql_);
     SetMySQLOptions(cfg_, &mysql_);
 
@@ -45,6 +83,12 @@ MySQLConn::MySQLConn(const Config& cfg): cfg_(cfg) {
     if (mysql == nullptr) {
         throw std::runtime_error("unable to connection mysql");
     }
+
+    unsigned long ext_capabilities = 0;
+    mariadb_get_infov(&mysql_, MARIADB_CONNECTION_EXTENDED_SERVER_CAPABILITIES, &ext_capabilities);
+    supports_bulk_ = ext_capabilities & (MARIADB_CLIENT_STMT_BULK_OPERATIONS >> 32);
+    mariadb_get_infov(&mysql_, MARIADB_MAX_ALLOWED_PACKET, &max_allowed_packet_);
+    thread_id_ = mysql_thread_id(&mysql_);
 }
 
 std::shared_ptr<driver::Stmt> MySQLConn::Prepare(const std::string& query) {
@@ -52,15 +96,87 @@ std::shared_ptr<driver::Stmt> MySQLConn::Prepare(const std::string& query) {
 }
 
 std::shared_ptr<Tx> MySQLConn::Begin() {
-    return nullptr;
+    return std::make_shared<MySQLTx>(this);
+}
+
+std::size_t MySQLConn::MaxAllowedPacket() {
+    if (server_max_allowed_packet_ == 0) {
+        static const char query[] = "SELECT @@max_allowed_packet";
+        if (mysql_real_query(&mysql_, query, sizeof(query) - 1) != 0) {
+            throw ExceptionFromMySQL(&mysql_);
+        }
+        MYSQL_RES* res = mysql_store_result(&mysql_);
+        if (res == nullptr) {
+            throw ExceptionFromMySQL(&mysql_);
+        }
+        MYSQL_ROW row = mysql_fetch_row(res);
+        if (row != nullptr && row[0] != nullptr) {
+            server_max_allowed_packet_ = std::strtoull(row[0], nullptr, 10);
+        }
+        mysql_free_result(res);
+        if (server_max_allowed_packet_ == 0) {
+            server_max_allowed_packet_ = max_allowed_packet_;
+        }
+    }
+    if (max_allowed_packet_ == 0) {
+        return server_max_allowed_packet_;
+    }
+    return std::min(max_allowed_packet_, server_max_allowed_packet_);
+}
+
+void MySQLConn::EnableNonblock() {
+    if (nonblock_) {
+        return;
+    }
+    if (mysql_optionsv(&mysql_, MYSQL_OPT_NONBLOCK, nullptr) != 0) {
+        throw ExceptionFromMySQL(&mysql_);
+    }
+    nonblock_ = true;
+}
+
+void MySQLConn::EnableMultiStatements() {
+    if (multi_statements_) {
+        return;
+    }
+    if (mysql_set_server_option(&mysql_, MYSQL_OPTION_MULTI_STATEMENTS_ON) != 0) {
+        throw ExceptionFromMySQL(&mysql_);
+    }
+    multi_statements_ = true;
+}
+
+void MySQLConn::DisableMultiStatements() {
+    if (!multi_statements_) {
+        return;
+    }
+    if (mysql_set_server_option(&mysql_, MYSQL_OPTION_MULTI_STATEMENTS_OFF) == 0) {
+        multi_statements_ = false;
+    }
+}
+
+std::shared_ptr<driver::Pipeline> MySQLConn::NewPipeline() {
+    return std::make_shared<MySQLPipeline>(this);
+}
+
+void MySQLConn::Ping() {
+    if (mysql_ping(&mysql_) != 0) {
+        throw ExceptionFromMySQL(&mysql_);
+    }
+}
+
+bool MySQLConn::IsValid() {
+    unsigned int code = mysql_errno(&mysql_);
+    if (code == CR_SERVER_GONE_ERROR || code == CR_SERVER_LOST) {
+        return false;
+    }
+    return !multi_statements_ && mysql_thread_id(&mysql_) == thread_id_;
 }
 
 void MySQLConn::EnterThread() {
-    mysql_thread_init();
+    thread_state.Enter();
 }
 
 void MySQLConn::LeaveThread() {
-    mysql_thread_end();
+    thread_state.Leave();
 }
 
 MySQLConn::~MySQLConn() {
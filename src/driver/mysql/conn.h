@@ -17,10 +17,41 @@ public:
     std::shared_ptr<driver::Tx> Begin() override;
     void EnterThread() override;
     void LeaveThread() override;
+    // SupportsBulk reports whether the server accepts array binding
+    bool SupportsBulk() const { return supports_bulk_; }
+    // MaxAllowedPacket is the smaller of the client and the server
+    // max_allowed_packet, the server value is read on the first call
+    std::size_t MaxAllowedPacket();
+    // EnableNonblock turns on the non-blocking API, blocking calls keep
+    // working
+    void EnableNonblock();
+    // EnableMultiStatements lets text queries carry several statements
+    void EnableMultiStatements();
+    // DisableMultiStatements turns them off again once no result is
+    // pending. A connection it fails on is no longer valid.
+    void DisableMultiStatements();
+    std::shared_ptr<driver::Pipeline> NewPipeline() override;
+    void SetMetrics(Metrics* metrics) override { metrics_ = metrics; }
+    void Ping() override;
+    // IsValid is false once the server went away, the client reconnected
+    // on its own and lost the prepared statements, or multi statements
+    // could not be turned off
+    bool IsValid() override;
 private:
     friend class MySQLStmt;
+    friend class MySQLTx;
+    friend class MySQLPipeline;
     Config cfg_;
     MYSQL mysql_;
+    bool supports_bulk_;
+    std::size_t max_allowed_packet_;
+    // 0 until read
+    std::size_t server_max_allowed_packet_;
+    bool nonblock_;
+    bool multi_statements_;
+    // read by statements and rows on every call, nullptr when off
+    Metrics* metrics_;
+    unsigned long thread_id_;
 };
 
 } // namespace mysql
@@ -0,0 +1,208 @@
+#include "driver/mysql/datetime.h"
+
+#include <cstring>
+
+#include "sqlcc/exception.h"
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+bool IsTimeType(enum_field_types type) {
+    switch (type) {
+        case MYSQL_TYPE_DATE:
+        case MYSQL_TYPE_NEWDATE:
+        case MYSQL_TYPE_DATETIME:
+        case MYSQL_TYPE_TIMESTAMP:
+        case MYSQL_TYPE_TIME:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// days since 1970-01-01 of a proleptic gregorian date, see
+// http://howardhinnant.github.io/date_algorithms.html
+static int64_t DaysFromCivil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+static void CivilFromDays(int64_t z, int64_t* y, unsigned* m, unsigned* d) {
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe =
+        (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = static_cast<int64_t>(yoe) + era * 400 + (*m <= 2);
+}
+
+void MySQLTimeToTm(const MYSQL_TIME& time, std::tm* tm) {
+    memset(tm, 0, sizeof(std::tm));
+    tm->tm_year = static_cast<int>(time.year) - 1900;
+    tm->tm_mon = static_cast<int>(time.month) - 1;
+    tm->tm_mday = time.day;
+    tm->tm_hour = time.hour;
+    tm->tm_min = time.minute;
+    tm->tm_sec = time.second;
+}
+
+TimePoint MySQLTimeToTimePoint(const MYSQL_TIME& time) {
+    if (time.time_type == MYSQL_TIMESTAMP_TIME) {
+        throw Exception(400, "can't bind time of day to time_point");
+    }
+    if (time.year == 0 && time.month == 0 && time.day == 0) {
+        return TimePoint();
+    }
+    int64_t seconds = DaysFromCivil(time.year, time.month, time.day) * 86400 +
+                      time.hour * 3600 + time.minute * 60 + time.second;
+    return TimePoint(std::chrono::seconds(seconds) +
+                     std::chrono::microseconds(time.second_part));
+}
+
+void TimePointToMySQLTime(TimePoint tp, MYSQL_TIME* time) {
+    using Days = std::chrono::duration<int64_t, std::ratio<86400>>;
+    memset(time, 0, sizeof(MYSQL_TIME));
+    std::chrono::microseconds us = tp.time_since_epoch();
+    Days days = std::chrono::floor<Days>(us);
+    int64_t us_of_day = (us - days).count();
+    int64_t seconds = us_of_day / 1000000;
+    int64_t year;
+    CivilFromDays(days.count(), &year, &time->month, &time->day);
+    time->year = static_cast<unsigned int>(year);
+    time->hour = static_cast<unsigned int>(seconds / 3600);
+    time->minute = static_cast<unsigned int>(seconds / 60 % 60);
+    time->second = static_cast<unsigned int>(seconds % 60);
+    time->second_part = static_cast<unsigned long>(us_of_day % 1000000);
+    time->time_type = MYSQL_TIMESTAMP_DATETIME;
+}
+
+// PutDigits writes the n low decimal digits of v
+static char* PutDigits(char* p, unsigned long v, int n) {
+    for (int i = n - 1; i >= 0; i--) {
+        p[i] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    }
+    return p + n;
+}
+
+std::size_t FormatMySQLTime(const MYSQL_TIME& time, unsigned int decimals,
+                            char* buf) {
+    char* p = buf;
+    if (time.time_type == MYSQL_TIMESTAMP_TIME) {
+        if (time.neg) {
+            *p++ = '-';
+        }
+        p = PutDigits(p, time.hour, time.hour > 99 ? 3 : 2);
+    } else {
+        p = PutDigits(p, time.year, 4);
+        *p++ = '-';
+        p = PutDigits(p, time.month, 2);
+        *p++ = '-';
+        p = PutDigits(p, time.day, 2);
+        if (time.time_type == MYSQL_TIMESTAMP_DATE) {
+            return p - buf;
+        }
+        *p++ = ' ';
+        p = PutDigits(p, time.hour, 2);
+    }
+    *p++ = ':';
+    p = PutDigits(p, time.minute, 2);
+    *p++ = ':';
+    p = PutDigits(p, time.second, 2);
+    if (decimals > 0 && decimals <= 6) {
+        *p++ = '.';
+        char frac[6];
+        PutDigits(frac, time.second_part, 6);
+        memcpy(p, frac, decimals);
+        p += decimals;
+    }
+    return p - buf;
+}
+
+// ParseNumber reads n digits at p
+static bool ParseNumber(const char* p, const char* end, int n,
+                        unsigned int* v) {
+    if (end - p < n) {
+        return false;
+    }
+    *v = 0;
+    for (int i = 0; i < n; i++) {
+        if (p[i] < '0' || p[i] > '9') {
+            return false;
+        }
+        *v = *v * 10 + (p[i] - '0');
+    }
+    return true;
+}
+
+// ParseClock parses "hh:mm:ss[.ffffff]" with hours of hour_digits
+static bool ParseClock(const char* p, const char* end, int hour_digits,
+                       MYSQL_TIME* time) {
+    if (!ParseNumber(p, end, hour_digits, &time->hour)) {
+        return false;
+    }
+    p += hour_digits;
+    if (end - p < 6 || p[0] != ':' || p[3] != ':' ||
+        !ParseNumber(p + 1, end, 2, &time->minute) ||
+        !ParseNumber(p + 4, end, 2, &time->second)) {
+        return false;
+    }
+    p += 6;
+    if (p == end) {
+        return true;
+    }
+    if (*p++ != '.' || p == end || end - p > 6) {
+        return false;
+    }
+    unsigned int frac;
+    int digits = static_cast<int>(end - p);
+    if (!ParseNumber(p, end, digits, &frac)) {
+        return false;
+    }
+    for (int i = digits; i < 6; i++) {
+        frac *= 10;
+    }
+    time->second_part = frac;
+    return true;
+}
+
+bool ParseMySQLTime(const char* p, std::size_t size, MYSQL_TIME* time) {
+    memset(time, 0, sizeof(MYSQL_TIME));
+    const char* end = p + size;
+    if (size >= 10 && p[4] == '-') {
+        if (p[7] != '-' || !ParseNumber(p, end, 4, &time->year) ||
+            !ParseNumber(p + 5, end, 2, &time->month) ||
+            !ParseNumber(p + 8, end, 2, &time->day)) {
+            return false;
+        }
+        if (size == 10) {
+            time->time_type = MYSQL_TIMESTAMP_DATE;
+            return true;
+        }
+        time->time_type = MYSQL_TIMESTAMP_DATETIME;
+        return p[10] == ' ' && ParseClock(p + 11, end, 2, time);
+    }
+    time->time_type = MYSQL_TIMESTAMP_TIME;
+    if (p < end && *p == '-') {
+        time->neg = 1;
+        p++;
+    }
+    const char* colon = static_cast<const char*>(memchr(p, ':', end - p));
+    if (colon == nullptr || colon - p < 2 || colon - p > 3) {
+        return false;
+    }
+    return ParseClock(p, end, static_cast<int>(colon - p), time);
+}
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "sqlcc/driver/driver.h"
+
+#include <mysql.h>
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+// Conversions between MYSQL_TIME and the time types of the driver. They are
+// plain calendar arithmetic, time points are taken as UTC and no time zone
+// is looked up.
+
+// room FormatMySQLTime needs, "-838:59:59.000000" and
+// "YYYY-MM-DD hh:mm:ss.ffffff" included
+static const std::size_t kMaxTimeText = 32;
+
+bool IsTimeType(enum_field_types type);
+
+void MySQLTimeToTm(const MYSQL_TIME& time, std::tm* tm);
+
+// MySQLTimeToTimePoint throws for TIME values, which are no point in time.
+// The zero date gives the zero time point.
+TimePoint MySQLTimeToTimePoint(const MYSQL_TIME& time);
+
+void TimePointToMySQLTime(TimePoint tp, MYSQL_TIME* time);
+
+// FormatMySQLTime writes time the way the text protocol does, with decimals
+// fractional digits, into buf and returns its length.
+std::size_t FormatMySQLTime(const MYSQL_TIME& time, unsigned int decimals,
+                            char* buf);
+
+// ParseMySQLTime parses "YYYY-MM-DD", "YYYY-MM-DD hh:mm:ss[.ffffff]" or
+// "[-]hh:mm:ss[.ffffff]", returns false for anything else.
+bool ParseMySQLTime(const char* p, std::size_t size, MYSQL_TIME* time);
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
@@ -14,6 +14,21 @@ std::shared_ptr<driver::Conn> MySQLDriver::Open(const std::string& dsn) {
     return std::make_shared<MySQLConn>(cfg);
 }
 
+std::shared_ptr<driver::Connector> MySQLDriver::OpenConnector(const std::string& dsn) {
+    return std::make_shared<MySQLConnector>(ParseDSN(dsn), Self());
+}
+
+MySQLConnector::MySQLConnector(const Config& cfg, std::shared_ptr<driver::Driver> driver)
+    : cfg_(cfg), driver_(driver) {}
+
+std::shared_ptr<driver::Conn> MySQLConnector::Connect() {
+    return std::make_shared<MySQLConn>(cfg_);
+}
+
+std::shared_ptr<driver::Driver> MySQLConnector::Driver() {
+    return driver_;
+}
+
 std::shared_ptr<MySQLDriver> CreateMySQLDriver() {
     return std::make_shared<MySQLDriver>();
 }
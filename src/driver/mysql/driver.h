@@ -3,6 +3,7 @@
 #include <map>
 
 #include "sqlcc/driver/driver.h"
+#include "driver/mysql/dsn.h"
 
 namespace sqlcc {
 namespace driver {
@@ -12,6 +13,18 @@ class MySQLDriver : public driver::Driver {
 public:
     MySQLDriver();
     std::shared_ptr<driver::Conn> Open(const std::string& name) override;
+    std::shared_ptr<driver::Connector> OpenConnector(const std::string& name) override;
+};
+
+// MySQLConnector opens connections from a DSN parsed once
+class MySQLConnector : public driver::Connector {
+public:
+    MySQLConnector(const Config& cfg, std::shared_ptr<driver::Driver> driver);
+    std::shared_ptr<driver::Conn> Connect() override;
+    std::shared_ptr<driver::Driver> Driver() override;
+private:
+    Config cfg_;
+    std::shared_ptr<driver::Driver> driver_;
 };
 
 } // namespace mysql
@@ -15,7 +15,9 @@ Config::Config()
       timeout(5),
       read_timeout(5),
       write_timeout(5),
-      reconnect(1) {}
+      reconnect(1),
+      result_mode(ResultMode::kStream),
+      prefetch_rows(128) {}
 
 std::ostream& operator<<(std::ostream& os, const Config& cfg) {
     if (cfg.user.size() || cfg.passwd.size()) {
@@ -68,6 +70,17 @@ static void ParseDBName(Config* cfg, const std::string& dbname) {
     cfg->dbname = dbname;
 }
 
+static ResultMode ParseResultMode(const std::string& mode) {
+    if (mode == "stream") {
+        return ResultMode::kStream;
+    } else if (mode == "buffered") {
+        return ResultMode::kBuffered;
+    } else if (mode == "cursor") {
+        return ResultMode::kCursor;
+    }
+    throw std::invalid_argument("invalid result_mode: " + mode);
+}
+
 static void ParseKVParam(Config* cfg, const std::string& kv_param) {
     std::size_t equal_pos = kv_param.find('=');
     std::string k;
@@ -88,6 +101,10 @@ static void ParseKVParam(Config* cfg, const std::string& kv_param) {
         cfg->reconnect = std::stol(v);
     } else if (k == "charset") {
         cfg->charset = v;
+    } else if (k == "result_mode") {
+        cfg->result_mode = ParseResultMode(v);
+    } else if (k == "prefetch_rows") {
+        cfg->prefetch_rows = std::stoul(v);
     } else {
         throw std::invalid_argument("unrecognized param: " + k);
     }
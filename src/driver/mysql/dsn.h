@@ -2,6 +2,8 @@
 
 #include <string>
 
+#include "sqlcc/driver/driver.h"
+
 namespace sqlcc {
 namespace driver {
 namespace mysql {
@@ -17,6 +19,9 @@ struct Config {
     int32_t write_timeout;
     int32_t reconnect;
     std::string charset;
+    // result_mode=stream|buffered|cursor
+    ResultMode result_mode;
+    uint32_t prefetch_rows;
     Config();
 };
 
@@ -0,0 +1,466 @@
+#include "driver/mysql/pipeline.h"
+
+#include "driver/mysql/datetime.h"
+#include "driver/mysql/exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+namespace {
+
+class TextResult : public driver::SQLResult {
+   public:
+    TextResult(int64_t last_insert_id, int64_t rows_affected)
+        : last_insert_id_(last_insert_id), rows_affected_(rows_affected) {}
+    int64_t LastInsertID() override { return last_insert_id_; }
+    int64_t RowsAffected() override { return rows_affected_; }
+
+   private:
+    int64_t last_insert_id_;
+    int64_t rows_affected_;
+};
+
+// TextRows reads a stored text protocol result set, every column arrives
+// as a string and is parsed into the scan destination.
+class TextRows : public driver::SQLRows {
+   public:
+    TextRows(MYSQL_RES *res);
+    ~TextRows();
+    const std::vector<std::string> &Columns() const override {
+        return columns_;
+    }
+    bool Next() override;
+    void Scan(std::vector<Value> &dest) override;
+    void ScanCells(Cell *dest, std::size_t size) override;
+    std::size_t ReadColumn(std::size_t idx, uint64_t offset, char *buf,
+                           std::size_t size) override;
+    int64_t RowCount() override { return (int64_t)mysql_num_rows(res_); }
+    void Seek(uint64_t row) override { mysql_data_seek(res_, row); }
+
+   private:
+    MYSQL_RES *res_;
+    MYSQL_ROW row_;
+    unsigned long *lengths_;
+    std::vector<std::string> columns_;
+    // cell type of every column, numbers are parsed from their text
+    std::vector<Cell::Type> types_;
+};
+
+static Cell::Type TextCellType(const MYSQL_FIELD &field) {
+    switch (field.type) {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_LONGLONG:
+            return field.flags & UNSIGNED_FLAG ? Cell::Type::kUInt64
+                                               : Cell::Type::kInt64;
+        case MYSQL_TYPE_FLOAT:
+        case MYSQL_TYPE_DOUBLE:
+            return Cell::Type::kDouble;
+        default:
+            return Cell::Type::kString;
+    }
+}
+
+TextRows::TextRows(MYSQL_RES *res)
+    : res_(res), row_(nullptr), lengths_(nullptr) {
+    MYSQL_FIELD *fields = mysql_fetch_fields(res_);
+    unsigned int size = mysql_num_fields(res_);
+    columns_.reserve(size);
+    types_.reserve(size);
+    for (unsigned int i = 0; i < size; i++) {
+        columns_.emplace_back(fields[i].name, fields[i].name_length);
+        types_.push_back(TextCellType(fields[i]));
+    }
+}
+
+TextRows::~TextRows() { mysql_free_result(res_); }
+
+bool TextRows::Next() {
+    row_ = mysql_fetch_row(res_);
+    if (row_ == nullptr) {
+        return false;
+    }
+    lengths_ = mysql_fetch_lengths(res_);
+    return true;
+}
+
+static void TextTo(const char *p, unsigned long length, int64_t &dest) {
+    if (p == nullptr) {
+        throw Exception(400, "can't bind null to int64_t");
+    }
+    dest = std::strtoll(p, nullptr, 10);
+}
+
+static void TextTo(const char *p, unsigned long length, uint64_t &dest) {
+    if (p == nullptr) {
+        throw Exception(400, "can't bind null to uint64_t");
+    }
+    dest = std::strtoull(p, nullptr, 10);
+}
+
+static void TextTo(const char *p, unsigned long length, double &dest) {
+    if (p == nullptr) {
+        throw Exception(400, "can't bind null to double");
+    }
+    dest = std::strtod(p, nullptr);
+}
+
+static void TextTo(const char *p, unsigned long length, std::string &dest) {
+    if (p == nullptr) {
+        throw Exception(400, "can't bind null to string");
+    }
+    dest.assign(p, length);
+}
+
+// "YYYY-MM-DD hh:mm:ss"
+static void TextTo(const char *p, unsigned long length, std::tm &dest) {
+    if (p == nullptr) {
+        throw Exception(400, "can't bind null to tm");
+    }
+    std::memset(&dest, 0, sizeof(std::tm));
+    if (length != 19 ||
+        std::sscanf(p, "%4d-%2d-%2d %2d:%2d:%2d", &dest.tm_year, &dest.tm_mon,
+                    &dest.tm_mday, &dest.tm_hour, &dest.tm_min,
+                    &dest.tm_sec) != 6) {
+        throw Exception(400, "can't bind to tm");
+    }
+    dest.tm_year -= 1900;
+    dest.tm_mon -= 1;
+}
+
+static void TextTo(const char *p, unsigned long length, TimePoint &dest) {
+    if (p == nullptr) {
+        throw Exception(400, "can't bind null to time_point");
+    }
+    MYSQL_TIME time;
+    if (!ParseMySQLTime(p, length, &time)) {
+        throw Exception(400, "can't bind to time_point");
+    }
+    dest = MySQLTimeToTimePoint(time);
+}
+
+template <typename T>
+static void TextTo(const char *p, unsigned long length, NullValue<T> &dest) {
+    if (p == nullptr) {
+        dest = NullValue<T>();
+        return;
+    }
+    TextTo(p, length, *dest);
+}
+
+void TextRows::Scan(std::vector<Value> &dest) {
+    if (dest.size() != columns_.size()) {
+        throw Exception(400, "sql: expected " +
+                                 std::to_string(columns_.size()) +
+                                 " destination arguments in Scan, not " +
+                                 std::to_string(dest.size()));
+    }
+    for (std::size_t i = 0; i < dest.size(); i++) {
+        const char *p = row_[i];
+        unsigned long length = lengths_[i];
+        std::visit([p, length](auto &&value) { TextTo(p, length, value); },
+                   dest[i]);
+    }
+}
+
+void TextRows::ScanCells(Cell *dest, std::size_t size) {
+    if (size != columns_.size()) {
+        throw Exception(400, "sql: expected " +
+                                 std::to_string(columns_.size()) +
+                                 " cells in ScanCells, not " +
+                                 std::to_string(size));
+    }
+    for (std::size_t i = 0; i < size; i++) {
+        const char *p = row_[i];
+        if (p == nullptr) {
+            dest[i] = Cell::Null(types_[i]);
+            continue;
+        }
+        // text rows are nul terminated
+        switch (types_[i]) {
+            case Cell::Type::kInt64:
+                dest[i] = Cell::Int64(std::strtoll(p, nullptr, 10));
+                break;
+            case Cell::Type::kUInt64:
+                dest[i] = Cell::UInt64(std::strtoull(p, nullptr, 10));
+                break;
+            case Cell::Type::kDouble:
+                dest[i] = Cell::Double(std::strtod(p, nullptr));
+                break;
+            case Cell::Type::kString:
+                dest[i] = Cell::String(p, lengths_[i]);
+                break;
+        }
+    }
+}
+
+std::size_t TextRows::ReadColumn(std::size_t idx, uint64_t offset, char *buf,
+                                 std::size_t size) {
+    if (idx >= columns_.size()) {
+        throw Exception(400, "sql: column index out of range");
+    }
+    // text rows arrive whole, this only copies
+    if (row_[idx] == nullptr || offset >= lengths_[idx]) {
+        return 0;
+    }
+    std::size_t n = std::min<uint64_t>(size, lengths_[idx] - offset);
+    memcpy(buf, row_[idx] + offset, n);
+    return n;
+}
+
+class LiteralWriter {
+   public:
+    LiteralWriter(MYSQL *mysql, std::string *out, std::string *scratch)
+        : mysql_(mysql), out_(out), scratch_(scratch) {}
+    void operator()(int64_t v) { out_->append(std::to_string(v)); }
+    void operator()(uint64_t v) { out_->append(std::to_string(v)); }
+    void operator()(double v) {
+        if (!std::isfinite(v)) {
+            throw Exception(400, "sql: can't inline non-finite double");
+        }
+        char buf[32];
+        int n = std::snprintf(buf, sizeof(buf), "%.17g", v);
+        out_->append(buf, n);
+    }
+    void operator()(const std::string &v) {
+        scratch_->resize(v.size() * 2 + 1);
+        unsigned long n =
+            mysql_real_escape_string(mysql_, &(*scratch_)[0], v.data(), v.size());
+        out_->push_back('\'');
+        out_->append(scratch_->data(), n);
+        out_->push_back('\'');
+    }
+    void operator()(const std::tm &v) {
+        char buf[32];
+        std::size_t n = std::strftime(buf, sizeof(buf), "'%Y-%m-%d %H:%M:%S'", &v);
+        out_->append(buf, n);
+    }
+    void operator()(TimePoint v) {
+        MYSQL_TIME time;
+        char buf[kMaxTimeText];
+        TimePointToMySQLTime(v, &time);
+        std::size_t n = FormatMySQLTime(time, 6, buf);
+        out_->push_back('\'');
+        out_->append(buf, n);
+        out_->push_back('\'');
+    }
+    template <typename T>
+    void operator()(const NullValue<T> &v) {
+        if (!v) {
+            out_->append("NULL");
+            return;
+        }
+        (*this)(*v);
+    }
+
+   private:
+    MYSQL *mysql_;
+    std::string *out_;
+    std::string *scratch_;
+};
+
+// AppendQuery appends query to out with its placeholders replaced by the
+// literals of args. Placeholders inside quotes and comments are left alone.
+// An unterminated quote or comment throws, it would swallow the statements
+// queued after query and invert the quoting of their literals.
+static void AppendQuery(MYSQL *mysql, const std::string &query,
+                        const std::vector<Value> &args, std::string *out,
+                        std::string *scratch) {
+    LiteralWriter writer(mysql, out, scratch);
+    // a backslash is a plain character in strings under NO_BACKSLASH_ESCAPES
+    bool backslash = !(mysql->server_status & SERVER_STATUS_NO_BACKSLASH_ESCAPES);
+    std::size_t arg = 0;
+    std::size_t n = query.size();
+    for (std::size_t i = 0; i < n; i++) {
+        char c = query[i];
+        if (c == '\'' || c == '"' || c == '`') {
+            std::size_t j = i + 1;
+            while (j < n && query[j] != c) {
+                if (query[j] == '\\' && c != '`' && backslash) {
+                    j++;
+                }
+                j++;
+            }
+            if (j >= n) {
+                throw Exception(400, "sql: unterminated quote in " + query);
+            }
+            out->append(query, i, j + 1 - i);
+            i = j;
+        } else if (c == '#' || (c == '-' && i + 2 < n && query[i + 1] == '-' &&
+                                (query[i + 2] == ' ' || query[i + 2] == '\t'))) {
+            std::size_t j = query.find('\n', i);
+            if (j == query.npos) {
+                // keep the separator of the next statement out of the
+                // comment
+                out->append(query, i, n - i);
+                out->push_back('\n');
+                break;
+            }
+            out->append(query, i, j - i);
+            i = j - 1;
+        } else if (c == '/' && i + 1 < n && query[i + 1] == '*') {
+            std::size_t j = query.find("*/", i + 2);
+            if (j == query.npos) {
+                throw Exception(400, "sql: unterminated comment in " + query);
+            }
+            j += 2;
+            out->append(query, i, j - i);
+            i = j - 1;
+        } else if (c == '?') {
+            if (arg < args.size()) {
+                std::visit(writer, args[arg]);
+            }
+            arg++;
+        } else {
+            out->push_back(c);
+        }
+    }
+    if (arg != args.size()) {
+        throw Exception(400, "sql: expected " + std::to_string(arg) +
+                                 " arguments, got " +
+                                 std::to_string(args.size()));
+    }
+}
+
+}  // namespace
+
+MySQLPipeline::MySQLPipeline(MySQLConn *conn)
+    : conn_(conn), state_(State::kQueueing), size_(0) {}
+
+MySQLPipeline::~MySQLPipeline() { Drain(); }
+
+void MySQLPipeline::Add(const std::string &query,
+                        const std::vector<Value> &args) {
+    if (state_ != State::kQueueing) {
+        Drain();
+        state_ = State::kQueueing;
+    }
+    std::size_t mark = sql_.size();
+    if (size_ > 0) {
+        sql_.push_back(';');
+    }
+    try {
+        AppendQuery(&conn_->mysql_, query, args, &sql_, &escaped_);
+    } catch (...) {
+        sql_.resize(mark);
+        throw;
+    }
+    size_++;
+}
+
+void MySQLPipeline::Send() {
+    if (state_ != State::kQueueing) {
+        return;
+    }
+    if (size_ == 0) {
+        state_ = State::kDone;
+        return;
+    }
+    conn_->EnableMultiStatements();
+    int ret = mysql_real_query(&conn_->mysql_, sql_.data(), sql_.size());
+    sql_.clear();
+    size_ = 0;
+    state_ = State::kSent;
+    if (ret != 0) {
+        error_ = std::make_exception_ptr(ExceptionFromMySQL(&conn_->mysql_));
+    }
+}
+
+void MySQLPipeline::ReadResult() {
+    MYSQL *mysql = &conn_->mysql_;
+    if (mysql_field_count(mysql) == 0) {
+        result_ = std::make_shared<TextResult>(mysql_insert_id(mysql),
+                                               mysql_affected_rows(mysql));
+        return;
+    }
+    MYSQL_RES *res = mysql_store_result(mysql);
+    if (res == nullptr) {
+        Exception error = ExceptionFromMySQL(mysql);
+        Done();
+        throw error;
+    }
+    rows_ = std::make_shared<TextRows>(res);
+}
+
+bool MySQLPipeline::Next() {
+    result_.reset();
+    rows_.reset();
+    switch (state_) {
+        case State::kQueueing:
+            throw Exception(400, "sql: pipeline is not sent");
+        case State::kDone:
+            return false;
+        case State::kSent:
+            state_ = State::kReading;
+            if (error_) {
+                std::exception_ptr error = std::move(error_);
+                Done();
+                std::rethrow_exception(error);
+            }
+            break;
+        case State::kReading: {
+            int ret = mysql_next_result(&conn_->mysql_);
+            if (ret < 0) {
+                Done();
+                return false;
+            }
+            if (ret > 0) {
+                Exception error = ExceptionFromMySQL(&conn_->mysql_);
+                Done();
+                throw error;
+            }
+            break;
+        }
+    }
+    ReadResult();
+    return true;
+}
+
+std::shared_ptr<driver::SQLResult> MySQLPipeline::CurrentResult() {
+    return result_;
+}
+
+std::shared_ptr<driver::SQLRows> MySQLPipeline::CurrentRows() {
+    return rows_;
+}
+
+void MySQLPipeline::Done() {
+    state_ = State::kDone;
+    conn_->DisableMultiStatements();
+}
+
+void MySQLPipeline::Drain() {
+    // the connection is out of sync until every result has been read
+    MYSQL *mysql = &conn_->mysql_;
+    bool pending = state_ == State::kSent && !error_;
+    bool more = pending || state_ == State::kReading;
+    state_ = State::kDone;
+    result_.reset();
+    rows_.reset();
+    sql_.clear();
+    size_ = 0;
+    error_ = nullptr;
+    if (pending && mysql_field_count(mysql) > 0) {
+        mysql_free_result(mysql_store_result(mysql));
+    }
+    while (more && mysql_next_result(mysql) == 0) {
+        if (mysql_field_count(mysql) > 0) {
+            mysql_free_result(mysql_store_result(mysql));
+        }
+    }
+    conn_->DisableMultiStatements();
+}
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "sqlcc/driver/driver.h"
+
+#include "driver/mysql/conn.h"
+
+#include <exception>
+#include <string>
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+// MySQLPipeline joins the queued statements into one multi-statement text
+// query, arguments are escaped and inlined on the client. Result sets are
+// stored, so rows stay valid after moving to the next result. Multi
+// statements are on for the connection only until the results are read.
+class MySQLPipeline : public driver::Pipeline {
+public:
+    MySQLPipeline(MySQLConn* conn);
+    ~MySQLPipeline();
+    void Add(const std::string& query, const std::vector<Value>& args) override;
+    void Send() override;
+    bool Next() override;
+    std::shared_ptr<driver::SQLResult> CurrentResult() override;
+    std::shared_ptr<driver::SQLRows> CurrentRows() override;
+private:
+    enum class State { kQueueing, kSent, kReading, kDone };
+    void ReadResult();
+    // Done ends the reading once no result is pending
+    void Done();
+    void Drain();
+    MySQLConn* conn_;
+    State state_;
+    std::string sql_;
+    std::size_t size_;
+    // scratch of the escaped string arguments
+    std::string escaped_;
+    // error of the first statement, thrown by the first Next
+    std::exception_ptr error_;
+    std::shared_ptr<driver::SQLResult> result_;
+    std::shared_ptr<driver::SQLRows> rows_;
+};
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
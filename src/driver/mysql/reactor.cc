@@ -0,0 +1,212 @@
+#include "driver/mysql/reactor.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+#include <vector>
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+static const unsigned int kMaxReactors = 4;
+
+static const int kMaxEvents = 64;
+
+Reactor& Reactor::For(MYSQL* mysql) {
+    static std::vector<std::unique_ptr<Reactor>> reactors = [] {
+        unsigned int n = std::max(
+            1u, std::min(kMaxReactors, std::thread::hardware_concurrency()));
+        std::vector<std::unique_ptr<Reactor>> reactors;
+        for (unsigned int i = 0; i < n; i++) {
+            reactors.emplace_back(new Reactor);
+        }
+        return reactors;
+    }();
+    // a connection always goes to the same reactor
+    return *reactors[mysql_get_socket(mysql) % reactors.size()];
+}
+
+Reactor::Reactor() : epfd_(-1), eventfd_(-1), stop_(false) {
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd_ < 0) {
+        throw std::system_error(errno, std::system_category(),
+                                "epoll_create1");
+    }
+    eventfd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (eventfd_ < 0) {
+        int err = errno;
+        close(epfd_);
+        throw std::system_error(err, std::system_category(), "eventfd");
+    }
+    // the wakeup event is the only one without an op
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, eventfd_, &ev);
+    thread_ = std::thread(&Reactor::Loop, this);
+}
+
+Reactor::~Reactor() {
+    stop_ = true;
+    Wakeup();
+    thread_.join();
+    close(eventfd_);
+    close(epfd_);
+}
+
+void Reactor::Wakeup() {
+    uint64_t one = 1;
+    ssize_t n = write(eventfd_, &one, sizeof(one));
+    (void)n;
+}
+
+void Reactor::Run(MYSQL* mysql, std::unique_ptr<AsyncOp> op) {
+    int wait = op->Start();
+    if (wait == 0) {
+        op->Complete();
+        return;
+    }
+    Pending* p = new Pending;
+    p->op = std::move(op);
+    p->mysql = mysql;
+    p->fd = mysql_get_socket(mysql);
+    p->has_timer = false;
+    Arm(p, wait, EPOLL_CTL_ADD);
+}
+
+void Reactor::Arm(Pending* p, int wait, int ctl) {
+    epoll_event ev = {};
+    ev.events = EPOLLONESHOT;
+    if (wait & MYSQL_WAIT_READ) {
+        ev.events |= EPOLLIN;
+    }
+    if (wait & MYSQL_WAIT_WRITE) {
+        ev.events |= EPOLLOUT;
+    }
+    if (wait & MYSQL_WAIT_EXCEPT) {
+        ev.events |= EPOLLPRI;
+    }
+    ev.data.ptr = p;
+    // held until the socket is armed, so the loop sees the timer and the
+    // socket together
+    std::lock_guard<std::mutex> lock(mu_);
+    if (wait & MYSQL_WAIT_TIMEOUT) {
+        Clock::time_point deadline =
+            Clock::now() +
+            std::chrono::milliseconds(mysql_get_timeout_value_ms(p->mysql));
+        bool earliest = timers_.empty() || deadline < timers_.begin()->first;
+        p->timer = timers_.emplace(deadline, p);
+        p->has_timer = true;
+        // the loop may sleep past the new deadline
+        if (earliest && std::this_thread::get_id() != thread_.get_id()) {
+            Wakeup();
+        }
+    }
+    epoll_ctl(epfd_, ctl, p->fd, &ev);
+}
+
+void Reactor::CancelTimer(Pending* p) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (p->has_timer) {
+        timers_.erase(p->timer);
+        p->has_timer = false;
+    }
+}
+
+void Reactor::Step(Pending* p, int status) {
+    int wait = p->op->Continue(status);
+    if (wait != 0) {
+        Arm(p, wait, EPOLL_CTL_MOD);
+        return;
+    }
+    Finish(p);
+}
+
+void Reactor::Finish(Pending* p) {
+    std::unique_ptr<Pending> done(p);
+    // the socket has to leave the epoll set before the connection can be
+    // handed to the next op
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, p->fd, nullptr);
+    try {
+        p->op->Complete();
+    } catch (...) {
+        // a throwing callback must not take the reactor down
+    }
+}
+
+int Reactor::NextTimeout() {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (timers_.empty()) {
+        return -1;
+    }
+    Clock::duration d = timers_.begin()->first - Clock::now();
+    if (d <= Clock::duration::zero()) {
+        return 0;
+    }
+    // round up so the timer is due when epoll_wait returns
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               d + std::chrono::milliseconds(1) - Clock::duration(1))
+        .count();
+}
+
+void Reactor::Loop() {
+    mysql_thread_init();
+    epoll_event events[kMaxEvents];
+    std::vector<Pending*> expired;
+    while (!stop_) {
+        int n = epoll_wait(epfd_, events, kMaxEvents, NextTimeout());
+        if (n < 0 && errno != EINTR) {
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            Pending* p = static_cast<Pending*>(events[i].data.ptr);
+            if (p == nullptr) {
+                uint64_t count;
+                ssize_t r = read(eventfd_, &count, sizeof(count));
+                (void)r;
+                continue;
+            }
+            int status = 0;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                status |= MYSQL_WAIT_READ;
+            }
+            if (events[i].events & EPOLLOUT) {
+                status |= MYSQL_WAIT_WRITE;
+            }
+            if (events[i].events & EPOLLPRI) {
+                status |= MYSQL_WAIT_EXCEPT;
+            }
+            CancelTimer(p);
+            Step(p, status);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            Clock::time_point now = Clock::now();
+            while (!timers_.empty() && timers_.begin()->first <= now) {
+                Pending* p = timers_.begin()->second;
+                timers_.erase(timers_.begin());
+                p->has_timer = false;
+                expired.push_back(p);
+            }
+        }
+        for (Pending* p : expired) {
+            // disarm the socket, Step arms it again if the call goes on
+            epoll_event ev = {};
+            ev.data.ptr = p;
+            epoll_ctl(epfd_, EPOLL_CTL_MOD, p->fd, &ev);
+            Step(p, MYSQL_WAIT_TIMEOUT);
+        }
+        expired.clear();
+    }
+    mysql_thread_end();
+}
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
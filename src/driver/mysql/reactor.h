@@ -0,0 +1,72 @@
+#pragma once
+
+#include <mysql.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+// AsyncOp is a non-blocking mariadb call, driven by Start and Continue
+// which return the MYSQL_WAIT_* events the call waits for, 0 once it is
+// done.
+class AsyncOp {
+public:
+    virtual ~AsyncOp() {}
+    virtual int Start() = 0;
+    virtual int Continue(int status) = 0;
+    // Complete is called once the call is done, the op is deleted after it.
+    virtual void Complete() = 0;
+};
+
+// Reactor runs non-blocking calls on an epoll loop, so a handful of threads
+// can wait for many connections. A connection must have MYSQL_OPT_NONBLOCK
+// set and must not be used by anyone else until its op completed.
+class Reactor {
+public:
+    // For returns the reactor serving the connection, the reactors are
+    // started on first use.
+    static Reactor& For(MYSQL* mysql);
+    Reactor();
+    ~Reactor();
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+    // Run starts op on the calling thread, it completes on the reactor
+    // thread, or on the calling thread when it did not have to wait.
+    void Run(MYSQL* mysql, std::unique_ptr<AsyncOp> op);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Pending {
+        std::unique_ptr<AsyncOp> op;
+        MYSQL* mysql;
+        int fd;
+        bool has_timer;
+        std::multimap<Clock::time_point, Pending*>::iterator timer;
+    };
+    void Loop();
+    void Arm(Pending* p, int wait, int ctl);
+    void Step(Pending* p, int status);
+    void Finish(Pending* p);
+    void CancelTimer(Pending* p);
+    int NextTimeout();
+    void Wakeup();
+
+    int epfd_;
+    int eventfd_;
+    std::atomic<bool> stop_;
+    // guards timers_, they are added by the threads starting ops
+    std::mutex mu_;
+    std::multimap<Clock::time_point, Pending*> timers_;
+    std::thread thread_;
+};
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
@@ -0,0 +1,310 @@
+#include "driver/mysql/scan.h"
+
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "sqlcc/exception.h"
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+// Fits tells whether the integer of a column, unsigned or not, is in the
+// range of T
+template <typename T>
+static bool Fits(const MYSQL_BIND *bind) {
+    if (bind->is_unsigned) {
+        uint64_t v = *static_cast<const uint64_t *>(bind->buffer);
+        return v <= uint64_t(std::numeric_limits<T>::max());
+    }
+    int64_t v = *static_cast<const int64_t *>(bind->buffer);
+    if (std::is_signed<T>::value) {
+        return v >= int64_t(std::numeric_limits<T>::min()) &&
+               v <= int64_t(std::numeric_limits<T>::max());
+    }
+    return v >= 0 && uint64_t(v) <= uint64_t(std::numeric_limits<T>::max());
+}
+
+template <typename T>
+static void LongLongTo(const MYSQL_BIND *bind, void *dest) {
+    if (*bind->is_null) {
+        throw Exception(400, "can't bind null to integer");
+    }
+    if constexpr (std::is_integral<T>::value && !std::is_same<T, bool>::value) {
+        if (!Fits<T>(bind)) {
+            throw Exception(400, "can't bind integer out of range");
+        }
+    }
+    if (bind->is_unsigned) {
+        *static_cast<T *>(dest) =
+            static_cast<T>(*static_cast<const uint64_t *>(bind->buffer));
+    } else {
+        *static_cast<T *>(dest) =
+            static_cast<T>(*static_cast<const int64_t *>(bind->buffer));
+    }
+}
+
+template <typename T>
+static void DoubleTo(const MYSQL_BIND *bind, void *dest) {
+    if (*bind->is_null) {
+        throw Exception(400, "can't bind null to double");
+    }
+    *static_cast<T *>(dest) =
+        static_cast<T>(*static_cast<const double *>(bind->buffer));
+}
+
+static void StringTo(const MYSQL_BIND *bind, void *dest) {
+    if (*bind->is_null) {
+        throw Exception(400, "can't bind null to string");
+    }
+    static_cast<std::string *>(dest)->assign(
+        static_cast<const char *>(bind->buffer), *bind->length);
+}
+
+static int ParseDigits(const char *p, int n) {
+    int v = 0;
+    for (int i = 0; i < n; i++) {
+        if (p[i] < '0' || p[i] > '9') {
+            throw Exception(400, "can't bind to tm");
+        }
+        v = v * 10 + (p[i] - '0');
+    }
+    return v;
+}
+
+// "YYYY-MM-DD hh:mm:ss"
+static void StringToTm(const MYSQL_BIND *bind, void *dest) {
+    if (*bind->is_null) {
+        throw Exception(400, "can't bind null to tm");
+    }
+    if (*bind->length != 19) {
+        throw Exception(400, "can't bind to tm");
+    }
+    const char *p = static_cast<const char *>(bind->buffer);
+    std::tm *tm = static_cast<std::tm *>(dest);
+    memset(tm, 0, sizeof(std::tm));
+    tm->tm_year = ParseDigits(p, 4) - 1900;
+    tm->tm_mon = ParseDigits(p + 5, 2) - 1;
+    tm->tm_mday = ParseDigits(p + 8, 2);
+    tm->tm_hour = ParseDigits(p + 11, 2);
+    tm->tm_min = ParseDigits(p + 14, 2);
+    tm->tm_sec = ParseDigits(p + 17, 2);
+}
+
+static void StringToTimePoint(const MYSQL_BIND *bind, void *dest) {
+    MYSQL_TIME time;
+    if (*bind->is_null) {
+        throw Exception(400, "can't bind null to time_point");
+    }
+    if (!ParseMySQLTime(static_cast<const char *>(bind->buffer), *bind->length,
+                        &time)) {
+        throw Exception(400, "can't bind to time_point");
+    }
+    *static_cast<TimePoint *>(dest) = MySQLTimeToTimePoint(time);
+}
+
+// temporal columns arrive as MYSQL_TIME
+
+template <unsigned int Decimals>
+static void TimeToString(const MYSQL_BIND *bind, void *dest) {
+    if (*bind->is_null) {
+        throw Exception(400, "can't bind null to string");
+    }
+    char text[kMaxTimeText];
+    std::size_t n = FormatMySQLTime(
+        *static_cast<const MYSQL_TIME *>(bind->buffer), Decimals, text);
+    static_cast<std::string *>(dest)->assign(text, n);
+}
+
+static void TimeToTm(const MYSQL_BIND *bind, void *dest) {
+    if (*bind->is_null) {
+        throw Exception(400, "can't bind null to tm");
+    }
+    MySQLTimeToTm(*static_cast<const MYSQL_TIME *>(bind->buffer),
+                  static_cast<std::tm *>(dest));
+}
+
+static void TimeToTimePoint(const MYSQL_BIND *bind, void *dest) {
+    if (*bind->is_null) {
+        throw Exception(400, "can't bind null to time_point");
+    }
+    *static_cast<TimePoint *>(dest) =
+        MySQLTimeToTimePoint(*static_cast<const MYSQL_TIME *>(bind->buffer));
+}
+
+template <typename T, ScanPlan::Convert F>
+static void NullTo(const MYSQL_BIND *bind, void *dest) {
+    NullValue<T> *value = static_cast<NullValue<T> *>(dest);
+    if (*bind->is_null) {
+        *value = NullValue<T>();
+        return;
+    }
+    // non-const operator* marks the value as not null
+    F(bind, &**value);
+}
+
+static ScanPlan::Convert LongLongConvert(ScanType type) {
+    switch (type) {
+        case ScanType::kBool:
+            return LongLongTo<bool>;
+        case ScanType::kInt8:
+            return LongLongTo<int8_t>;
+        case ScanType::kInt16:
+            return LongLongTo<int16_t>;
+        case ScanType::kInt32:
+            return LongLongTo<int32_t>;
+        case ScanType::kInt64:
+            return LongLongTo<int64_t>;
+        case ScanType::kUInt8:
+            return LongLongTo<uint8_t>;
+        case ScanType::kUInt16:
+            return LongLongTo<uint16_t>;
+        case ScanType::kUInt32:
+            return LongLongTo<uint32_t>;
+        case ScanType::kUInt64:
+            return LongLongTo<uint64_t>;
+        case ScanType::kFloat:
+            return LongLongTo<float>;
+        case ScanType::kDouble:
+            return LongLongTo<double>;
+        case ScanType::kNullInt64:
+            return NullTo<int64_t, LongLongTo<int64_t>>;
+        case ScanType::kNullUInt64:
+            return NullTo<uint64_t, LongLongTo<uint64_t>>;
+        case ScanType::kNullDouble:
+            return NullTo<double, LongLongTo<double>>;
+        default:
+            return nullptr;
+    }
+}
+
+static ScanPlan::Convert DoubleConvert(ScanType type) {
+    switch (type) {
+        case ScanType::kFloat:
+            return DoubleTo<float>;
+        case ScanType::kDouble:
+            return DoubleTo<double>;
+        case ScanType::kNullDouble:
+            return NullTo<double, DoubleTo<double>>;
+        default:
+            return nullptr;
+    }
+}
+
+static ScanPlan::Convert StringConvert(ScanType type) {
+    switch (type) {
+        case ScanType::kString:
+            return StringTo;
+        case ScanType::kTm:
+            return StringToTm;
+        case ScanType::kNullString:
+            return NullTo<std::string, StringTo>;
+        case ScanType::kNullTm:
+            return NullTo<std::tm, StringToTm>;
+        case ScanType::kTimePoint:
+            return StringToTimePoint;
+        case ScanType::kNullTimePoint:
+            return NullTo<TimePoint, StringToTimePoint>;
+        default:
+            return nullptr;
+    }
+}
+
+template <unsigned int Decimals>
+static ScanPlan::Convert TimeConvert(ScanType type) {
+    switch (type) {
+        case ScanType::kString:
+            return TimeToString<Decimals>;
+        case ScanType::kTm:
+            return TimeToTm;
+        case ScanType::kTimePoint:
+            return TimeToTimePoint;
+        case ScanType::kNullString:
+            return NullTo<std::string, TimeToString<Decimals>>;
+        case ScanType::kNullTm:
+            return NullTo<std::tm, TimeToTm>;
+        case ScanType::kNullTimePoint:
+            return NullTo<TimePoint, TimeToTimePoint>;
+        default:
+            return nullptr;
+    }
+}
+
+// the fractional digits of the text are fixed per column, so they are
+// picked with the conversion
+static ScanPlan::Convert TimeConvert(ScanType type, unsigned int decimals) {
+    switch (decimals) {
+        case 1:
+            return TimeConvert<1>(type);
+        case 2:
+            return TimeConvert<2>(type);
+        case 3:
+            return TimeConvert<3>(type);
+        case 4:
+            return TimeConvert<4>(type);
+        case 5:
+            return TimeConvert<5>(type);
+        case 6:
+            return TimeConvert<6>(type);
+        default:
+            return TimeConvert<0>(type);
+    }
+}
+
+void ScanPlan::Reset() {
+    types_ = nullptr;
+    converts_.clear();
+}
+
+void ScanPlan::Build(ResultBind &bind, const ScanType *types,
+                     std::size_t size) {
+    if (size != bind.size()) {
+        throw Exception(400, "sql: expected " + std::to_string(bind.size()) +
+                                 " destination arguments in scan, not " +
+                                 std::to_string(size));
+    }
+    converts_.resize(size);
+    for (std::size_t i = 0; i < size; i++) {
+        Convert convert = nullptr;
+        switch (bind[i].buffer_type) {
+            case (MYSQL_TYPE_LONGLONG):
+                convert = LongLongConvert(types[i]);
+                break;
+            case (MYSQL_TYPE_DOUBLE):
+                convert = DoubleConvert(types[i]);
+                break;
+            case (MYSQL_TYPE_DATE):
+            case (MYSQL_TYPE_DATETIME):
+            case (MYSQL_TYPE_TIMESTAMP):
+            case (MYSQL_TYPE_TIME):
+                convert = TimeConvert(types[i], bind.Decimals(i));
+                break;
+            default:
+                convert = StringConvert(types[i]);
+                break;
+        }
+        if (convert == nullptr) {
+            types_ = nullptr;
+            throw Exception(400, "can't scan column " + bind.Columns()[i] +
+                                     " into destination " +
+                                     std::to_string(i));
+        }
+        converts_[i] = convert;
+    }
+    types_ = types;
+}
+
+void ScanPlan::Scan(ResultBind &bind, const ScanType *types,
+                    void *const *dest, std::size_t size) {
+    if (types != types_ || size != converts_.size()) {
+        Build(bind, types, size);
+    }
+    for (std::size_t i = 0; i < size; i++) {
+        converts_[i](&bind[i], dest[i]);
+    }
+}
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "sqlcc/driver/driver.h"
+
+#include "driver/mysql/bind.h"
+
+#include <vector>
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+// ScanPlan picks, once per result set shape and destination types, the
+// conversion from every column bind buffer to its scan destination, so a
+// typed scan is a single indirect call per column.
+class ScanPlan {
+public:
+    using Convert = void (*)(const MYSQL_BIND* bind, void* dest);
+    // Reset drops the plan, it must be called when the result set shape
+    // changes.
+    void Reset();
+    // Scan converts the current row held by bind into dest.
+    void Scan(ResultBind& bind, const ScanType* types, void* const* dest,
+              std::size_t size);
+
+private:
+    void Build(ResultBind& bind, const ScanType* types, std::size_t size);
+    const ScanType* types_ = nullptr;
+    std::vector<Convert> converts_;
+};
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
@@ -3,7 +3,6 @@
 #include <cassert>
 #include <cstring>
 #include <iostream>
-#include <sstream>
 #include <stdexcept>
 
 #include "driver/mysql/exception.h"
@@ -16,6 +15,10 @@ namespace mysql {
 class SQLResult : public driver::SQLResult {
    public:
     SQLResult(int64_t last_insert_id, int64_t rows_affected);
+    void Reset(int64_t last_insert_id, int64_t rows_affected) {
+        last_insert_id_ = last_insert_id;
+        rows_affected_ = rows_affected;
+    }
     int64_t LastInsertID() override;
     int64_t RowsAffected() override;
 
@@ -33,50 +36,40 @@ int64_t SQLResult::RowsAffected() { return rows_affected_; }
 
 class SQLRows : public driver::SQLRows {
    public:
-    SQLRows(MYSQL_STMT *stmt);
+    // the rows become the current ones of the statement, generation counts
+    // the rows it handed out
+    SQLRows(MYSQL_STMT *stmt, ResultBind *bind, ScanPlan *plan,
+            uint64_t *generation, bool buffered, Metrics *metrics);
     ~SQLRows();
     virtual const std::vector<std::string> &Columns() const override;
     virtual bool Next() override;
     virtual void Scan(std::vector<Value> &dest) override;
+    virtual void ScanTyped(const ScanType *types, void *const *dest,
+                           std::size_t size) override;
+    virtual std::size_t NextBatch(Batch &batch, std::size_t n) override;
+    virtual void ScanCells(Cell *dest, std::size_t size) override;
+    virtual std::size_t ReadColumn(std::size_t idx, uint64_t offset, char *buf,
+                                   std::size_t size) override;
+    virtual int64_t RowCount() override;
+    virtual void Seek(uint64_t row) override;
 
    private:
+    bool Fetch();
+    void CountBytes();
     MYSQL_STMT *stmt_;
     MYSQL_FIELD *fields_;
     std::size_t fields_size_;
-    std::vector<std::string> columns_;
-    MYSQL_BIND *bind_;
+    ResultBind *bind_;
+    ScanPlan *plan_;
+    const uint64_t *current_;
+    uint64_t generation_;
+    bool buffered_;
+    Metrics *metrics_;
 };
 
-static void AllocateResultBind(MYSQL_FIELD *field, MYSQL_BIND *bind) {
-    bind->length = new uint64_t(0);
-    bind->error = new my_bool(0);
-    bind->is_null = new my_bool(0);
-    switch (field->type) {
-        case (MYSQL_TYPE_DECIMAL):
-        case (MYSQL_TYPE_TINY):
-        case (MYSQL_TYPE_SHORT):
-        case (MYSQL_TYPE_LONG):
-        case (MYSQL_TYPE_INT24):
-        case (MYSQL_TYPE_LONGLONG): {
-            bind->buffer_type = MYSQL_TYPE_LONGLONG;
-            bind->buffer = (void *)new int64_t;
-            bind->buffer_length = sizeof(int64_t);
-            break;
-        }
-        case (MYSQL_TYPE_FLOAT):
-        case (MYSQL_TYPE_DOUBLE): {
-            bind->buffer_type = MYSQL_TYPE_DOUBLE;
-            bind->buffer = (void *)new double;
-            bind->buffer_length = sizeof(double);
-            break;
-        }
-        default: {
-            bind->buffer_type = MYSQL_TYPE_STRING;
-            bind->buffer = (void *)new char[field->length];
-            bind->buffer_length = field->length;
-            break;
-        }
-    }
+// Phase returns histogram h of metrics, nullptr when metrics are off
+static Histogram *Phase(Metrics *metrics, Histogram Metrics::*h) {
+    return metrics ? &(metrics->*h) : nullptr;
 }
 
 static Value NullValueFromBind(MYSQL_BIND *bind) {
@@ -121,25 +114,44 @@ static void BindTo(MYSQL_FIELD *field, MYSQL_BIND *bind, std::string &dest) {
     if (*bind->is_null) {
         throw Exception(400, "can't bind null to string");
     }
+    if (IsTimeType(bind->buffer_type)) {
+        char text[kMaxTimeText];
+        std::size_t n = FormatMySQLTime(
+            *static_cast<MYSQL_TIME *>(bind->buffer), field->decimals, text);
+        dest.assign(text, n);
+        return;
+    }
     if (bind->buffer_type != MYSQL_TYPE_STRING) {
         throw Exception(400, "can't bind to string");
     }
     dest = std::string((char *)bind->buffer, *(bind->length));
 }
 
-static void BindTo(MYSQL_FIELD *field, MYSQL_BIND *bind, std::tm &dest) {
+// BindTime gets the MYSQL_TIME of a temporal column, or parses the text of
+// a string one
+static void BindTime(MYSQL_BIND *bind, MYSQL_TIME *time, const char *type) {
     if (*bind->is_null) {
-        throw Exception(400, "can't bind null to tm");
-    }
-    if (bind->buffer_type != MYSQL_TYPE_STRING) {
-        throw Exception(400, "can't bind to tm");
+        throw Exception(400, std::string("can't bind null to ") + type);
     }
-    if (*bind->length != 19) {
-        throw Exception(400, "can't bind to tm");
+    if (IsTimeType(bind->buffer_type)) {
+        *time = *static_cast<MYSQL_TIME *>(bind->buffer);
+    } else if (bind->buffer_type != MYSQL_TYPE_STRING ||
+               !ParseMySQLTime(static_cast<char *>(bind->buffer),
+                               *bind->length, time)) {
+        throw Exception(400, std::string("can't bind to ") + type);
     }
-    memset(&dest, 0, sizeof(std::tm));
-    std::istringstream ss(std::string((char *)bind->buffer, *(bind->length)));
-    ss >> std::get_time(&dest, "%Y-%m-%d %T");
+}
+
+static void BindTo(MYSQL_FIELD *field, MYSQL_BIND *bind, std::tm &dest) {
+    MYSQL_TIME time;
+    BindTime(bind, &time, "tm");
+    MySQLTimeToTm(time, &dest);
+}
+
+static void BindTo(MYSQL_FIELD *field, MYSQL_BIND *bind, TimePoint &dest) {
+    MYSQL_TIME time;
+    BindTime(bind, &time, "time_point");
+    dest = MySQLTimeToTimePoint(time);
 }
 
 template <typename T>
@@ -162,224 +174,521 @@ static void BindToValue(MYSQL_FIELD *field, MYSQL_BIND *bind, Value &value) {
     }
 }
 
-SQLRows::SQLRows(MYSQL_STMT *stmt)
-    : stmt_(stmt), fields_(nullptr), fields_size_(0), bind_(nullptr) {
+SQLRows::SQLRows(MYSQL_STMT *stmt, ResultBind *bind, ScanPlan *plan,
+                 uint64_t *generation, bool buffered, Metrics *metrics)
+    : stmt_(stmt),
+      fields_(nullptr),
+      fields_size_(0),
+      bind_(bind),
+      plan_(plan),
+      current_(generation),
+      generation_(++*generation),
+      buffered_(buffered),
+      metrics_(metrics) {
     fields_ = mariadb_stmt_fetch_fields(stmt_);
     fields_size_ = mysql_stmt_field_count(stmt_);
-    for (std::size_t i = 0; i < fields_size_; i++) {
-        columns_.push_back(fields_[i].name);
-    }
-    bind_ = new MYSQL_BIND[fields_size_];
-    memset(bind_, 0, sizeof(MYSQL_BIND) * fields_size_);
-    for (std::size_t i = 0; i < fields_size_; i++) {
-        AllocateResultBind(&fields_[i], &bind_[i]);
+    if (bind_->Prepare(fields_, fields_size_)) {
+        plan_->Reset();
     }
-    int ret = mysql_stmt_bind_result(stmt_, bind_);
+    int ret = mysql_stmt_bind_result(stmt_, bind_->data());
     if (ret != 0) {
         throw ExceptionFromStmt(stmt_);
     }
 }
 
-bool SQLRows::Next() {
-    int ret = mysql_stmt_fetch(stmt_);
-    if (ret != 0) {
-        if (ret == MYSQL_NO_DATA) {
-            return false;
+void SQLRows::CountBytes() {
+    uint64_t bytes = 0;
+    for (std::size_t i = 0; i < fields_size_; i++) {
+        const MYSQL_BIND &b = (*bind_)[i];
+        if (!*b.is_null) {
+            bytes += *b.length;
         }
+    }
+    metrics_->bytes_received.Add(bytes);
+}
+
+// Fetch fetches the next row, false at the end. Values of streamed
+// columns longer than their buffer come truncated, that is no error.
+bool SQLRows::Fetch() {
+    int ret;
+    {
+        PhaseTimer timer(Phase(metrics_, &Metrics::fetch));
+        ret = mysql_stmt_fetch(stmt_);
+    }
+    if (ret == MYSQL_NO_DATA) {
+        return false;
+    }
+    if (ret != 0 && (ret != MYSQL_DATA_TRUNCATED || !bind_->Truncated())) {
         throw ExceptionFromStmt(stmt_);
     }
+    bind_->NextRow();
+    if (metrics_) {
+        CountBytes();
+    }
     return true;
 }
 
+bool SQLRows::Next() { return Fetch(); }
+
 void SQLRows::Scan(std::vector<Value> &dest) {
     assert(dest.size() == fields_size_);
+    PhaseTimer timer(Phase(metrics_, &Metrics::decode));
+    bind_->Load(stmt_);
     for (std::size_t i = 0; i < fields_size_; i++) {
-        BindToValue(&fields_[i], &bind_[i], dest[i]);
+        BindToValue(&fields_[i], &(*bind_)[i], dest[i]);
+    }
+}
+
+void SQLRows::ScanTyped(const ScanType *types, void *const *dest,
+                        std::size_t size) {
+    PhaseTimer timer(Phase(metrics_, &Metrics::decode));
+    bind_->Load(stmt_);
+    plan_->Scan(*bind_, types, dest, size);
+}
+
+// temporal columns are batched as their text
+static Column::Type ColumnType(const MYSQL_BIND &bind) {
+    switch (bind.buffer_type) {
+        case (MYSQL_TYPE_LONGLONG):
+            return Column::Type::kInt64;
+        case (MYSQL_TYPE_DOUBLE):
+            return Column::Type::kDouble;
+        default:
+            return Column::Type::kString;
     }
 }
 
-static void free_result_bind(MYSQL_BIND *bind, std::size_t bind_size) {
-    for (std::size_t i = 0; i < bind_size; i++) {
-        delete bind[i].length;
-        delete bind[i].error;
-        delete bind[i].is_null;
-        switch (bind[i].buffer_type) {
-            case (MYSQL_TYPE_LONGLONG):
-                delete (int64_t *)bind[i].buffer;
+std::size_t SQLRows::NextBatch(Batch &batch, std::size_t n) {
+    ResultBind &bind = *bind_;
+    batch.rows = 0;
+    batch.columns.resize(fields_size_);
+    for (std::size_t i = 0; i < fields_size_; i++) {
+        Column &column = batch.columns[i];
+        column.name = bind.Columns()[i];
+        column.Reset(ColumnType(bind[i]), n);
+    }
+    while (batch.rows < n && Fetch()) {
+        PhaseTimer timer(Phase(metrics_, &Metrics::decode));
+        bind.Load(stmt_);
+        for (std::size_t i = 0; i < fields_size_; i++) {
+            const MYSQL_BIND &b = bind[i];
+            Column &column = batch.columns[i];
+            bool valid = !*b.is_null;
+            switch (column.type) {
+                case Column::Type::kInt64:
+                    column.AppendInt64(*static_cast<int64_t *>(b.buffer),
+                                       valid);
+                    break;
+                case Column::Type::kDouble:
+                    column.AppendDouble(*static_cast<double *>(b.buffer),
+                                        valid);
+                    break;
+                case Column::Type::kString:
+                    if (valid && IsTimeType(b.buffer_type)) {
+                        std::string_view text = bind.TimeText(i);
+                        column.AppendString(text.data(), text.size(), valid);
+                    } else {
+                        column.AppendString(static_cast<char *>(b.buffer),
+                                            *b.length, valid);
+                    }
+                    break;
+            }
+        }
+        batch.rows++;
+    }
+    return batch.rows;
+}
+
+void SQLRows::ScanCells(Cell *dest, std::size_t size) {
+    assert(size == fields_size_);
+    PhaseTimer timer(Phase(metrics_, &Metrics::decode));
+    ResultBind &bind = *bind_;
+    bind.Load(stmt_);
+    for (std::size_t i = 0; i < size; i++) {
+        const MYSQL_BIND &b = bind[i];
+        bool is_unsigned = fields_[i].flags & UNSIGNED_FLAG;
+        switch (b.buffer_type) {
+            case MYSQL_TYPE_LONGLONG:
+                if (*b.is_null) {
+                    dest[i] = Cell::Null(is_unsigned ? Cell::Type::kUInt64
+                                                     : Cell::Type::kInt64);
+                } else if (is_unsigned) {
+                    dest[i] = Cell::UInt64(*static_cast<uint64_t *>(b.buffer));
+                } else {
+                    dest[i] = Cell::Int64(*static_cast<int64_t *>(b.buffer));
+                }
                 break;
-            case (MYSQL_TYPE_DOUBLE):
-                delete (double *)bind[i].buffer;
+            case MYSQL_TYPE_DOUBLE:
+                dest[i] = *b.is_null
+                              ? Cell::Null(Cell::Type::kDouble)
+                              : Cell::Double(*static_cast<double *>(b.buffer));
                 break;
-            case (MYSQL_TYPE_STRING):
-                delete (char *)bind[i].buffer;
+            case MYSQL_TYPE_DATE:
+            case MYSQL_TYPE_DATETIME:
+            case MYSQL_TYPE_TIMESTAMP:
+            case MYSQL_TYPE_TIME:
+                if (*b.is_null) {
+                    dest[i] = Cell::Null(Cell::Type::kString);
+                } else {
+                    std::string_view text = bind.TimeText(i);
+                    dest[i] = Cell::String(text.data(), text.size());
+                }
                 break;
             default:
-                assert(false);
+                // the string points into the result bind arena, which the
+                // next fetch overwrites
+                dest[i] = *b.is_null
+                              ? Cell::Null(Cell::Type::kString)
+                              : Cell::String(static_cast<char *>(b.buffer),
+                                             *b.length);
+                break;
         }
     }
 }
 
+std::size_t SQLRows::ReadColumn(std::size_t idx, uint64_t offset, char *buf,
+                                std::size_t size) {
+    if (idx >= fields_size_) {
+        throw Exception(400, "sql: column index out of range");
+    }
+    return bind_->Read(stmt_, idx, offset, buf, size);
+}
+
+int64_t SQLRows::RowCount() {
+    if (!buffered_) {
+        return -1;
+    }
+    return (int64_t)mysql_stmt_num_rows(stmt_);
+}
+
+void SQLRows::Seek(uint64_t row) {
+    if (!buffered_) {
+        throw Exception(400, "sql: only buffered rows are seekable");
+    }
+    mysql_stmt_data_seek(stmt_, row);
+}
+
 SQLRows::~SQLRows() {
-    free_result_bind(bind_, fields_size_);
-    delete[] bind_;
+    // the statement may be executed again by the statement cache, drop
+    // whatever is left of this result set unless newer rows own it
+    if (*current_ == generation_) {
+        mysql_stmt_free_result(stmt_);
+    }
 }
 
-const std::vector<std::string> &SQLRows::Columns() const { return columns_; }
+const std::vector<std::string> &SQLRows::Columns() const {
+    return bind_->Columns();
+}
 
 MySQLStmt::MySQLStmt(MySQLConn *conn, const std::string &query)
     : conn_(conn),
       query_(query),
       stmt_(nullptr),
-      bind_(nullptr),
-      bind_size_(0) {
+      num_input_(0),
+      rows_generation_(0),
+      cursor_type_(CURSOR_TYPE_NO_CURSOR),
+      prefetch_rows_(1) {
     stmt_ = mysql_stmt_init(&conn_->mysql_);
     if (stmt_ == nullptr) {
         throw ExceptionFromMySQL(&conn_->mysql_);
     }
-    int ret = mysql_stmt_prepare(stmt_, query_.c_str(), -1);
+    int ret;
+    {
+        PhaseTimer timer(Phase(conn_->metrics_, &Metrics::prepare));
+        ret = mysql_stmt_prepare(stmt_, query_.c_str(), -1);
+    }
     if (ret != 0) {
-        throw ExceptionFromStmt(stmt_);
+        Exception e = ExceptionFromStmt(stmt_);
+        mysql_stmt_close(stmt_);
+        throw e;
     }
+    num_input_ = (std::size_t)mysql_stmt_param_count(stmt_);
+    params_.Reset(num_input_);
 }
 
-MySQLStmt::~MySQLStmt() {
-    mysql_stmt_close(stmt_);
-    if (bind_ != nullptr) {
-        for (std::size_t i = 0; i < bind_size_; i++) {
-            switch (bind_[i].buffer_type) {
-                case (MYSQL_TYPE_DATETIME):
-                    delete (MYSQL_TIME *)bind_[i].buffer;
-                    break;
-                default:;
-            }
-        }
-        delete[] bind_;
-    }
-}
-
-std::size_t MySQLStmt::NumInput() {
-    return (std::size_t)mysql_stmt_param_count(stmt_);
-}
-
-MYSQL_TIME *StdTmToMySQLTm(const std::tm &tm) {
-    MYSQL_TIME *mysql_tm = new MYSQL_TIME;
-    memset(mysql_tm, 0, sizeof(MYSQL_TIME));
-
-    mysql_tm->second = tm.tm_sec;
-    mysql_tm->minute = tm.tm_min;
-    mysql_tm->hour = tm.tm_hour;
-    mysql_tm->day = tm.tm_mday;
-    mysql_tm->month = tm.tm_mon + 1;
-    mysql_tm->year = tm.tm_year + 1900;
-    mysql_tm->time_type = MYSQL_TIMESTAMP_DATETIME;
-    return mysql_tm;
-}
-
-static void BindValue(const Value &value, MYSQL_BIND *bind) {
-    std::visit(
-        [&bind](auto &&arg) {
-            using T = std::decay_t<decltype(arg)>;
-            if constexpr (std::is_same_v<T, int64_t>) {
-                bind->buffer_type = MYSQL_TYPE_LONGLONG;
-                bind->buffer = (void *)&const_cast<int64_t &>(arg);
-                bind->buffer_length = sizeof(arg);
-            } else if constexpr (std::is_same_v<T, uint64_t>) {
-                bind->buffer_type = MYSQL_TYPE_DOUBLE;
-                bind->buffer = (void *)&const_cast<uint64_t &>(arg);
-                bind->buffer_length = sizeof(arg);
-                bind->is_unsigned = true;
-            } else if constexpr (std::is_same_v<T, double>) {
-                bind->buffer_type = MYSQL_TYPE_DOUBLE;
-                bind->buffer = (void *)&const_cast<double &>(arg);
-                bind->buffer_length = sizeof(arg);
-            } else if constexpr (std::is_same_v<T, std::string>) {
-                bind->buffer_type = MYSQL_TYPE_STRING;
-                bind->buffer = (void *)const_cast<std::string &>(arg).c_str();
-                bind->buffer_length = arg.size();
-            } else if constexpr (std::is_same_v<T, std::tm>) {
-                bind->buffer_type = MYSQL_TYPE_DATETIME;
-                bind->buffer = (void *)StdTmToMySQLTm(arg);
-                bind->buffer_length = sizeof(MYSQL_TIME);
-            } else if constexpr (std::is_same_v<T, NullInt64>) {
-                bind->buffer_type = MYSQL_TYPE_LONGLONG;
-                bind->is_null_value = (arg == nullptr);
-                bind->buffer = (void *)&const_cast<int64_t &>(*arg);
-                bind->buffer_length = sizeof(arg);
-            } else if constexpr (std::is_same_v<T, NullUInt64>) {
-                bind->buffer_type = MYSQL_TYPE_LONGLONG;
-                bind->is_null_value = (arg == nullptr);
-                bind->is_unsigned = true;
-                bind->buffer = (void *)&const_cast<uint64_t &>(*arg);
-                bind->buffer_length = sizeof(arg);
-            } else if constexpr (std::is_same_v<T, NullDouble>) {
-                bind->buffer_type = MYSQL_TYPE_DOUBLE;
-                bind->is_null_value = (arg == nullptr);
-                bind->buffer = (void *)&const_cast<double &>(*arg);
-                bind->buffer_length = sizeof(arg);
-            } else if constexpr (std::is_same_v<T, NullString>) {
-                bind->buffer_type = MYSQL_TYPE_STRING;
-                bind->is_null_value = (arg == nullptr);
-                bind->buffer = (void *)const_cast<std::string &>(*arg).c_str();
-                bind->buffer_length = (*arg).size();
-            } else if constexpr (std::is_same_v<T, NullTm>) {
-                bind->buffer_type = MYSQL_TYPE_DATETIME;
-                bind->is_null_value = (arg == nullptr);
-                bind->buffer = (void *)StdTmToMySQLTm(*arg);
-                bind->buffer_length = sizeof(MYSQL_TIME);
-            } else
-                static_assert(always_false_v<T>, "non-exhaustive visitor!");
-        },
-        value);
-}
-
-static void bind_args(const std::vector<Value> &args, MYSQL_BIND *bind) {
-    for (int i = 0; i < args.size(); i++) {
-        BindValue(args[i], &bind[i]);
+MySQLStmt::~MySQLStmt() { mysql_stmt_close(stmt_); }
+
+std::size_t MySQLStmt::NumInput() { return num_input_; }
+
+void MySQLStmt::BindValue(const std::vector<Value> &args) {
+    if (!params_.Bind(args)) {
+        return;
+    }
+    int ret = mysql_stmt_bind_param(stmt_, params_.data());
+    if (ret != 0) {
+        params_.Invalidate();
+        throw ExceptionFromStmt(stmt_);
     }
 }
 
-std::shared_ptr<driver::SQLResult> MySQLStmt::Exec(
-    const std::vector<Value> &args) {
-    assert(args.size() == NumInput());
-    if (args.size()) {
+void MySQLStmt::BindArgs(const std::vector<Value> &args) {
+    if (args.size() != num_input_) {
+        throw Exception(400, "sql: expected " + std::to_string(num_input_) +
+                                 " arguments, got " +
+                                 std::to_string(args.size()));
+    }
+    if (num_input_) {
         BindValue(args);
     }
+}
 
-    int ret = mysql_stmt_execute(stmt_);
+void MySQLStmt::Execute(const std::vector<Value> &args) {
+    BindArgs(args);
+    int ret;
+    {
+        PhaseTimer timer(Phase(conn_->metrics_, &Metrics::execute));
+        ret = mysql_stmt_execute(stmt_);
+    }
     if (ret != 0) {
         throw ExceptionFromStmt(stmt_);
     }
+}
+
+std::shared_ptr<driver::SQLResult> MySQLStmt::Exec(
+    const std::vector<Value> &args) {
+    Execute(args);
     int64_t last_insert_id = mysql_stmt_insert_id(stmt_);
     int64_t rows_affected = mysql_stmt_affected_rows(stmt_);
-    return std::make_shared<SQLResult>(last_insert_id, rows_affected);
+    if (exec_result_.use_count() == 1) {
+        exec_result_->Reset(last_insert_id, rows_affected);
+    } else {
+        exec_result_ = std::make_shared<SQLResult>(last_insert_id, rows_affected);
+    }
+    return exec_result_;
 }
 
-void MySQLStmt::BindValue(const std::vector<Value> &args) {
-    assert(args.size());
-    bind_ = new MYSQL_BIND[NumInput()];
-    memset(bind_, 0, sizeof(MYSQL_BIND) * NumInput());
-    bind_size_ = NumInput();
-
-    bind_args(args, bind_);
-    int ret = mysql_stmt_bind_param(stmt_, bind_);
+// room left in a bulk packet for the header, statement id, flags and
+// parameter types
+static const std::size_t kBulkPacketReserve = 1024;
+
+void MySQLStmt::ExecuteBulk(const std::vector<std::vector<Value>> &args,
+                            std::size_t begin, std::size_t end) {
+    bulk_.Bind(args, begin, end, num_input_);
+    // the bulk binds replace the ones of the parameter scratch
+    params_.Invalidate();
+
+    unsigned int array_size = end - begin;
+    mysql_stmt_attr_set(stmt_, STMT_ATTR_ARRAY_SIZE, &array_size);
+    int ret = mysql_stmt_bind_param(stmt_, bulk_.data());
+    if (ret == 0) {
+        PhaseTimer timer(Phase(conn_->metrics_, &Metrics::execute));
+        ret = mysql_stmt_execute(stmt_);
+    }
     if (ret != 0) {
-        throw ExceptionFromStmt(stmt_);
+        Exception e = ExceptionFromStmt(stmt_);
+        array_size = 0;
+        mysql_stmt_attr_set(stmt_, STMT_ATTR_ARRAY_SIZE, &array_size);
+        throw e;
+    }
+    array_size = 0;
+    mysql_stmt_attr_set(stmt_, STMT_ATTR_ARRAY_SIZE, &array_size);
+}
+
+std::shared_ptr<driver::SQLResult> MySQLStmt::ExecBatch(
+    const std::vector<std::vector<Value>> &args) {
+    for (const std::vector<Value> &row : args) {
+        if (row.size() != num_input_) {
+            throw Exception(400, "sql: expected " +
+                                     std::to_string(num_input_) +
+                                     " arguments, got " +
+                                     std::to_string(row.size()));
+        }
+    }
+    if (num_input_ == 0 || args.size() < 2 || !conn_->SupportsBulk()) {
+        return driver::Stmt::ExecBatch(args);
+    }
+
+    std::size_t max_size = conn_->MaxAllowedPacket() > 2 * kBulkPacketReserve
+                               ? conn_->MaxAllowedPacket() - kBulkPacketReserve
+                               : kBulkPacketReserve;
+    int64_t last_insert_id = 0;
+    int64_t rows_affected = 0;
+    std::size_t begin = 0;
+    while (begin < args.size()) {
+        // split the rows into chunks that fit into max_allowed_packet
+        std::size_t end = begin;
+        std::size_t size = 0;
+        while (end < args.size()) {
+            std::size_t row_size = BulkRowSize(args[end]);
+            if (end > begin && size + row_size > max_size) {
+                break;
+            }
+            size += row_size;
+            end++;
+        }
+        ExecuteBulk(args, begin, end);
+        if (begin == 0) {
+            last_insert_id = mysql_stmt_insert_id(stmt_);
+        }
+        rows_affected += mysql_stmt_affected_rows(stmt_);
+        begin = end;
+    }
+    return std::make_shared<SQLResult>(last_insert_id, rows_affected);
+}
+
+void MySQLStmt::SetCursor(ResultMode mode, unsigned long prefetch_rows) {
+    unsigned long cursor_type = mode == ResultMode::kCursor
+                                    ? CURSOR_TYPE_READ_ONLY
+                                    : CURSOR_TYPE_NO_CURSOR;
+    // attributes stick to the statement, only touch them on change
+    if (cursor_type != cursor_type_) {
+        if (mysql_stmt_attr_set(stmt_, STMT_ATTR_CURSOR_TYPE, &cursor_type)) {
+            throw ExceptionFromStmt(stmt_);
+        }
+        cursor_type_ = cursor_type;
+    }
+    if (mode == ResultMode::kCursor && prefetch_rows != prefetch_rows_) {
+        if (mysql_stmt_attr_set(stmt_, STMT_ATTR_PREFETCH_ROWS,
+                                &prefetch_rows)) {
+            throw ExceptionFromStmt(stmt_);
+        }
+        prefetch_rows_ = prefetch_rows;
     }
 }
 
 std::shared_ptr<driver::SQLRows> MySQLStmt::Query(
     const std::vector<Value> &args) {
-    assert(args.size() == NumInput());
-    if (args.size()) {
-        BindValue(args);
+    return QueryWith(args, QueryOptions());
+}
+
+std::shared_ptr<driver::SQLRows> MySQLStmt::QueryWith(
+    const std::vector<Value> &args, const QueryOptions &opts) {
+    ResultMode mode = opts.mode;
+    if (mode == ResultMode::kDefault) {
+        mode = conn_->cfg_.result_mode;
+    }
+    std::size_t prefetch_rows = opts.prefetch_rows;
+    if (prefetch_rows == 0) {
+        prefetch_rows = conn_->cfg_.prefetch_rows;
+    }
+    SetCursor(mode, prefetch_rows);
+    Execute(args);
+
+    bool buffered = mode == ResultMode::kBuffered;
+    std::shared_ptr<SQLRows> rows = std::make_shared<SQLRows>(
+        stmt_, &result_, &plan_, &rows_generation_, buffered, conn_->metrics_);
+    // the result binds have to be in place before the rows are stored
+    if (buffered) {
+        PhaseTimer timer(Phase(conn_->metrics_, &Metrics::fetch));
+        if (mysql_stmt_store_result(stmt_) != 0) {
+            throw ExceptionFromStmt(stmt_);
+        }
     }
+    return rows;
+}
 
-    int ret = mysql_stmt_execute(stmt_);
-    if (ret != 0) {
-        throw ExceptionFromStmt(stmt_);
+namespace {
+
+class ExecOp : public AsyncOp {
+   public:
+    ExecOp(MYSQL_STMT *stmt, ExecCallback cb)
+        : stmt_(stmt), cb_(std::move(cb)), ret_(0) {}
+    int Start() override { return mysql_stmt_execute_start(&ret_, stmt_); }
+    int Continue(int status) override {
+        return mysql_stmt_execute_cont(&ret_, stmt_, status);
+    }
+    void Complete() override {
+        if (ret_ != 0) {
+            cb_(nullptr, std::make_exception_ptr(ExceptionFromStmt(stmt_)));
+            return;
+        }
+        cb_(std::make_shared<SQLResult>(mysql_stmt_insert_id(stmt_),
+                                        mysql_stmt_affected_rows(stmt_)),
+            nullptr);
+    }
+
+   private:
+    MYSQL_STMT *stmt_;
+    ExecCallback cb_;
+    int ret_;
+};
+
+// QueryOp executes the statement and stores the whole result, so the rows
+// never touch the network once handed out.
+class QueryOp : public AsyncOp {
+   public:
+    QueryOp(MYSQL_STMT *stmt, ResultBind *bind, ScanPlan *plan,
+            uint64_t *generation, Metrics *metrics, QueryCallback cb)
+        : stmt_(stmt),
+          bind_(bind),
+          plan_(plan),
+          generation_(generation),
+          metrics_(metrics),
+          cb_(std::move(cb)),
+          ret_(0),
+          storing_(false) {}
+    int Start() override {
+        int wait = mysql_stmt_execute_start(&ret_, stmt_);
+        return wait != 0 ? wait : Store();
     }
+    int Continue(int status) override {
+        if (storing_) {
+            return mysql_stmt_store_result_cont(&ret_, stmt_, status);
+        }
+        int wait = mysql_stmt_execute_cont(&ret_, stmt_, status);
+        return wait != 0 ? wait : Store();
+    }
+    void Complete() override {
+        if (error_) {
+            cb_(nullptr, error_);
+            return;
+        }
+        if (ret_ != 0) {
+            std::exception_ptr error =
+                std::make_exception_ptr(ExceptionFromStmt(stmt_));
+            rows_.reset();
+            cb_(nullptr, error);
+            return;
+        }
+        cb_(std::move(rows_), nullptr);
+    }
+
+   private:
+    int Store() {
+        if (ret_ != 0) {
+            return 0;
+        }
+        try {
+            rows_ = std::make_shared<SQLRows>(stmt_, bind_, plan_,
+                                              generation_, true, metrics_);
+        } catch (...) {
+            error_ = std::current_exception();
+            return 0;
+        }
+        storing_ = true;
+        return mysql_stmt_store_result_start(&ret_, stmt_);
+    }
+    MYSQL_STMT *stmt_;
+    ResultBind *bind_;
+    ScanPlan *plan_;
+    uint64_t *generation_;
+    Metrics *metrics_;
+    QueryCallback cb_;
+    int ret_;
+    bool storing_;
+    std::shared_ptr<SQLRows> rows_;
+    std::exception_ptr error_;
+};
+
+}  // namespace
+
+void MySQLStmt::ExecAsync(const std::vector<Value> &args, ExecCallback cb) {
+    conn_->EnableNonblock();
+    BindArgs(args);
+    Reactor::For(&conn_->mysql_)
+        .Run(&conn_->mysql_, std::make_unique<ExecOp>(stmt_, std::move(cb)));
+}
 
-    return std::make_shared<SQLRows>(stmt_);
+void MySQLStmt::QueryAsync(const std::vector<Value> &args, QueryCallback cb) {
+    conn_->EnableNonblock();
+    // the result is stored, a server cursor would be pointless
+    SetCursor(ResultMode::kBuffered, prefetch_rows_);
+    BindArgs(args);
+    Reactor::For(&conn_->mysql_)
+        .Run(&conn_->mysql_,
+             std::make_unique<QueryOp>(stmt_, &result_, &plan_,
+                                       &rows_generation_, conn_->metrics_,
+                                       std::move(cb)));
 }
 
 }  // namespace mysql
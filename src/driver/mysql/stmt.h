@@ -2,26 +2,54 @@
 
 #include "sqlcc/driver/driver.h"
 
+#include "driver/mysql/bind.h"
 #include "driver/mysql/conn.h"
+#include "driver/mysql/reactor.h"
+#include "driver/mysql/scan.h"
 
 namespace sqlcc {
 namespace driver {
 namespace mysql {
 
+class SQLResult;
+
 class MySQLStmt : public driver::Stmt {
 public:
     MySQLStmt(MySQLConn* conn, const std::string& query);
     ~MySQLStmt();
     std::size_t NumInput() override;
+    // Exec reuses its last result once the caller released it, so repeated
+    // executions with the same argument types do not allocate
     std::shared_ptr<driver::SQLResult> Exec(const std::vector<Value>& args) override;
     std::shared_ptr<driver::SQLRows> Query(const std::vector<Value>& args) override;
+    std::shared_ptr<driver::SQLRows> QueryWith(const std::vector<Value>& args, const QueryOptions& opts) override;
+    std::shared_ptr<driver::SQLResult> ExecBatch(const std::vector<std::vector<Value>>& args) override;
+    // ExecAsync and QueryAsync run on the reactor of the connection, the
+    // rows of QueryAsync are buffered.
+    void ExecAsync(const std::vector<Value>& args, ExecCallback cb) override;
+    void QueryAsync(const std::vector<Value>& args, QueryCallback cb) override;
+    // Execute binds args and executes the statement, it does not allocate
+    // once the statement has been executed with the same argument types.
+    void Execute(const std::vector<Value>& args);
 private:
     void BindValue(const std::vector<Value>& args);
+    void BindArgs(const std::vector<Value>& args);
+    void SetCursor(ResultMode mode, unsigned long prefetch_rows);
+    void ExecuteBulk(const std::vector<std::vector<Value>>& args, std::size_t begin, std::size_t end);
     MySQLConn* conn_;
     std::string query_;
     MYSQL_STMT* stmt_;
-    MYSQL_BIND* bind_;
-    std::size_t bind_size_;
+    std::size_t num_input_;
+    ParamBind params_;
+    BulkBind bulk_;
+    // shared by the rows of every execution, only one can be active
+    ResultBind result_;
+    ScanPlan plan_;
+    // counts the rows handed out, only the current ones free the result
+    uint64_t rows_generation_;
+    std::shared_ptr<SQLResult> exec_result_;
+    unsigned long cursor_type_;
+    unsigned long prefetch_rows_;
 };
 
 } // namespace mysql
@@ -0,0 +1,43 @@
+#include "driver/mysql/tx.h"
+
+#include "driver/mysql/exception.h"
+
+#include <cstring>
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+static const char kStartTransaction[] = "START TRANSACTION";
+
+MySQLTx::MySQLTx(MySQLConn* conn) : conn_(conn), done_(false) {
+    if (mysql_real_query(&conn_->mysql_, kStartTransaction,
+                         std::strlen(kStartTransaction)) != 0) {
+        throw ExceptionFromMySQL(&conn_->mysql_);
+    }
+}
+
+void MySQLTx::CheckDone() {
+    if (done_) {
+        throw Exception(400, "sql: transaction has already been committed or rolled back");
+    }
+    done_ = true;
+}
+
+void MySQLTx::Commit() {
+    CheckDone();
+    if (mysql_commit(&conn_->mysql_) != 0) {
+        throw ExceptionFromMySQL(&conn_->mysql_);
+    }
+}
+
+void MySQLTx::Rollback() {
+    CheckDone();
+    if (mysql_rollback(&conn_->mysql_) != 0) {
+        throw ExceptionFromMySQL(&conn_->mysql_);
+    }
+}
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
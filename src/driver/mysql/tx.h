@@ -0,0 +1,26 @@
+#pragma once
+
+#include "sqlcc/driver/driver.h"
+
+#include "driver/mysql/conn.h"
+
+namespace sqlcc {
+namespace driver {
+namespace mysql {
+
+class MySQLTx : public driver::Tx {
+public:
+    // MySQLTx starts a transaction on conn, statements prepared on conn
+    // run in it until Commit or Rollback.
+    MySQLTx(MySQLConn* conn);
+    void Commit() override;
+    void Rollback() override;
+private:
+    void CheckDone();
+    MySQLConn* conn_;
+    bool done_;
+};
+
+} // namespace mysql
+} // namespace driver
+} // namespace sqlcc
@@ -0,0 +1,131 @@
+#include "sqlcc/group_commit.h"
+
+namespace sqlcc {
+
+GroupCommitter::GroupCommitter(DB db, GroupCommitOptions opts)
+    : db_(db), opts_(opts), stop_(false) {
+    if (opts_.max_batch == 0) {
+        opts_.max_batch = 1;
+    }
+    thread_ = std::thread(&GroupCommitter::Loop, this);
+}
+
+GroupCommitter::~GroupCommitter() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+std::future<void> GroupCommitter::Submit(Unit unit) {
+    std::unique_lock<std::mutex> lock(mu_);
+    if (stop_) {
+        throw Exception(500, "sqlcc: group committer is closed");
+    }
+    queue_.push_back(Pending{std::move(unit), std::promise<void>()});
+    std::future<void> future = queue_.back().done.get_future();
+    // wake the committer to open a batch, or because one is full
+    if (queue_.size() == 1 || queue_.size() >= opts_.max_batch) {
+        cv_.notify_one();
+    }
+    return future;
+}
+
+void GroupCommitter::Loop() {
+    std::vector<Pending> batch;
+    std::unique_lock<std::mutex> lock(mu_);
+    for (;;) {
+        cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        // the window opens with the first unit
+        cv_.wait_for(lock, opts_.max_delay, [this] {
+            return stop_ || queue_.size() >= opts_.max_batch;
+        });
+        while (!queue_.empty() && batch.size() < opts_.max_batch) {
+            batch.push_back(std::move(queue_.front()));
+            queue_.pop_front();
+        }
+        lock.unlock();
+        Commit(batch);
+        batch.clear();
+        lock.lock();
+    }
+}
+
+void GroupCommitter::CommitAlone(Pending& p) {
+    try {
+        Tx tx = db_->Begin();
+        p.unit(*tx);
+        tx->Commit();
+    } catch (...) {
+        p.done.set_exception(std::current_exception());
+        return;
+    }
+    p.done.set_value();
+}
+
+void GroupCommitter::Fail(std::vector<Pending>& batch,
+                          std::exception_ptr error) {
+    for (Pending& p : batch) {
+        p.done.set_exception(error);
+    }
+}
+
+void GroupCommitter::Commit(std::vector<Pending>& batch) {
+    if (batch.size() == 1) {
+        CommitAlone(batch[0]);
+        return;
+    }
+    Tx tx;
+    try {
+        tx = db_->Begin();
+    } catch (...) {
+        Fail(batch, std::current_exception());
+        return;
+    }
+    std::size_t failed = batch.size();
+    std::exception_ptr error;
+    for (std::size_t i = 0; i < batch.size(); i++) {
+        try {
+            batch[i].unit(*tx);
+        } catch (...) {
+            failed = i;
+            error = std::current_exception();
+            break;
+        }
+    }
+    if (failed == batch.size()) {
+        try {
+            tx->Commit();
+        } catch (...) {
+            // the batch may or may not be committed, running it again is
+            // not safe
+            Fail(batch, std::current_exception());
+            return;
+        }
+        for (Pending& p : batch) {
+            p.done.set_value();
+        }
+        return;
+    }
+
+    try {
+        tx->Rollback();
+    } catch (...) {
+        // the server drops the transaction with the connection
+    }
+    tx.reset();
+    for (std::size_t i = 0; i < batch.size(); i++) {
+        if (i == failed) {
+            batch[i].done.set_exception(error);
+        } else {
+            CommitAlone(batch[i]);
+        }
+    }
+}
+
+}  // namespace sqlcc
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <sqlcc/sqlcc.h>
+
+#include <algorithm>
+#include <cstring>
+#include <streambuf>
+#include <vector>
+
+namespace sqlcc {
+
+// ColumnReader is a streambuf reading column idx of the current row in
+// chunks with SQLRows::ReadColumn, so a large value can be piped somewhere
+// else with bounded memory:
+//
+//     ColumnReader reader(rows, 1);
+//     std::istream in(&reader);
+//     out << in.rdbuf();
+//
+// It reads the row current at the time, call Reset after Next to read the
+// column of the next row.
+class ColumnReader : public std::streambuf {
+   public:
+    ColumnReader(Rows rows, std::size_t idx, std::size_t chunk_size = 64 << 10)
+        : rows_(std::move(rows)), idx_(idx), offset_(0), buf_(chunk_size) {}
+
+    void Reset() {
+        offset_ = 0;
+        setg(nullptr, nullptr, nullptr);
+    }
+
+   protected:
+    int_type underflow() override {
+        if (gptr() == egptr()) {
+            std::size_t n =
+                rows_->ReadColumn(idx_, offset_, buf_.data(), buf_.size());
+            if (n == 0) {
+                return traits_type::eof();
+            }
+            offset_ += n;
+            setg(buf_.data(), buf_.data(), buf_.data() + n);
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+    // large reads skip the chunk buffer
+    std::streamsize xsgetn(char* s, std::streamsize count) override {
+        std::streamsize done = std::min<std::streamsize>(count, egptr() - gptr());
+        memcpy(s, gptr(), done);
+        gbump(static_cast<int>(done));
+        while (done < count) {
+            if (count - done < static_cast<std::streamsize>(buf_.size())) {
+                if (underflow() == traits_type::eof()) {
+                    break;
+                }
+                std::streamsize n =
+                    std::min<std::streamsize>(count - done, egptr() - gptr());
+                memcpy(s + done, gptr(), n);
+                gbump(static_cast<int>(n));
+                done += n;
+                continue;
+            }
+            std::size_t n =
+                rows_->ReadColumn(idx_, offset_, s + done, count - done);
+            if (n == 0) {
+                break;
+            }
+            offset_ += n;
+            done += n;
+        }
+        return done;
+    }
+
+   private:
+    Rows rows_;
+    std::size_t idx_;
+    uint64_t offset_;
+    std::vector<char> buf_;
+};
+
+}  // namespace sqlcc
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sqlcc {
+namespace driver {
+
+// Column holds the values of one column of a Batch. Integers and doubles
+// are stored in contiguous arrays, strings as offsets into a single byte
+// buffer with value i spanning [offsets[i], offsets[i + 1]). A value is
+// valid (not null) when bit i of validity is set, null values keep a zero
+// or empty slot so the arrays stay dense.
+class Column {
+   public:
+    enum class Type : uint8_t { kInt64, kDouble, kString };
+
+    Type type = Type::kString;
+    std::string name;
+    std::size_t size = 0;
+    std::vector<int64_t> ints;
+    std::vector<double> doubles;
+    std::vector<uint64_t> offsets;
+    std::string bytes;
+    std::vector<uint64_t> validity;
+
+    bool IsValid(std::size_t i) const {
+        return (validity[i >> 6] >> (i & 63)) & 1;
+    }
+    std::string_view String(std::size_t i) const {
+        return std::string_view(bytes.data() + offsets[i],
+                                offsets[i + 1] - offsets[i]);
+    }
+
+    // Reset empties the column, keeping the memory for capacity rows.
+    void Reset(Type t, std::size_t capacity) {
+        type = t;
+        size = 0;
+        ints.clear();
+        doubles.clear();
+        offsets.clear();
+        bytes.clear();
+        validity.assign((capacity + 63) >> 6, 0);
+        switch (type) {
+            case Type::kInt64:
+                ints.reserve(capacity);
+                break;
+            case Type::kDouble:
+                doubles.reserve(capacity);
+                break;
+            case Type::kString:
+                offsets.reserve(capacity + 1);
+                offsets.push_back(0);
+                break;
+        }
+    }
+    void AppendInt64(int64_t v, bool valid) {
+        ints.push_back(valid ? v : 0);
+        SetValid(valid);
+    }
+    void AppendDouble(double v, bool valid) {
+        doubles.push_back(valid ? v : 0);
+        SetValid(valid);
+    }
+    void AppendString(const char *data, std::size_t len, bool valid) {
+        if (valid) bytes.append(data, len);
+        offsets.push_back(bytes.size());
+        SetValid(valid);
+    }
+
+   private:
+    void SetValid(bool valid) {
+        if ((size >> 6) >= validity.size()) validity.push_back(0);
+        validity[size >> 6] |= uint64_t(valid) << (size & 63);
+        size++;
+    }
+};
+
+// Batch is a column oriented chunk of rows returned by SQLRows::NextBatch.
+class Batch {
+   public:
+    std::size_t rows = 0;
+    std::vector<Column> columns;
+};
+
+}  // namespace driver
+}  // namespace sqlcc
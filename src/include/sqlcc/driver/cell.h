@@ -0,0 +1,111 @@
+#pragma once
+
+#include <sqlcc/exception.h>
+
+#include <cstdint>
+#include <string_view>
+
+namespace sqlcc {
+namespace driver {
+
+// Cell is a compact read only column value of the current row, 16 bytes
+// against the 72 of a Value. Strings are borrowed from the row buffer of
+// the driver and stay valid until the next call to Next. A null cell keeps
+// the type of its column.
+class Cell {
+   public:
+    enum class Type : uint8_t { kInt64, kUInt64, kDouble, kString };
+
+    Cell() : i_(0), size_(0), type_(Type::kString), null_(true) {}
+
+    static Cell Null(Type type) {
+        Cell c;
+        c.type_ = type;
+        return c;
+    }
+    static Cell Int64(int64_t v) {
+        Cell c(Type::kInt64);
+        c.i_ = v;
+        return c;
+    }
+    static Cell UInt64(uint64_t v) {
+        Cell c(Type::kUInt64);
+        c.u_ = v;
+        return c;
+    }
+    static Cell Double(double v) {
+        Cell c(Type::kDouble);
+        c.d_ = v;
+        return c;
+    }
+    // String borrows data, the caller keeps it alive
+    static Cell String(const char *data, std::size_t size) {
+        Cell c(Type::kString);
+        c.p_ = data;
+        c.size_ = static_cast<uint32_t>(size);
+        return c;
+    }
+
+    Type type() const { return type_; }
+    bool IsNull() const { return null_; }
+
+    // the accessors throw on null and on a type they can't convert from
+    // without loss
+    int64_t AsInt64() const {
+        Check(type_ == Type::kInt64 || type_ == Type::kUInt64);
+        if (type_ == Type::kUInt64 && u_ > uint64_t(INT64_MAX)) {
+            throw Exception(400,
+                            "sql driver: cell value out of range of int64_t");
+        }
+        return i_;
+    }
+    uint64_t AsUInt64() const {
+        Check(type_ == Type::kInt64 || type_ == Type::kUInt64);
+        if (type_ == Type::kInt64 && i_ < 0) {
+            throw Exception(400,
+                            "sql driver: cell value out of range of uint64_t");
+        }
+        return u_;
+    }
+    double AsDouble() const {
+        Check(type_ != Type::kString);
+        switch (type_) {
+            case Type::kInt64:
+                return double(i_);
+            case Type::kUInt64:
+                return double(u_);
+            default:
+                return d_;
+        }
+    }
+    std::string_view AsString() const {
+        Check(type_ == Type::kString);
+        return std::string_view(p_, size_);
+    }
+
+   private:
+    explicit Cell(Type type) : i_(0), size_(0), type_(type), null_(false) {}
+    void Check(bool ok) const {
+        if (null_) {
+            throw Exception(400, "sql driver: cell is null");
+        }
+        if (!ok) {
+            throw Exception(400, "sql driver: cell type mismatch");
+        }
+    }
+
+    union {
+        int64_t i_;
+        uint64_t u_;
+        double d_;
+        const char *p_;
+    };
+    uint32_t size_;
+    Type type_;
+    bool null_;
+};
+
+static_assert(sizeof(Cell) == 16, "Cell must stay 16 bytes");
+
+}  // namespace driver
+}  // namespace sqlcc
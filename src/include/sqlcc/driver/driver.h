@@ -1,12 +1,37 @@
 #pragma once
 
+#include <sqlcc/driver/batch.h>
+#include <sqlcc/driver/cell.h>
+#include <sqlcc/driver/metrics.h>
+
+#include <chrono>
 #include <ctime>
+#include <exception>
+#include <functional>
 #include <iomanip>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
+// time points print as UTC, declared ahead of NullValue so that it finds
+// it for NullTimePoint
+inline std::ostream &operator<<(
+    std::ostream &os,
+    const std::chrono::time_point<std::chrono::system_clock,
+                                  std::chrono::microseconds> &tp) {
+    auto seconds = std::chrono::floor<std::chrono::seconds>(tp);
+    std::time_t t = seconds.time_since_epoch().count();
+    std::tm tm;
+    gmtime_r(&t, &tm);
+    auto us =
+        std::chrono::duration_cast<std::chrono::microseconds>(tp - seconds);
+    os << std::put_time(&tm, "%FT%T") << '.' << std::setw(6)
+       << std::setfill('0') << us.count() << std::setfill(' ') << 'Z';
+    return os;
+}
+
 namespace sqlcc {
 namespace driver {
 
@@ -54,7 +79,102 @@ using NullDouble = NullValue<double>;
 using NullString = NullValue<std::string>;
 using NullTm = NullValue<std::tm>;
 
-using Value = std::variant<int64_t, uint64_t, double, std::string, std::tm, NullInt64, NullUInt64, NullDouble, NullString, NullTm>;
+// TimePoint is the point in time of a DATETIME or TIMESTAMP value, taken as
+// UTC. It counts microseconds like the columns do, the sys_time<microseconds>
+// of C++20, which also keeps years 1000 to 9999 in range. Bind a
+// system_clock::now() through std::chrono::floor<std::chrono::microseconds>.
+using TimePoint = std::chrono::time_point<std::chrono::system_clock,
+                                          std::chrono::microseconds>;
+using NullTimePoint = NullValue<TimePoint>;
+
+using Value = std::variant<int64_t, uint64_t, double, std::string, std::tm, TimePoint, NullInt64, NullUInt64, NullDouble, NullString, NullTm, NullTimePoint>;
+
+// ScanType describes the variable a typed scan writes a column into.
+enum class ScanType : uint8_t {
+    kBool,
+    kInt8,
+    kInt16,
+    kInt32,
+    kInt64,
+    kUInt8,
+    kUInt16,
+    kUInt32,
+    kUInt64,
+    kFloat,
+    kDouble,
+    kString,
+    kTm,
+    kTimePoint,
+    kNullInt64,
+    kNullUInt64,
+    kNullDouble,
+    kNullString,
+    kNullTm,
+    kNullTimePoint,
+};
+
+template <typename T>
+constexpr ScanType ScanTypeOf() {
+    if constexpr (std::is_same_v<T, bool>) {
+        return ScanType::kBool;
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        static_assert(sizeof(T) <= 8, "unsupported integer size");
+        return sizeof(T) == 1   ? ScanType::kInt8
+               : sizeof(T) == 2 ? ScanType::kInt16
+               : sizeof(T) == 4 ? ScanType::kInt32
+                                : ScanType::kInt64;
+    } else if constexpr (std::is_integral_v<T>) {
+        static_assert(sizeof(T) <= 8, "unsupported integer size");
+        return sizeof(T) == 1   ? ScanType::kUInt8
+               : sizeof(T) == 2 ? ScanType::kUInt16
+               : sizeof(T) == 4 ? ScanType::kUInt32
+                                : ScanType::kUInt64;
+    } else if constexpr (std::is_same_v<T, float>) {
+        return ScanType::kFloat;
+    } else if constexpr (std::is_same_v<T, double>) {
+        return ScanType::kDouble;
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return ScanType::kString;
+    } else if constexpr (std::is_same_v<T, std::tm>) {
+        return ScanType::kTm;
+    } else if constexpr (std::is_same_v<T, TimePoint>) {
+        return ScanType::kTimePoint;
+    } else if constexpr (std::is_same_v<T, NullInt64>) {
+        return ScanType::kNullInt64;
+    } else if constexpr (std::is_same_v<T, NullUInt64>) {
+        return ScanType::kNullUInt64;
+    } else if constexpr (std::is_same_v<T, NullDouble>) {
+        return ScanType::kNullDouble;
+    } else if constexpr (std::is_same_v<T, NullString>) {
+        return ScanType::kNullString;
+    } else if constexpr (std::is_same_v<T, NullTm>) {
+        return ScanType::kNullTm;
+    } else if constexpr (std::is_same_v<T, NullTimePoint>) {
+        return ScanType::kNullTimePoint;
+    } else {
+        static_assert(always_false_v<T>, "unsupported scan type");
+    }
+}
+
+// ResultMode selects how the rows of a query are fetched.
+enum class ResultMode : uint8_t {
+    // driver or DSN default
+    kDefault,
+    // rows are read from the connection while iterating
+    kStream,
+    // the whole result is read into client memory by Query, the row count
+    // is known up front and rows can be seeked. The connection goes back to
+    // the pool once the result is read.
+    kBuffered,
+    // read only server side cursor, fetching prefetch_rows per round trip
+    kCursor,
+};
+
+struct QueryOptions {
+    ResultMode mode = ResultMode::kDefault;
+    // rows fetched per round trip in kCursor mode, 0 uses the default
+    std::size_t prefetch_rows = 0;
+};
 
 class SQLResult {
    public:
@@ -69,37 +189,151 @@ class SQLRows {
     virtual const std::vector<std::string> &Columns() const = 0;
     virtual bool Next() = 0;
     virtual void Scan(std::vector<Value> &dest) = 0;
+    // ScanTyped writes the current row straight into dest[i], which points
+    // to a variable of types[i]. types is a static array of the caller, so
+    // drivers may use its address to reuse a conversion plan across rows.
+    // The default implementation goes through Scan.
+    virtual void ScanTyped(const ScanType *types, void *const *dest,
+                           std::size_t size);
+    // NextBatch fetches up to n rows into batch, reusing its memory, and
+    // returns the number of rows fetched, 0 once the rows are exhausted.
+    // The default implementation throws, drivers opt in.
+    virtual std::size_t NextBatch(Batch &batch, std::size_t n);
+    // ScanCells points dest[i] at column i of the current row without
+    // copying, size is the number of columns. The default implementation
+    // throws, drivers opt in.
+    virtual void ScanCells(Cell *dest, std::size_t size);
+    // ReadColumn copies up to size bytes of column idx of the current row,
+    // starting at offset, into buf and returns the number of bytes copied,
+    // 0 past the end and for null. Drivers read large values in chunks
+    // instead of buffering them whole. The default implementation throws.
+    virtual std::size_t ReadColumn(std::size_t idx, uint64_t offset, char *buf,
+                                   std::size_t size);
+    // RowCount returns the number of rows of a buffered result, -1 when it
+    // is not known.
+    virtual int64_t RowCount() { return -1; }
+    // Seek moves a buffered result to row, the next call to Next fetches it.
+    virtual void Seek(uint64_t row);
 };
 
+// completion callbacks of async calls, exactly one of the arguments is set
+using ExecCallback =
+    std::function<void(std::shared_ptr<SQLResult>, std::exception_ptr)>;
+using QueryCallback =
+    std::function<void(std::shared_ptr<SQLRows>, std::exception_ptr)>;
+
 class Stmt {
    public:
     virtual ~Stmt(){};
     virtual std::size_t NumInput() = 0;
     virtual std::shared_ptr<SQLResult> Exec(const std::vector<Value> &args) = 0;
     virtual std::shared_ptr<SQLRows> Query(const std::vector<Value> &args) = 0;
+    // QueryWith is Query with a result mode, the default implementation
+    // ignores opts.
+    virtual std::shared_ptr<SQLRows> QueryWith(const std::vector<Value> &args,
+                                               const QueryOptions &opts) {
+        return Query(args);
+    }
+    // ExecBatch executes the statement once per row of args, drivers may
+    // send all rows in bulk. RowsAffected is the sum over all rows and
+    // LastInsertID the one of the first row. The default implementation
+    // calls Exec for every row.
+    virtual std::shared_ptr<SQLResult> ExecBatch(
+        const std::vector<std::vector<Value>> &args);
+    // ExecAsync and QueryAsync run the statement without blocking the
+    // caller and call cb once done, possibly on another thread. args are
+    // only used during the call. The statement must not be used until cb
+    // is called. The default implementations run synchronously.
+    virtual void ExecAsync(const std::vector<Value> &args, ExecCallback cb);
+    virtual void QueryAsync(const std::vector<Value> &args, QueryCallback cb);
+};
+
+// Pipeline sends several statements in a single round trip and reads their
+// results back in order.
+class Pipeline {
+   public:
+    virtual ~Pipeline() {}
+    // Add queues query, args are bound right away so they may be released
+    // after the call.
+    virtual void Add(const std::string &query,
+                     const std::vector<Value> &args) = 0;
+    // Send writes the queued statements at once. Adding after a send starts
+    // a new batch, discarding the results not read yet.
+    virtual void Send() = 0;
+    // Next advances to the result of the next statement, it returns false
+    // after the last one. It throws the error of a failed statement, the
+    // statements after it are not executed.
+    virtual bool Next() = 0;
+    // CurrentRows is nullptr for statements without a result set,
+    // CurrentResult for those with one.
+    virtual std::shared_ptr<SQLResult> CurrentResult() = 0;
+    virtual std::shared_ptr<SQLRows> CurrentRows() = 0;
 };
 
 class Tx {
    public:
+    virtual ~Tx() {}
     virtual void Commit() = 0;
     virtual void Rollback() = 0;
 };
 
 class Conn {
    public:
+    virtual ~Conn() {}
     virtual std::shared_ptr<Stmt> Prepare(const std::string &query) = 0;
     virtual std::shared_ptr<Tx> Begin() = 0;
+    // EnterThread prepares the calling thread for the connection, the pool
+    // calls it on every hand out so it must be cheap once done. LeaveThread
+    // undoes it before the thread exits, drivers may do so at exit on
+    // their own.
     virtual void EnterThread() = 0;
     virtual void LeaveThread() = 0;
+    // NewPipeline returns a pipeline on this connection, the connection must
+    // not be used otherwise until its results are read. The default
+    // implementation throws, drivers opt in.
+    virtual std::shared_ptr<Pipeline> NewPipeline();
+    // SetMetrics makes the connection record its statement phases into
+    // metrics, which outlives the connection; nullptr stops recording. The
+    // default implementation records nothing.
+    virtual void SetMetrics(Metrics *metrics) {}
+    // Ping checks the connection with a round trip to the server, throwing
+    // when it is broken. The default implementation does nothing.
+    virtual void Ping() {}
+    // IsValid tells without a round trip whether the connection can be
+    // reused, the pool closes it otherwise. The default implementation
+    // returns true.
+    virtual bool IsValid() { return true; }
+};
+
+class Driver;
+
+// Connector opens connections with a configuration parsed once up front,
+// like driver.Connector of golang database/sql.
+class Connector {
+   public:
+    virtual ~Connector() = default;
+    virtual std::shared_ptr<Conn> Connect() = 0;
+    virtual std::shared_ptr<driver::Driver> Driver() = 0;
 };
 
-class Driver {
+class Driver : public std::enable_shared_from_this<Driver> {
    public:
     Driver() = default;
     virtual ~Driver() = default;
     virtual std::shared_ptr<Conn> Open(const std::string &name) = 0;
+    // OpenConnector returns a connector for name, drivers override it to
+    // parse name once and reject a malformed one right away. The default
+    // implementation calls Open(name) on every Connect.
+    virtual std::shared_ptr<Connector> OpenConnector(const std::string &name);
+
+   protected:
+    // Self returns the driver for its connectors to hold. A driver not
+    // owned by a shared_ptr gets a non-owning one and has to outlive them.
+    std::shared_ptr<Driver> Self();
 };
 
+// The driver registry is safe to use from any thread, GetDriver reads a
+// snapshot that RegisterDriver and UnregisterDriver replace.
 void RegisterDriver(const std::string &name, std::shared_ptr<Driver> driver);
 
 bool UnregisterDriver(const std::string &name);
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace sqlcc {
+namespace driver {
+
+// Counter is a monotonic counter, safe to add to from any thread.
+class Counter {
+   public:
+    void Add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+   private:
+    std::atomic<uint64_t> value_{0};
+};
+
+// HistogramSnapshot is a copy of a Histogram. Bucket i counts the
+// observations in (UpperBound(i - 1), UpperBound(i)], the last bucket
+// everything above the largest bound.
+struct HistogramSnapshot {
+    // bucket i ends at 128ns << i, the last finite one at about 4.3s
+    static const std::size_t kBuckets = 26;
+    std::array<uint64_t, kBuckets + 1> counts{};
+    uint64_t count = 0;
+    std::chrono::nanoseconds sum{0};
+
+    static std::chrono::nanoseconds UpperBound(std::size_t i) {
+        return std::chrono::nanoseconds(int64_t(128) << i);
+    }
+    // Quantile returns the upper bound of the bucket holding quantile q,
+    // an upper estimate within a factor of two. It is zero without
+    // observations and the largest bound for the overflow bucket.
+    std::chrono::nanoseconds Quantile(double q) const {
+        if (count == 0) {
+            return std::chrono::nanoseconds::zero();
+        }
+        uint64_t rank = uint64_t(q * (count - 1)) + 1;
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < kBuckets; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return UpperBound(i);
+            }
+        }
+        return UpperBound(kBuckets - 1);
+    }
+};
+
+// Histogram counts durations into power of two buckets. Observe is two
+// relaxed atomic adds, so it can sit on the hot path of every statement.
+class Histogram {
+   public:
+    void Observe(std::chrono::nanoseconds d) {
+        uint64_t ns = d.count() > 0 ? uint64_t(d.count()) : 0;
+        counts_[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    }
+    // Snapshot copies the histogram, sum and count may disagree by the
+    // observations made while it runs.
+    HistogramSnapshot Snapshot() const {
+        HistogramSnapshot s;
+        for (std::size_t i = 0; i < s.counts.size(); i++) {
+            s.counts[i] = counts_[i].load(std::memory_order_relaxed);
+            s.count += s.counts[i];
+        }
+        s.sum = std::chrono::nanoseconds(
+            int64_t(sum_ns_.load(std::memory_order_relaxed)));
+        return s;
+    }
+
+   private:
+    static std::size_t Bucket(uint64_t ns) {
+        if (ns <= 128) {
+            return 0;
+        }
+        std::size_t i = 64 - __builtin_clzll(ns - 1) - 7;
+        return i < HistogramSnapshot::kBuckets ? i : HistogramSnapshot::kBuckets;
+    }
+
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::kBuckets + 1>
+        counts_{};
+    std::atomic<uint64_t> sum_ns_{0};
+};
+
+// Metrics is recorded into by the pool and, once handed to a connection
+// with Conn::SetMetrics, by the driver.
+struct Metrics {
+    Counter conn_opens;
+    Counter conn_closes;
+    // time callers were blocked waiting for a free connection
+    Histogram pool_wait;
+    // driver phases of a statement
+    Histogram prepare;
+    Histogram execute;
+    Histogram fetch;
+    Histogram decode;
+    // result payload read by fetch, without protocol overhead
+    Counter bytes_received;
+};
+
+// PhaseTimer observes the time from its construction to its destruction
+// into h, it does nothing when h is nullptr.
+class PhaseTimer {
+   public:
+    explicit PhaseTimer(Histogram *h)
+        : h_(h),
+          start_(h ? std::chrono::steady_clock::now()
+                   : std::chrono::steady_clock::time_point()) {}
+    ~PhaseTimer() {
+        if (h_) {
+            h_->Observe(std::chrono::steady_clock::now() - start_);
+        }
+    }
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+   private:
+    Histogram *h_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace driver
+}  // namespace sqlcc
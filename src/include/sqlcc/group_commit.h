@@ -0,0 +1,61 @@
+#pragma once
+
+#include <sqlcc/sqlcc.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sqlcc {
+
+struct GroupCommitOptions {
+    // most units committed by one transaction
+    std::size_t max_batch = 64;
+    // how long the first unit of a batch waits for others to join
+    std::chrono::microseconds max_delay{1000};
+};
+
+// GroupCommitter runs small write units submitted by many threads in
+// shared transactions, one per batch, so they share a single commit.
+//
+// A unit that throws fails alone: its batch is rolled back and the other
+// units are run again, each in a transaction of its own. Units may thus run
+// more than once and must not have side effects outside the transaction.
+class GroupCommitter {
+   public:
+    using Unit = std::function<void(Transaction&)>;
+    GroupCommitter(DB db, GroupCommitOptions opts = GroupCommitOptions());
+    // commits what is queued and stops
+    ~GroupCommitter();
+    GroupCommitter(const GroupCommitter&) = delete;
+    GroupCommitter& operator=(const GroupCommitter&) = delete;
+    // Submit queues unit, the future is ready once its transaction is
+    // committed and holds the exception of the unit or the transaction. A
+    // failed commit fails every unit of the batch, they are not retried.
+    std::future<void> Submit(Unit unit);
+
+   private:
+    struct Pending {
+        Unit unit;
+        std::promise<void> done;
+    };
+    void Loop();
+    void Commit(std::vector<Pending>& batch);
+    void CommitAlone(Pending& p);
+    void Fail(std::vector<Pending>& batch, std::exception_ptr error);
+
+    DB db_;
+    GroupCommitOptions opts_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<Pending> queue_;
+    bool stop_;
+    std::thread thread_;
+};
+
+}  // namespace sqlcc
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <sqlcc/driver/driver.h>
+
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sqlcc {
+
+enum class Op : uint8_t {
+    kPrepare,
+    kExec,
+    kExecMany,
+    kQuery,
+    // the iteration of the rows of a query ended, by exhaustion, Close or
+    // an error. Only After is called for it, elapsed runs from the start of
+    // the query.
+    kRows,
+};
+
+// Event describes a call seen by interceptors. It only lives for the
+// duration of the hook, copy what has to be kept.
+struct Event {
+    Event(Op op, const std::string& query,
+          const std::vector<driver::Value>& args)
+        : op(op), query(query), args(args) {}
+
+    Op op;
+    const std::string& query;
+    // the bound arguments of kExec and kQuery, empty otherwise
+    const std::vector<driver::Value>& args;
+    std::chrono::steady_clock::time_point start;
+    // the fields below are set for After
+    std::chrono::nanoseconds elapsed{0};
+    // rows affected for kExec and kExecMany, rows read for kRows, else -1
+    int64_t rows = -1;
+    std::exception_ptr error;
+};
+
+// Interceptor observes the calls of a Database. Before hooks run in the
+// order the interceptors were added, After hooks in reverse order. An
+// exception thrown by Before fails the call before it reaches the driver,
+// hooks should not throw otherwise.
+class Interceptor {
+   public:
+    virtual ~Interceptor() {}
+    virtual void Before(const Event& e) {}
+    // After sees the elapsed time and the error of the call. For kQuery it
+    // covers the driver call only, the kRows event covers the iteration.
+    virtual void After(const Event& e) {}
+};
+
+using InterceptorChain = std::vector<std::shared_ptr<Interceptor>>;
+
+}  // namespace sqlcc
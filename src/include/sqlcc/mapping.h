@@ -0,0 +1,127 @@
+#pragma once
+
+#include <sqlcc/driver/driver.h>
+#include <sqlcc/exception.h>
+
+#include <strings.h>
+
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace sqlcc {
+
+// Field maps the column name to member of T
+template <typename T, typename M>
+struct Field {
+    using Type = M;
+    const char* name;
+    M T::*member;
+};
+
+template <typename T, typename M>
+constexpr Field<T, M> MapField(const char* name, M T::*member) {
+    return Field<T, M>{name, member};
+}
+
+// RowMapping tells QueryAll and ScanAll how columns map to the fields of
+// T. Specialize it with a Fields function returning a tuple of MapField:
+//
+//     template <>
+//     struct sqlcc::RowMapping<User> {
+//         static constexpr auto Fields() {
+//             return std::make_tuple(sqlcc::MapField("id", &User::id),
+//                                    sqlcc::MapField("username", &User::name),
+//                                    sqlcc::MapField("age", &User::age));
+//         }
+//     };
+//
+// Names are matched ignoring case. Every column of a result set needs a
+// field, fields without a column keep their default value.
+template <typename T>
+struct RowMapping;
+
+// RowMapper resolves the columns of a result set to the fields of T once,
+// then points the typed scan of each row straight at the fields.
+template <typename T>
+class RowMapper {
+   public:
+    explicit RowMapper(const std::vector<std::string>& columns)
+        : dest_(columns.size(), nullptr) {
+        std::vector<driver::ScanType> types(columns.size());
+        Resolve(columns, types, std::make_index_sequence<kFields>());
+        types_ = Intern(types);
+    }
+
+    // Bind points the destinations at the fields of row
+    void* const* Bind(T& row) {
+        Bind(row, std::make_index_sequence<kFields>());
+        return dest_.data();
+    }
+    const driver::ScanType* Types() const { return types_; }
+    std::size_t Size() const { return dest_.size(); }
+
+   private:
+    using Fields = decltype(RowMapping<T>::Fields());
+    static constexpr std::size_t kFields = std::tuple_size_v<Fields>;
+    static_assert(kFields > 0, "RowMapping needs a field");
+
+    // Intern returns the types as an array that is never freed, drivers
+    // key their conversion plans by its address
+    static const driver::ScanType* Intern(
+        const std::vector<driver::ScanType>& types) {
+        static std::mutex mu;
+        static std::set<std::vector<driver::ScanType>> interned;
+        std::lock_guard<std::mutex> lock(mu);
+        return interned.insert(types).first->data();
+    }
+
+    template <std::size_t... I>
+    void Resolve(const std::vector<std::string>& columns,
+                 std::vector<driver::ScanType>& types,
+                 std::index_sequence<I...>) {
+        std::vector<bool> mapped(columns.size());
+        (ResolveField<I>(columns, types, mapped), ...);
+        for (std::size_t i = 0; i < columns.size(); i++) {
+            if (!mapped[i]) {
+                throw Exception(400, "sql: no field for column " + columns[i]);
+            }
+        }
+    }
+
+    template <std::size_t I>
+    void ResolveField(const std::vector<std::string>& columns,
+                      std::vector<driver::ScanType>& types,
+                      std::vector<bool>& mapped) {
+        using M = typename std::tuple_element_t<I, Fields>::Type;
+        const auto& field = std::get<I>(fields_);
+        columns_[I] = -1;
+        for (std::size_t i = 0; i < columns.size(); i++) {
+            if (!mapped[i] && strcasecmp(columns[i].c_str(), field.name) == 0) {
+                types[i] = driver::ScanTypeOf<M>();
+                mapped[i] = true;
+                columns_[I] = static_cast<int>(i);
+                return;
+            }
+        }
+    }
+
+    template <std::size_t... I>
+    void Bind(T& row, std::index_sequence<I...>) {
+        ((columns_[I] >= 0
+              ? (void)(dest_[columns_[I]] = &(row.*std::get<I>(fields_).member))
+              : (void)0),
+         ...);
+    }
+
+    Fields fields_ = RowMapping<T>::Fields();
+    // column of each field, -1 when the result set has none
+    int columns_[kFields];
+    const driver::ScanType* types_;
+    std::vector<void*> dest_;
+};
+
+}  // namespace sqlcc
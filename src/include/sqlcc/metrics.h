@@ -0,0 +1,32 @@
+#pragma once
+
+#include <sqlcc/driver/metrics.h>
+
+#include <string>
+
+namespace sqlcc {
+
+// MetricsSnapshot is a copy of the metrics of a Database. The phase
+// histograms stay empty unless SetPhaseMetrics(true) was called.
+struct MetricsSnapshot {
+    int open_connections = 0;
+    int in_use = 0;
+    int idle = 0;
+    uint64_t conn_opens = 0;
+    uint64_t conn_closes = 0;
+    driver::HistogramSnapshot pool_wait;
+    driver::HistogramSnapshot prepare;
+    driver::HistogramSnapshot execute;
+    driver::HistogramSnapshot fetch;
+    driver::HistogramSnapshot decode;
+    uint64_t bytes_received = 0;
+};
+
+// PrometheusText renders s in the Prometheus text exposition format, with
+// metric names starting with prefix. labels, like db="main", are added to
+// every sample so several databases can be exported side by side.
+std::string PrometheusText(const MetricsSnapshot& s,
+                           const std::string& labels = "",
+                           const std::string& prefix = "sqlcc");
+
+}  // namespace sqlcc
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <sqlcc/sqlcc.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace sqlcc {
+
+struct QueryCacheOptions {
+    // bound on the bytes of all cached results, the least recently used go
+    // first
+    std::size_t max_bytes = 64 << 20;
+    // results larger than max_entry_bytes are returned but not kept
+    std::size_t max_entry_bytes = 1 << 20;
+    std::chrono::milliseconds ttl{60000};
+    // tables the cache is declared for. A query is cached when every table
+    // it reads is declared, a statement writing to a declared table drops
+    // the results of the queries reading it.
+    std::vector<std::string> tables;
+};
+
+struct QueryCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // misses served by the query of a concurrent miss for the same key
+    uint64_t shared = 0;
+    uint64_t evictions = 0;
+    uint64_t invalidations = 0;
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+};
+
+// CachedDatabase keeps the results of query on declared tables in memory,
+// keyed by the query and its arguments. Cached results are read in full
+// before the first row is returned, and concurrent misses for the same key
+// share a single query. Everything else goes to the wrapped database.
+//
+// Writes are seen by an interceptor on the wrapped database, so statements
+// run through Prepare, Conn and transactions invalidate too. Like other
+// interceptors it misses async calls and pipelines, and it runs before a
+// transaction commits: call Invalidate for the writes it can't see, or
+// after a commit that other readers may have raced.
+class CachedDatabase : public Database {
+   public:
+    // Invalidate drops the cached results of queries reading table
+    virtual void Invalidate(const std::string& table) = 0;
+    virtual void Clear() = 0;
+    virtual QueryCacheStats CacheStats() = 0;
+};
+
+std::shared_ptr<CachedDatabase> OpenCached(
+    DB db, QueryCacheOptions opts = QueryCacheOptions());
+
+}  // namespace sqlcc
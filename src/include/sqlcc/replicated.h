@@ -0,0 +1,77 @@
+#pragma once
+
+#include <sqlcc/sqlcc.h>
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sqlcc {
+
+struct ReplicaOptions {
+    // weight of a new sample in the moving averages of latency and errors
+    double ewma_alpha = 0.2;
+    // a replica whose error rate goes above max_error_rate, once it served
+    // min_requests, is ejected for ejection_time. Back in, a single error
+    // ejects it again until successes bring the rate down.
+    double max_error_rate = 0.5;
+    uint64_t min_requests = 10;
+    std::chrono::milliseconds ejection_time{30000};
+    // lag_query is run on every replica each lag_check_interval, replicas
+    // lagging more than max_replication_lag are skipped until they catch
+    // up. It may be "SHOW REPLICA STATUS", the Seconds_Behind_Source or
+    // Seconds_Behind_Master column is read, or any query returning the lag
+    // in seconds in its first column. A null lag, no row or an error count
+    // as lagging. Empty disables the check.
+    std::string lag_query;
+    std::chrono::milliseconds max_replication_lag{1000};
+    std::chrono::milliseconds lag_check_interval{1000};
+    // IsReplicaError tells the errors that count against a replica from
+    // those of the statement. By default these are the MySQL client errors
+    // (codes 2000 to 2999), pool timeouts and exceptions that are no
+    // sqlcc::Exception.
+    std::function<bool(const std::exception_ptr&)> is_replica_error;
+};
+
+struct ReplicaStatus {
+    // moving average of the time to run a query, zero before the first
+    std::chrono::nanoseconds latency{0};
+    // queries running, rows being read included
+    int in_flight = 0;
+    double error_rate = 0;
+    uint64_t requests = 0;
+    // last lag seen by the lag check, -1 when unknown or not checked
+    std::chrono::milliseconds lag{-1};
+    bool ejected = false;
+    bool lagging = false;
+};
+
+// ReplicatedDatabase sends query and QueryAsync to replicas and everything
+// else, exec, Prepare, Conn, Begin and pipelines, to the primary. Replicas
+// may lag behind, read your own writes from a transaction or a Conn.
+// QueryAsync picks a replica the same way, but is not observed.
+//
+// A replica is picked by the power of two choices: of two random healthy
+// replicas the one with the lower latency average times queries in flight
+// wins. Without a healthy replica queries go to the primary, and a query
+// failing with a replica error is retried once on the primary. The pool
+// settings apply to every database, Stats and Metrics are the primary's.
+class ReplicatedDatabase : public Database {
+   public:
+    // Replicas returns the status of the replicas in the order they were
+    // given
+    virtual std::vector<ReplicaStatus> Replicas() = 0;
+};
+
+std::shared_ptr<ReplicatedDatabase> OpenReplicated(
+    DB primary, std::vector<DB> replicas,
+    ReplicaOptions opts = ReplicaOptions());
+
+std::shared_ptr<ReplicatedDatabase> OpenReplicated(
+    const std::string& driver_name, const std::string& primary_dsn,
+    const std::vector<std::string>& replica_dsns,
+    ReplicaOptions opts = ReplicaOptions());
+
+}  // namespace sqlcc
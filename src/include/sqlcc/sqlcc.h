@@ -1,8 +1,15 @@
 #pragma once
 
 #include <sqlcc/driver/driver.h>
+#include <sqlcc/exception.h>
+#include <sqlcc/interceptor.h>
+#include <sqlcc/mapping.h>
+#include <sqlcc/metrics.h>
 
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <tuple>
 #include <utility>
 
 namespace sqlcc {
@@ -74,6 +81,7 @@ class Database;
 class Connection;
 class Statement;
 class Transaction;
+class Pipeline;
 class SQLResult;
 class SQLRows;
 
@@ -94,16 +102,75 @@ class SQLRows {
    public:
     virtual ~SQLRows() {}
     virtual const std::vector<std::string>& Columns() const = 0;
+    // Next advances to the next row, once it returns false the rows are
+    // closed and their connection goes back to the pool. Buffered rows gave
+    // their connection back when queried and stay open until closed.
     virtual bool Next() = 0;
+    // Close releases the rows and their connection before they are
+    // exhausted, it is safe to call more than once.
+    virtual void Close() = 0;
+    // RowCount returns the number of rows of a buffered result, -1 when it
+    // is not known.
+    virtual int64_t RowCount() = 0;
+    // Seek moves a buffered result to row, the next Next fetches it.
+    virtual void Seek(uint64_t row) = 0;
+    // scan copies the columns of the current row into args, the argument
+    // types select the conversions at compile time so no driver::Value is
+    // built in between.
     template <typename... Args>
     void scan(Args*... args) {
-        std::vector<driver::Value> dest = MergePointerValues(args...);
-        DoScan(dest);
-        SplitDestValues(dest, args...);
+        static_assert(sizeof...(Args) > 0, "scan needs a destination");
+        static constexpr driver::ScanType types[] = {
+            driver::ScanTypeOf<Args>()...};
+        void* const dest[] = {static_cast<void*>(args)...};
+        DoScanTyped(types, dest, sizeof...(Args));
     }
+    // ScanAll appends the remaining rows to out, each decoded straight into
+    // the fields of a T by its RowMapping. The columns are resolved once,
+    // and out grows by RowCount up front when the result is buffered.
+    template <typename T>
+    void ScanAll(std::vector<T>& out) {
+        RowMapper<T> mapper(Columns());
+        int64_t count = RowCount();
+        if (count > 0) {
+            out.reserve(out.size() + static_cast<std::size_t>(count));
+        }
+        while (Next()) {
+            T& row = out.emplace_back();
+            try {
+                DoScanTyped(mapper.Types(), mapper.Bind(row), mapper.Size());
+            } catch (...) {
+                out.pop_back();
+                throw;
+            }
+        }
+    }
+    // NextBatch fetches up to n rows column by column into batch, reusing
+    // its memory, and returns the number of rows fetched, 0 at the end.
+    virtual std::size_t NextBatch(driver::Batch& batch, std::size_t n) = 0;
+    driver::Batch NextBatch(std::size_t n) {
+        driver::Batch batch;
+        NextBatch(batch, n);
+        return batch;
+    }
+    // ScanCells fills cells with one borrowed cell per column of the
+    // current row, reusing its memory. String cells are only valid until
+    // the next call to Next.
+    virtual void ScanCells(std::vector<driver::Cell>& cells) = 0;
+    // ReadColumn copies up to size bytes of column idx of the current row,
+    // starting at offset, and returns the number copied, 0 at the end of
+    // the value and for null. Large BLOB and TEXT values can be read in
+    // chunks this way without holding them in memory twice, see
+    // ColumnReader for a streambuf over it.
+    virtual std::size_t ReadColumn(std::size_t idx, uint64_t offset,
+                                   char* buf, std::size_t size) = 0;
 
    protected:
+    // forwards the calls of the rows it wraps
+    friend class ReplicaRows;
     virtual void DoScan(std::vector<driver::Value>& dest) = 0;
+    virtual void DoScanTyped(const driver::ScanType* types, void* const* dest,
+                             std::size_t size) = 0;
 };
 
 class Statement {
@@ -117,26 +184,221 @@ class Statement {
     template <typename... Args>
     Rows Query(const Args&... args) {
         std::vector<driver::Value> args_values = MergeConstValues(args...);
-        return DoQuery(args_values);
+        return DoQuery(args_values, driver::QueryOptions());
+    }
+    template <typename... Args>
+    Rows Query(const driver::QueryOptions& opts, const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        return DoQuery(args_values, opts);
+    }
+    // QueryAll runs the statement and maps every row to a T, see RowMapping
+    template <typename T, typename... Args>
+    std::vector<T> QueryAll(const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        std::vector<T> out;
+        DoQuery(args_values, driver::QueryOptions())->ScanAll(out);
+        return out;
+    }
+    // ExecMany executes the statement once per row, the driver sends the
+    // rows in bulk when the server supports it. RowsAffected of the result
+    // is the sum over all rows.
+    template <typename... Args>
+    Result ExecMany(const std::vector<std::tuple<Args...>>& rows) {
+        std::vector<std::vector<driver::Value>> args_values;
+        args_values.reserve(rows.size());
+        for (const auto& row : rows) {
+            args_values.push_back(std::apply(
+                [](const auto&... args) { return MergeConstValues(args...); },
+                row));
+        }
+        return DoExecMany(args_values);
+    }
+    Result ExecMany(const std::vector<std::vector<driver::Value>>& rows) {
+        return DoExecMany(rows);
+    }
+    // ExecAsync and QueryAsync return once the statement is sent, drivers
+    // with an event loop complete it there. Rows of QueryAsync are
+    // buffered. The statement must not be used until the future is ready.
+    template <typename... Args>
+    std::future<Result> ExecAsync(const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        return DoExecAsync(args_values);
+    }
+    template <typename... Args>
+    std::future<Rows> QueryAsync(const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        return DoQueryAsync(args_values);
     }
 
    protected:
     virtual Result DoExec(const std::vector<driver::Value>& args) = 0;
-    virtual Rows DoQuery(const std::vector<driver::Value>& args) = 0;
+    virtual Rows DoQuery(const std::vector<driver::Value>& args,
+                         const driver::QueryOptions& opts) = 0;
+    virtual Result DoExecMany(
+        const std::vector<std::vector<driver::Value>>& rows) = 0;
+    virtual std::future<Result> DoExecAsync(
+        const std::vector<driver::Value>& args) = 0;
+    virtual std::future<Rows> DoQueryAsync(
+        const std::vector<driver::Value>& args) = 0;
+};
+
+class Transaction {
+   public:
+    // a transaction that is neither committed nor rolled back is rolled
+    // back when released
+    virtual ~Transaction() {}
+    // Commit and Rollback end the transaction, further calls throw. The
+    // connection goes back to the pool once the statements and rows of the
+    // transaction are released.
+    virtual void Commit() = 0;
+    virtual void Rollback() = 0;
+    virtual Stmt Prepare(const std::string& query) = 0;
+    template <typename... Args>
+    Result exec(const std::string& query, const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        return DoExec(query, args_values);
+    }
+    template <typename... Args>
+    Rows query(const std::string& query, const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        return DoQuery(query, args_values, driver::QueryOptions());
+    }
+    template <typename... Args>
+    Rows query(const driver::QueryOptions& opts, const std::string& query,
+               const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        return DoQuery(query, args_values, opts);
+    }
+    // QueryAll runs query and maps every row to a T, see RowMapping
+    template <typename T, typename... Args>
+    std::vector<T> QueryAll(const std::string& query, const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        std::vector<T> out;
+        DoQuery(query, args_values, driver::QueryOptions())->ScanAll(out);
+        return out;
+    }
+
+   protected:
+    virtual Result DoExec(const std::string& query,
+                          const std::vector<driver::Value>& args) = 0;
+    virtual Rows DoQuery(const std::string& query,
+                         const std::vector<driver::Value>& args,
+                         const driver::QueryOptions& opts) = 0;
+};
+
+// Pipeline queues statements and sends them in a single round trip, then
+// yields their results in the order they were added.
+class Pipeline {
+   public:
+    virtual ~Pipeline() {}
+    template <typename... Args>
+    void Add(const std::string& query, const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        DoAdd(query, args_values);
+    }
+    // Send writes the queued statements at once, adding after a send starts
+    // a new batch.
+    virtual void Send() = 0;
+    // Next advances to the result of the next statement, false after the
+    // last one. It throws the error of a failed statement, the statements
+    // after it are not executed.
+    virtual bool Next() = 0;
+    // CurrentResult is nullptr for statements with a result set,
+    // CurrentRows for those without one. Rows stay valid after Next.
+    virtual Result CurrentResult() = 0;
+    virtual Rows CurrentRows() = 0;
+
+   protected:
+    virtual void DoAdd(const std::string& query,
+                       const std::vector<driver::Value>& args) = 0;
 };
 
 class Connection {
    public:
     virtual ~Connection() {}
     virtual Stmt Prepare(const std::string& query) = 0;
+    // Begin starts a transaction pinned to this connection
+    virtual Tx Begin() = 0;
+    // NewPipeline returns a pipeline on this connection, which must not be
+    // used otherwise while results of the pipeline are unread
+    virtual std::shared_ptr<Pipeline> NewPipeline() = 0;
+};
+
+// DBStats contains database connection pool statistics.
+struct DBStats {
+    int max_open_connections = 0;
+    int open_connections = 0;
+    int in_use = 0;
+    int idle = 0;
+    int64_t wait_count = 0;
+    std::chrono::nanoseconds wait_duration{0};
+    int64_t max_idle_closed = 0;
+    int64_t max_idle_time_closed = 0;
+    int64_t max_lifetime_closed = 0;
+    // closed because the driver found them broken or a ping failed
+    int64_t invalid_closed = 0;
+    int64_t stmt_cache_hits = 0;
+    int64_t stmt_cache_misses = 0;
+    int64_t stmt_cache_evictions = 0;
 };
 
 class Database {
    public:
     virtual ~Database(){};
+    // Conn returns a single connection from the pool, it goes back to the
+    // pool once the Connection and every Stmt/Rows made from it are released.
     virtual std::shared_ptr<Connection> Conn() = 0;
+    // Begin starts a transaction on a connection of its own
+    virtual Tx Begin() = 0;
+    // NewPipeline returns a pipeline on a connection of its own, the
+    // connection goes back to the pool when the pipeline is released
+    virtual std::shared_ptr<Pipeline> NewPipeline() = 0;
+    // Ping checks a pooled connection with a round trip, a broken one is
+    // closed instead of going back to the pool
     virtual void Ping() = 0;
+    virtual void Close() = 0;
     virtual std::shared_ptr<driver::Driver> Driver() = 0;
+    // <= 0 means unlimited, default 0
+    virtual void SetMaxOpenConns(int n) = 0;
+    // <= 0 means no idle connections are retained, default 2
+    virtual void SetMaxIdleConns(int n) = 0;
+    // <= 0 means connections are reused forever
+    virtual void SetConnMaxLifetime(std::chrono::milliseconds d) = 0;
+    // <= 0 means connections are not closed due to idle time
+    virtual void SetConnMaxIdleTime(std::chrono::milliseconds d) = 0;
+    // how long to wait for a connection when max open connections is
+    // reached, <= 0 means wait forever
+    virtual void SetConnWaitTimeout(std::chrono::milliseconds d) = 0;
+    // number of prepared statements cached per connection, <= 0 disables
+    // the cache, default 64
+    virtual void SetStmtCacheSize(int n) = 0;
+    // number of idle connections the health check keeps open, default 0
+    virtual void SetMinIdleConns(int n) = 0;
+    // how often a background health check closes expired idle connections,
+    // pings those idle for longer and opens the min idle connections. Keep
+    // it below the wait_timeout of the server. <= 0 turns it off, default.
+    virtual void SetHealthCheckPeriod(std::chrono::milliseconds d) = 0;
+    // SetThreadAffinity gives each thread back the connection it released
+    // last, with its statement cache, without taking the pool lock. Parked
+    // connections count as idle, threads waiting for a connection take
+    // them and the health check reclaims those unused for a period. Off by
+    // default.
+    virtual void SetThreadAffinity(bool on) = 0;
+    // SetSharding spreads idle connections over per-CPU shards taken and
+    // returned with atomic swaps, a thread finding its shard empty steals
+    // from the neighbouring ones before taking the pool lock. Parked
+    // connections count as idle. Meant for hosts with many cores, off by
+    // default.
+    virtual void SetSharding(bool on) = 0;
+    virtual DBStats Stats() = 0;
+    // SetPhaseMetrics turns on timing of the driver phases of every
+    // statement, off by default as it reads the clock around every call
+    virtual void SetPhaseMetrics(bool on) = 0;
+    virtual MetricsSnapshot Metrics() = 0;
+    // AddInterceptor appends interceptor to the chain that observes every
+    // statement, statements prepared before keep the chain they started
+    // with. Async calls and pipelines are not intercepted.
+    virtual void AddInterceptor(std::shared_ptr<Interceptor> interceptor) = 0;
     template <typename... Args>
     Result exec(const std::string& query, const Args&... args) {
         std::vector<driver::Value> args_values = MergeConstValues(args...);
@@ -145,17 +407,59 @@ class Database {
     template <typename... Args>
     Rows query(const std::string& query, const Args&... args) {
         std::vector<driver::Value> args_values = MergeConstValues(args...);
-        return DoQuery(query, args_values);
+        return DoQuery(query, args_values, driver::QueryOptions());
+    }
+    template <typename... Args>
+    Rows query(const driver::QueryOptions& opts, const std::string& query,
+               const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        return DoQuery(query, args_values, opts);
+    }
+    // QueryAll runs query and maps every row to a T, see RowMapping
+    template <typename T, typename... Args>
+    std::vector<T> QueryAll(const std::string& query, const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        std::vector<T> out;
+        DoQuery(query, args_values, driver::QueryOptions())->ScanAll(out);
+        return out;
+    }
+    // ExecAsync and QueryAsync take a connection from the pool and give it
+    // back once the statement completed, or the rows are released.
+    template <typename... Args>
+    std::future<Result> ExecAsync(const std::string& query,
+                                  const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        return DoExecAsync(query, args_values);
+    }
+    template <typename... Args>
+    std::future<Rows> QueryAsync(const std::string& query,
+                                 const Args&... args) {
+        std::vector<driver::Value> args_values = MergeConstValues(args...);
+        return DoQueryAsync(query, args_values);
     }
     virtual Stmt Prepare(const std::string& query) = 0;
 
    protected:
+    // routes the calls of its databases
+    friend class ReplicatedDatabaseImpl;
+    friend class CachedDatabaseImpl;
     virtual Result DoExec(const std::string& query,
                            const std::vector<driver::Value>& args) = 0;
+    virtual std::future<Result> DoExecAsync(
+        const std::string& query, const std::vector<driver::Value>& args) = 0;
+    virtual std::future<Rows> DoQueryAsync(
+        const std::string& query, const std::vector<driver::Value>& args) = 0;
     virtual Rows DoQuery(const std::string& query,
-                          const std::vector<driver::Value>& args) = 0;
+                          const std::vector<driver::Value>& args,
+                          const driver::QueryOptions& opts) = 0;
 };
 
+// Open opens a database with a registered driver, a malformed dsn throws
+// right away when the driver parses it up front.
 DB Open(const std::string& driver_name, const std::string& dsn);
 
+// OpenDB opens a database from a connector, sharing its configuration
+// between all connections.
+DB OpenDB(std::shared_ptr<driver::Connector> connector);
+
 }  // namespace sqlcc
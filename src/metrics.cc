@@ -0,0 +1,88 @@
+#include "sqlcc/metrics.h"
+
+#include <cstdio>
+
+namespace sqlcc {
+
+static std::string Seconds(std::chrono::nanoseconds d) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", d.count() / 1e9);
+    return buf;
+}
+
+// Join joins two label lists, either may be empty
+static std::string Join(const std::string& a, const std::string& b) {
+    if (a.empty() || b.empty()) {
+        return a + b;
+    }
+    return a + "," + b;
+}
+
+static void Header(std::string* out, const std::string& name,
+                   const char* type, const char* help) {
+    *out += "# HELP " + name + " " + help + "\n";
+    *out += "# TYPE " + name + " " + type + "\n";
+}
+
+static void Sample(std::string* out, const std::string& name,
+                   const std::string& labels, const std::string& value) {
+    *out += name;
+    if (!labels.empty()) {
+        *out += "{" + labels + "}";
+    }
+    *out += " " + value + "\n";
+}
+
+static void Histogram(std::string* out, const std::string& name,
+                      const std::string& labels,
+                      const driver::HistogramSnapshot& h) {
+    // buckets are cumulative in the exposition format
+    uint64_t cumulative = 0;
+    for (std::size_t i = 0; i < driver::HistogramSnapshot::kBuckets; i++) {
+        cumulative += h.counts[i];
+        Sample(out, name + "_bucket",
+               Join(labels, "le=\"" + Seconds(h.UpperBound(i)) + "\""),
+               std::to_string(cumulative));
+    }
+    Sample(out, name + "_bucket", Join(labels, "le=\"+Inf\""),
+           std::to_string(h.count));
+    Sample(out, name + "_sum", labels, Seconds(h.sum));
+    Sample(out, name + "_count", labels, std::to_string(h.count));
+}
+
+std::string PrometheusText(const MetricsSnapshot& s, const std::string& labels,
+                           const std::string& prefix) {
+    std::string out;
+    std::string name = prefix + "_connections_opened_total";
+    Header(&out, name, "counter", "Connections opened by the pool.");
+    Sample(&out, name, labels, std::to_string(s.conn_opens));
+
+    name = prefix + "_connections_closed_total";
+    Header(&out, name, "counter", "Connections closed by the pool.");
+    Sample(&out, name, labels, std::to_string(s.conn_closes));
+
+    name = prefix + "_connections";
+    Header(&out, name, "gauge", "Open connections by state.");
+    Sample(&out, name, Join(labels, "state=\"in_use\""),
+           std::to_string(s.in_use));
+    Sample(&out, name, Join(labels, "state=\"idle\""), std::to_string(s.idle));
+
+    name = prefix + "_pool_wait_seconds";
+    Header(&out, name, "histogram",
+           "Time callers were blocked waiting for a connection.");
+    Histogram(&out, name, labels, s.pool_wait);
+
+    name = prefix + "_phase_seconds";
+    Header(&out, name, "histogram", "Time spent in each statement phase.");
+    Histogram(&out, name, Join(labels, "phase=\"prepare\""), s.prepare);
+    Histogram(&out, name, Join(labels, "phase=\"execute\""), s.execute);
+    Histogram(&out, name, Join(labels, "phase=\"fetch\""), s.fetch);
+    Histogram(&out, name, Join(labels, "phase=\"decode\""), s.decode);
+
+    name = prefix + "_received_bytes_total";
+    Header(&out, name, "counter", "Result bytes fetched from the server.");
+    Sample(&out, name, labels, std::to_string(s.bytes_received));
+    return out;
+}
+
+}  // namespace sqlcc
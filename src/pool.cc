@@ -0,0 +1,673 @@
+#include "pool.h"
+
+#include "sqlcc/exception.h"
+
+#include <sched.h>
+
+#include <algorithm>
+#include <random>
+
+namespace sqlcc {
+
+// same default as golang database/sql
+static const int kDefaultMaxIdleConns = 2;
+
+static const std::size_t kDefaultStmtCacheSize = 64;
+
+// connections expire up to this share of the max lifetime early
+static const double kMaxLifetimeJitter = 0.1;
+
+ConnPool::ConnPool(std::shared_ptr<driver::Connector> connector)
+    : stmt_cache_hits(0),
+      stmt_cache_misses(0),
+      stmt_cache_evictions(0),
+      connector_(connector),
+      phase_metrics_(false),
+      interceptors_(nullptr),
+      affinity_(false),
+      sharding_(false),
+      waiters_(0),
+      slotted_(0),
+      thread_slots_(new ThreadSlot[kThreadSlots]),
+      num_shards_(std::max(1u, std::thread::hardware_concurrency())),
+      num_open_(0),
+      max_open_(0),
+      max_idle_(kDefaultMaxIdleConns),
+      max_lifetime_(Clock::duration::zero()),
+      max_idle_time_(Clock::duration::zero()),
+      wait_timeout_(Clock::duration::zero()),
+      stmt_cache_size_(kDefaultStmtCacheSize),
+      min_idle_(0),
+      health_check_period_(Clock::duration::zero()),
+      closed_(false),
+      wait_count_(0),
+      wait_duration_(Clock::duration::zero()),
+      max_idle_closed_(0),
+      max_idle_time_closed_(0),
+      max_lifetime_closed_(0),
+      invalid_closed_(0) {}
+
+ConnPool::~ConnPool() {
+    Close();
+    // released concurrently with Close
+    std::list<std::unique_ptr<PooledConn>> closing;
+    TakeSlots(Clock::duration::zero(), &closing);
+}
+
+ConnPool::Expiry ConnPool::Expired(const PooledConn& pc,
+                                   Clock::time_point now) const {
+    Clock::duration max_lifetime =
+        max_lifetime_.load(std::memory_order_relaxed);
+    if (max_lifetime > Clock::duration::zero() &&
+        now - pc.created_at >=
+            max_lifetime - std::chrono::duration_cast<Clock::duration>(
+                               max_lifetime * pc.lifetime_jitter)) {
+        return Expiry::kMaxLifetime;
+    }
+    Clock::duration max_idle_time =
+        max_idle_time_.load(std::memory_order_relaxed);
+    if (max_idle_time > Clock::duration::zero() &&
+        now - pc.returned_at >= max_idle_time) {
+        return Expiry::kMaxIdleTime;
+    }
+    if (!pc.conn->IsValid()) {
+        return Expiry::kInvalid;
+    }
+    return Expiry::kNone;
+}
+
+std::atomic<PooledConn*>& ConnPool::CurrentThreadSlot() {
+    static std::atomic<std::size_t> next_thread{0};
+    thread_local std::size_t thread =
+        next_thread.fetch_add(1, std::memory_order_relaxed);
+    return thread_slots_[thread % kThreadSlots].conn;
+}
+
+ConnPool::Shard& ConnPool::CurrentShard(std::size_t offset) {
+    int cpu = sched_getcpu();
+    std::size_t shard = cpu < 0 ? 0 : static_cast<std::size_t>(cpu);
+    return shards_[(shard + offset) % num_shards_];
+}
+
+std::unique_ptr<PooledConn> ConnPool::TakeSlot(
+    std::atomic<PooledConn*>& slot) {
+    // seq_cst like the waiters_ handshake, a waiter must not miss a
+    // connection parked after it announced itself
+    if (slot.load() == nullptr) {
+        return nullptr;
+    }
+    std::unique_ptr<PooledConn> pc(slot.exchange(nullptr));
+    if (pc) {
+        slotted_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return pc;
+}
+
+bool ConnPool::PutSlot(std::atomic<PooledConn*>& slot,
+                       std::unique_ptr<PooledConn>& pc) {
+    PooledConn* empty = nullptr;
+    if (!slot.compare_exchange_strong(empty, pc.get())) {
+        return false;
+    }
+    pc.release();
+    slotted_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+std::unique_ptr<PooledConn> ConnPool::AcquireFromSlot() {
+    std::unique_ptr<PooledConn> pc;
+    if (affinity_.load(std::memory_order_relaxed)) {
+        pc = TakeSlot(CurrentThreadSlot());
+    }
+    if (!pc && sharding_.load(std::memory_order_acquire)) {
+        // the shard of the CPU first, then its neighbours
+        for (std::size_t i = 0; !pc && i <= kStealShards && i < num_shards_;
+             i++) {
+            Shard& shard = CurrentShard(i);
+            for (std::size_t j = 0; !pc && j < kShardSlots; j++) {
+                pc = TakeSlot(shard.conns[j]);
+            }
+        }
+    }
+    return pc;
+}
+
+bool ConnPool::ReleaseToSlot(std::unique_ptr<PooledConn>& pc) {
+    if (waiters_.load() > 0 ||
+        slotted_.load(std::memory_order_relaxed) >=
+            max_idle_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    pc->returned_at = Clock::now();
+    if (Expired(*pc, pc->returned_at) != Expiry::kNone) {
+        return false;
+    }
+    std::atomic<PooledConn*>* slot = nullptr;
+    if (affinity_.load(std::memory_order_relaxed)) {
+        std::atomic<PooledConn*>& thread_slot = CurrentThreadSlot();
+        if (PutSlot(thread_slot, pc)) {
+            slot = &thread_slot;
+        }
+    } else if (sharding_.load(std::memory_order_acquire)) {
+        Shard& shard = CurrentShard(0);
+        for (std::size_t j = 0; slot == nullptr && j < kShardSlots; j++) {
+            if (PutSlot(shard.conns[j], pc)) {
+                slot = &shard.conns[j];
+            }
+        }
+    }
+    if (slot == nullptr) {
+        return false;
+    }
+    if (waiters_.load() > 0) {
+        // a waiter came in after the first check, it may have missed the
+        // slot already
+        pc = TakeSlot(*slot);
+        return !pc;
+    }
+    return true;
+}
+
+void ConnPool::TakeSlots(Clock::duration idle_for,
+                         std::list<std::unique_ptr<PooledConn>>* out) {
+    Clock::time_point now = Clock::now();
+    auto take = [&](std::atomic<PooledConn*>& slot) {
+        std::unique_ptr<PooledConn> pc = TakeSlot(slot);
+        if (!pc) {
+            return;
+        }
+        // still in use by its thread, put it back unless the slot was
+        // filled meanwhile
+        if (now - pc->returned_at < idle_for && PutSlot(slot, pc)) {
+            return;
+        }
+        out->push_back(std::move(pc));
+    };
+    for (std::size_t i = 0; i < kThreadSlots; i++) {
+        take(thread_slots_[i].conn);
+    }
+    if (shards_) {
+        for (std::size_t i = 0; i < num_shards_; i++) {
+            for (std::size_t j = 0; j < kShardSlots; j++) {
+                take(shards_[i].conns[j]);
+            }
+        }
+    }
+}
+
+void ConnPool::DiscardLocked(Expiry expiry) {
+    switch (expiry) {
+        case Expiry::kMaxLifetime:
+            max_lifetime_closed_++;
+            break;
+        case Expiry::kMaxIdleTime:
+            max_idle_time_closed_++;
+            break;
+        case Expiry::kInvalid:
+            invalid_closed_++;
+            break;
+        case Expiry::kNone:
+            max_idle_closed_++;
+            break;
+    }
+    num_open_--;
+    metrics.conn_closes.Add();
+    cv_.notify_one();
+}
+
+std::unique_ptr<PooledConn> ConnPool::Open(std::size_t stmt_cache_size) {
+    thread_local std::minstd_rand rng(std::random_device{}());
+    std::unique_ptr<PooledConn> pc(new PooledConn);
+    pc->stmts.SetCapacity(stmt_cache_size);
+    try {
+        pc->conn = connector_->Connect();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mu_);
+        num_open_--;
+        cv_.notify_one();
+        throw;
+    }
+    metrics.conn_opens.Add();
+    pc->created_at = Clock::now();
+    pc->returned_at = pc->created_at;
+    pc->lifetime_jitter =
+        std::uniform_real_distribution<double>(0, kMaxLifetimeJitter)(rng);
+    return pc;
+}
+
+std::unique_ptr<PooledConn> ConnPool::Handout(
+    std::unique_ptr<PooledConn> pc) {
+    pc->conn->EnterThread();
+    pc->conn->SetMetrics(
+        phase_metrics_.load(std::memory_order_relaxed) ? &metrics : nullptr);
+    return pc;
+}
+
+std::unique_ptr<PooledConn> ConnPool::Acquire() {
+    if (slotted_.load(std::memory_order_relaxed) > 0) {
+        while (std::unique_ptr<PooledConn> pc = AcquireFromSlot()) {
+            Expiry expiry = Expired(*pc, Clock::now());
+            if (expiry == Expiry::kNone) {
+                return Handout(std::move(pc));
+            }
+            std::lock_guard<std::mutex> lock(mu_);
+            DiscardLocked(expiry);
+        }
+    }
+    // expired connections are closed after the lock is released
+    std::list<std::unique_ptr<PooledConn>> closing;
+    std::unique_lock<std::mutex> lock(mu_);
+    Clock::time_point deadline = Clock::now() + wait_timeout_;
+    // time blocked by this call, observed once it stops waiting
+    bool waited = false;
+    Clock::duration waited_for = Clock::duration::zero();
+    for (;;) {
+        if (closed_) {
+            throw Exception(500, "sqlcc: database is closed");
+        }
+        Clock::time_point now = Clock::now();
+        while (!idle_.empty()) {
+            std::unique_ptr<PooledConn> pc = std::move(idle_.back());
+            idle_.pop_back();
+            switch (Expired(*pc, now)) {
+                case Expiry::kMaxLifetime:
+                    max_lifetime_closed_++;
+                    break;
+                case Expiry::kMaxIdleTime:
+                    max_idle_time_closed_++;
+                    break;
+                case Expiry::kInvalid:
+                    invalid_closed_++;
+                    break;
+                case Expiry::kNone:
+                    pc->stmts.SetCapacity(stmt_cache_size_);
+                    if (waited) {
+                        metrics.pool_wait.Observe(waited_for);
+                    }
+                    return Handout(std::move(pc));
+            }
+            num_open_--;
+            metrics.conn_closes.Add();
+            closing.push_back(std::move(pc));
+        }
+        if (sharding_.load(std::memory_order_relaxed) &&
+            slotted_.load(std::memory_order_relaxed) > 0) {
+            // reuse the connections of the shards out of reach before
+            // opening one
+            TakeSlots(Clock::duration::zero(), &idle_);
+            if (!idle_.empty()) {
+                continue;
+            }
+        }
+        if (max_open_ <= 0 || num_open_ < max_open_) {
+            num_open_++;
+            std::size_t stmt_cache_size = stmt_cache_size_;
+            lock.unlock();
+            closing.clear();
+            if (waited) {
+                metrics.pool_wait.Observe(waited_for);
+            }
+            return Handout(Open(stmt_cache_size));
+        }
+
+        // announced before the slots are taken, a thread parking a
+        // connection meanwhile sees the waiter and takes it back
+        waiters_.fetch_add(1);
+        if (affinity_.load(std::memory_order_relaxed) ||
+            sharding_.load(std::memory_order_relaxed)) {
+            // connections parked by other threads go to the idle list first
+            std::list<std::unique_ptr<PooledConn>> slotted;
+            TakeSlots(Clock::duration::zero(), &slotted);
+            if (!slotted.empty()) {
+                waiters_.fetch_sub(1);
+                idle_.splice(idle_.end(), slotted);
+                continue;
+            }
+        }
+        wait_count_++;
+        waited = true;
+        Clock::time_point wait_start = Clock::now();
+        if (wait_timeout_ > Clock::duration::zero()) {
+            std::cv_status status = cv_.wait_until(lock, deadline);
+            waiters_.fetch_sub(1);
+            Clock::duration d = Clock::now() - wait_start;
+            waited_for += d;
+            wait_duration_ += d;
+            if (status == std::cv_status::timeout && idle_.empty() &&
+                max_open_ > 0 && num_open_ >= max_open_) {
+                metrics.pool_wait.Observe(waited_for);
+                throw Exception(408,
+                                "sqlcc: timeout waiting for a connection");
+            }
+        } else {
+            cv_.wait(lock);
+            waiters_.fetch_sub(1);
+            Clock::duration d = Clock::now() - wait_start;
+            waited_for += d;
+            wait_duration_ += d;
+        }
+    }
+}
+
+void ConnPool::Release(std::unique_ptr<PooledConn> pc) {
+    if ((affinity_.load(std::memory_order_relaxed) ||
+         sharding_.load(std::memory_order_relaxed)) &&
+        ReleaseToSlot(pc)) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mu_);
+    pc->returned_at = Clock::now();
+    Expiry expiry = Expired(*pc, pc->returned_at);
+    if (!closed_ && expiry == Expiry::kNone &&
+        static_cast<int>(idle_.size()) +
+                slotted_.load(std::memory_order_relaxed) <
+            max_idle_) {
+        idle_.push_back(std::move(pc));
+        cv_.notify_one();
+        return;
+    }
+    if (expiry == Expiry::kMaxLifetime) {
+        max_lifetime_closed_++;
+    } else if (expiry == Expiry::kInvalid) {
+        invalid_closed_++;
+    } else if (!closed_) {
+        max_idle_closed_++;
+    }
+    num_open_--;
+    metrics.conn_closes.Add();
+    cv_.notify_one();
+    lock.unlock();
+    pc.reset();
+}
+
+void ConnPool::Close() {
+    std::list<std::unique_ptr<PooledConn>> closing;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        closed_ = true;
+        affinity_.store(false, std::memory_order_relaxed);
+        sharding_.store(false, std::memory_order_relaxed);
+        TakeSlots(Clock::duration::zero(), &closing);
+        closing.splice(closing.end(), idle_);
+        num_open_ -= static_cast<int>(closing.size());
+        metrics.conn_closes.Add(closing.size());
+        cv_.notify_all();
+        health_check_cv_.notify_all();
+    }
+    if (health_check_thread_.joinable()) {
+        health_check_thread_.join();
+    }
+}
+
+void ConnPool::HealthCheck() {
+    std::list<std::unique_ptr<PooledConn>> closing;
+    std::list<std::unique_ptr<PooledConn>> checking;
+    std::unique_lock<std::mutex> lock(mu_);
+    // slotted connections unused for a period are checked like idle ones,
+    // their thread may be gone
+    TakeSlots(health_check_period_, &idle_);
+    ShrinkIdleLocked(&closing);
+    Clock::time_point now = Clock::now();
+    for (auto it = idle_.begin(); it != idle_.end();) {
+        Expiry expiry = Expired(**it, now);
+        if (expiry == Expiry::kNone) {
+            if (now - (*it)->returned_at >= health_check_period_) {
+                // out of the idle list while pinged, nobody else uses it
+                checking.push_back(std::move(*it));
+                it = idle_.erase(it);
+            } else {
+                ++it;
+            }
+            continue;
+        }
+        if (expiry == Expiry::kMaxLifetime) {
+            max_lifetime_closed_++;
+        } else if (expiry == Expiry::kMaxIdleTime) {
+            max_idle_time_closed_++;
+        } else {
+            invalid_closed_++;
+        }
+        num_open_--;
+        metrics.conn_closes.Add();
+        closing.push_back(std::move(*it));
+        it = idle_.erase(it);
+    }
+    cv_.notify_all();
+    lock.unlock();
+    closing.clear();
+
+    for (auto& pc : checking) {
+        bool ok;
+        try {
+            pc->conn->Ping();
+            ok = pc->conn->IsValid();
+        } catch (...) {
+            ok = false;
+        }
+        lock.lock();
+        if (ok && !closed_ && static_cast<int>(idle_.size()) < max_idle_) {
+            // still the least recently used ones
+            idle_.push_front(std::move(pc));
+        } else {
+            if (!ok) {
+                invalid_closed_++;
+            } else if (!closed_) {
+                max_idle_closed_++;
+            }
+            num_open_--;
+            metrics.conn_closes.Add();
+            closing.push_back(std::move(pc));
+        }
+        cv_.notify_one();
+        lock.unlock();
+        closing.clear();
+    }
+
+    lock.lock();
+    while (!closed_ && static_cast<int>(idle_.size()) < min_idle_ &&
+           static_cast<int>(idle_.size()) < max_idle_ &&
+           (max_open_ <= 0 || num_open_ < max_open_)) {
+        num_open_++;
+        std::size_t stmt_cache_size = stmt_cache_size_;
+        lock.unlock();
+        std::unique_ptr<PooledConn> pc;
+        try {
+            pc = Open(stmt_cache_size);
+        } catch (...) {
+            // retried on the next check
+            return;
+        }
+        lock.lock();
+        if (closed_) {
+            num_open_--;
+            metrics.conn_closes.Add();
+            lock.unlock();
+            return;
+        }
+        idle_.push_back(std::move(pc));
+        cv_.notify_one();
+    }
+}
+
+void ConnPool::HealthCheckLoop() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!closed_) {
+        if (health_check_period_ <= Clock::duration::zero()) {
+            health_check_cv_.wait(lock);
+            continue;
+        }
+        if (health_check_cv_.wait_for(lock, health_check_period_) ==
+                std::cv_status::no_timeout ||
+            closed_) {
+            // a new period or Close, the wait starts over
+            continue;
+        }
+        lock.unlock();
+        HealthCheck();
+        lock.lock();
+    }
+}
+
+void ConnPool::ShrinkIdleLocked(
+    std::list<std::unique_ptr<PooledConn>>* closing) {
+    while (static_cast<int>(idle_.size()) > max_idle_) {
+        // drop the least recently used ones first
+        closing->push_back(std::move(idle_.front()));
+        idle_.pop_front();
+        num_open_--;
+        metrics.conn_closes.Add();
+        max_idle_closed_++;
+    }
+}
+
+void ConnPool::SetMaxOpenConns(int n) {
+    std::list<std::unique_ptr<PooledConn>> closing;
+    std::lock_guard<std::mutex> lock(mu_);
+    max_open_ = n < 0 ? 0 : n;
+    if (max_open_ > 0 && max_idle_ > max_open_) {
+        max_idle_ = max_open_;
+        ShrinkIdleLocked(&closing);
+    }
+    cv_.notify_all();
+}
+
+void ConnPool::SetMaxIdleConns(int n) {
+    std::list<std::unique_ptr<PooledConn>> closing;
+    std::lock_guard<std::mutex> lock(mu_);
+    max_idle_ = n < 0 ? 0 : n;
+    if (max_open_ > 0 && max_idle_ > max_open_) {
+        max_idle_ = max_open_;
+    }
+    ShrinkIdleLocked(&closing);
+}
+
+void ConnPool::SetConnMaxLifetime(Clock::duration d) {
+    std::lock_guard<std::mutex> lock(mu_);
+    max_lifetime_ = d;
+}
+
+void ConnPool::SetConnMaxIdleTime(Clock::duration d) {
+    std::lock_guard<std::mutex> lock(mu_);
+    max_idle_time_ = d;
+}
+
+void ConnPool::SetWaitTimeout(Clock::duration d) {
+    std::lock_guard<std::mutex> lock(mu_);
+    wait_timeout_ = d;
+}
+
+void ConnPool::SetStmtCacheSize(int n) {
+    std::list<std::unique_ptr<PooledConn>> closing;
+    std::lock_guard<std::mutex> lock(mu_);
+    stmt_cache_size_ = n < 0 ? 0 : n;
+    // slotted connections get the new size on the idle list
+    TakeSlots(Clock::duration::zero(), &idle_);
+    ShrinkIdleLocked(&closing);
+    for (auto& pc : idle_) {
+        pc->stmts.SetCapacity(stmt_cache_size_);
+    }
+}
+
+void ConnPool::SetMinIdleConns(int n) {
+    std::lock_guard<std::mutex> lock(mu_);
+    min_idle_ = n < 0 ? 0 : n;
+}
+
+void ConnPool::SetHealthCheckPeriod(Clock::duration d) {
+    std::lock_guard<std::mutex> lock(mu_);
+    health_check_period_ = d;
+    if (d > Clock::duration::zero() && !closed_ &&
+        !health_check_thread_.joinable()) {
+        health_check_thread_ = std::thread(&ConnPool::HealthCheckLoop, this);
+    }
+    health_check_cv_.notify_all();
+}
+
+void ConnPool::SetThreadAffinity(bool on) {
+    std::list<std::unique_ptr<PooledConn>> closing;
+    std::lock_guard<std::mutex> lock(mu_);
+    if (closed_) {
+        return;
+    }
+    affinity_.store(on, std::memory_order_relaxed);
+    if (!on) {
+        TakeSlots(Clock::duration::zero(), &idle_);
+        ShrinkIdleLocked(&closing);
+        cv_.notify_all();
+    }
+}
+
+void ConnPool::SetSharding(bool on) {
+    std::list<std::unique_ptr<PooledConn>> closing;
+    std::lock_guard<std::mutex> lock(mu_);
+    if (closed_) {
+        return;
+    }
+    if (on && !shards_) {
+        // published by the store below, never replaced
+        shards_.reset(new Shard[num_shards_]);
+    }
+    sharding_.store(on, std::memory_order_release);
+    if (!on) {
+        TakeSlots(Clock::duration::zero(), &idle_);
+        ShrinkIdleLocked(&closing);
+        cv_.notify_all();
+    }
+}
+
+void ConnPool::SetPhaseMetrics(bool on) {
+    phase_metrics_.store(on, std::memory_order_relaxed);
+}
+
+void ConnPool::AddInterceptor(std::shared_ptr<Interceptor> interceptor) {
+    std::lock_guard<std::mutex> lock(mu_);
+    std::unique_ptr<InterceptorChain> chain(new InterceptorChain);
+    if (!chains_.empty()) {
+        *chain = *chains_.back();
+    }
+    chain->push_back(std::move(interceptor));
+    interceptors_.store(chain.get(), std::memory_order_release);
+    chains_.push_back(std::move(chain));
+}
+
+DBStats ConnPool::Stats() {
+    std::lock_guard<std::mutex> lock(mu_);
+    DBStats stats;
+    stats.max_open_connections = max_open_;
+    stats.open_connections = num_open_;
+    stats.idle = static_cast<int>(idle_.size()) + slotted_.load(std::memory_order_relaxed);
+    stats.in_use = num_open_ - stats.idle;
+    stats.wait_count = wait_count_;
+    stats.wait_duration =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(wait_duration_);
+    stats.max_idle_closed = max_idle_closed_;
+    stats.max_idle_time_closed = max_idle_time_closed_;
+    stats.max_lifetime_closed = max_lifetime_closed_;
+    stats.invalid_closed = invalid_closed_;
+    stats.stmt_cache_hits = stmt_cache_hits.load(std::memory_order_relaxed);
+    stats.stmt_cache_misses = stmt_cache_misses.load(std::memory_order_relaxed);
+    stats.stmt_cache_evictions =
+        stmt_cache_evictions.load(std::memory_order_relaxed);
+    return stats;
+}
+
+MetricsSnapshot ConnPool::Snapshot() {
+    MetricsSnapshot s;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        s.open_connections = num_open_;
+        s.idle = static_cast<int>(idle_.size()) + slotted_.load(std::memory_order_relaxed);
+        s.in_use = num_open_ - s.idle;
+    }
+    s.conn_opens = metrics.conn_opens.Value();
+    s.conn_closes = metrics.conn_closes.Value();
+    s.pool_wait = metrics.pool_wait.Snapshot();
+    s.prepare = metrics.prepare.Snapshot();
+    s.execute = metrics.execute.Snapshot();
+    s.fetch = metrics.fetch.Snapshot();
+    s.decode = metrics.decode.Snapshot();
+    s.bytes_received = metrics.bytes_received.Value();
+    return s;
+}
+
+}  // namespace sqlcc
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "sqlcc/interceptor.h"
+#include "sqlcc/sqlcc.h"
+
+#include "stmt_cache.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sqlcc {
+
+using Clock = std::chrono::steady_clock;
+
+// PooledConn is a driver connection together with the bookkeeping the pool
+// needs to decide when it has to be thrown away.
+struct PooledConn {
+    std::shared_ptr<driver::Conn> conn;
+    // declared after conn so cached statements are closed first
+    StmtCache stmts;
+    Clock::time_point created_at;
+    Clock::time_point returned_at;
+    // share of the max lifetime cut from this connection, so connections
+    // opened together don't expire together
+    double lifetime_jitter;
+};
+
+// ConnPool hands out driver connections to at most one user at a time, just
+// like the free connection list of golang database/sql.
+class ConnPool {
+public:
+    explicit ConnPool(std::shared_ptr<driver::Connector> connector);
+    ~ConnPool();
+    // Acquire returns an idle connection or opens a new one, blocking up to
+    // the wait timeout when max open connections is reached.
+    std::unique_ptr<PooledConn> Acquire();
+    // Release gives the connection back, closing it if it is expired or the
+    // idle list is full.
+    void Release(std::unique_ptr<PooledConn> pc);
+    void Close();
+    void SetMaxOpenConns(int n);
+    void SetMaxIdleConns(int n);
+    void SetConnMaxLifetime(Clock::duration d);
+    void SetConnMaxIdleTime(Clock::duration d);
+    void SetWaitTimeout(Clock::duration d);
+    void SetStmtCacheSize(int n);
+    // SetMinIdleConns makes the health check open connections until n are
+    // idle, within the max idle and max open limits
+    void SetMinIdleConns(int n);
+    // SetHealthCheckPeriod runs the health check every d on a thread of
+    // the pool, <= 0 stops it. It closes expired idle connections, pings
+    // those idle for d or more and tops up the min idle connections.
+    void SetHealthCheckPeriod(Clock::duration d);
+    // SetThreadAffinity keeps a released connection in a slot of the
+    // releasing thread, Acquire on that thread takes it back without the
+    // pool lock. Threads map to slots by a number taken on first use, more
+    // threads than slots share them. Waiters for a connection take the
+    // slotted ones, the health check reclaims those of threads gone idle.
+    void SetThreadAffinity(bool on);
+    // SetSharding parks released connections in per-CPU shards, taken and
+    // returned with atomic swaps. Acquire looks at the shard of its CPU,
+    // then steals from the next kStealShards, before taking the pool lock.
+    // Thread affinity goes first when both are on.
+    void SetSharding(bool on);
+    // SetPhaseMetrics hands metrics to the driver connections, from their
+    // next Acquire on
+    void SetPhaseMetrics(bool on);
+    DBStats Stats();
+    MetricsSnapshot Snapshot();
+    void AddInterceptor(std::shared_ptr<Interceptor> interceptor);
+    // Interceptors returns the installed chain, nullptr when there is none,
+    // so the check costs a single load. A chain stays valid as long as the
+    // pool.
+    const InterceptorChain* Interceptors() const {
+        return interceptors_.load(std::memory_order_acquire);
+    }
+
+    // statement cache counters, updated by the connection owner
+    std::atomic<int64_t> stmt_cache_hits;
+    std::atomic<int64_t> stmt_cache_misses;
+    std::atomic<int64_t> stmt_cache_evictions;
+
+    driver::Metrics metrics;
+
+private:
+    enum class Expiry { kNone, kMaxLifetime, kMaxIdleTime, kInvalid };
+    Expiry Expired(const PooledConn& pc, Clock::time_point now) const;
+    // ThreadSlot holds the connection of a thread, alone on its cache line
+    // as threads swap it concurrently
+    struct alignas(64) ThreadSlot {
+        std::atomic<PooledConn*> conn{nullptr};
+    };
+    static const std::size_t kThreadSlots = 64;
+    // Shard holds the connections parked on a CPU in one cache line
+    static const std::size_t kShardSlots = 8;
+    struct alignas(64) Shard {
+        std::atomic<PooledConn*> conns[kShardSlots] = {};
+    };
+    static const std::size_t kStealShards = 3;
+    std::atomic<PooledConn*>& CurrentThreadSlot();
+    Shard& CurrentShard(std::size_t offset);
+    // TakeSlot and PutSlot swap a connection out of and into slot, keeping
+    // slotted_ up to date. PutSlot fails when slot is taken.
+    std::unique_ptr<PooledConn> TakeSlot(std::atomic<PooledConn*>& slot);
+    bool PutSlot(std::atomic<PooledConn*>& slot,
+                 std::unique_ptr<PooledConn>& pc);
+    // AcquireFromSlot takes the connection of the thread slot or a shard
+    std::unique_ptr<PooledConn> AcquireFromSlot();
+    // ReleaseToSlot parks pc in the slot of the thread or its shard, false
+    // when they are taken, max idle connections are parked or somebody
+    // waits for a connection
+    bool ReleaseToSlot(std::unique_ptr<PooledConn>& pc);
+    // TakeSlots moves the slotted connections idle for at least idle_for
+    // out of their slots
+    void TakeSlots(Clock::duration idle_for,
+                   std::list<std::unique_ptr<PooledConn>>* out);
+    // DiscardLocked accounts for a connection closed for expiry, the
+    // caller closes it once the lock is released
+    void DiscardLocked(Expiry expiry);
+    // Open connects a new connection, num_open_ already counts it
+    std::unique_ptr<PooledConn> Open(std::size_t stmt_cache_size);
+    void ShrinkIdleLocked(std::list<std::unique_ptr<PooledConn>>* closing);
+    std::unique_ptr<PooledConn> Handout(std::unique_ptr<PooledConn> pc);
+    void HealthCheck();
+    void HealthCheckLoop();
+
+    std::shared_ptr<driver::Connector> connector_;
+    std::atomic<bool> phase_metrics_;
+    std::atomic<const InterceptorChain*> interceptors_;
+    std::atomic<bool> affinity_;
+    std::atomic<bool> sharding_;
+    // threads blocked in Acquire, they get connections before slots do
+    std::atomic<int> waiters_;
+    // connections parked in slots, they count as idle
+    std::atomic<int> slotted_;
+    std::unique_ptr<ThreadSlot[]> thread_slots_;
+    const std::size_t num_shards_;
+    // allocated on the first SetSharding(true)
+    std::unique_ptr<Shard[]> shards_;
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    // most recently returned connection at the back
+    std::list<std::unique_ptr<PooledConn>> idle_;
+    int num_open_;
+    int max_open_;
+    // atomic for the slot fast path too
+    std::atomic<int> max_idle_;
+    // atomic so the slot fast path can check expiry without the lock
+    std::atomic<Clock::duration> max_lifetime_;
+    std::atomic<Clock::duration> max_idle_time_;
+    Clock::duration wait_timeout_;
+    std::size_t stmt_cache_size_;
+    int min_idle_;
+    Clock::duration health_check_period_;
+    bool closed_;
+    std::condition_variable health_check_cv_;
+    std::thread health_check_thread_;
+
+    int64_t wait_count_;
+    Clock::duration wait_duration_;
+    int64_t max_idle_closed_;
+    int64_t max_idle_time_closed_;
+    int64_t max_lifetime_closed_;
+    int64_t invalid_closed_;
+    // every chain ever installed, replaced chains may still be in use
+    std::vector<std::unique_ptr<InterceptorChain>> chains_;
+};
+
+}  // namespace sqlcc
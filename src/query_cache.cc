@@ -0,0 +1,526 @@
+#include "sqlcc/query_cache.h"
+
+#include "buffered_rows.h"
+
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace sqlcc {
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// SQL words that can follow a table name, anything else there is an alias
+const std::unordered_set<std::string> kAfterTable = {
+    "where", "join",   "on",    "left",      "right",  "inner",
+    "outer", "cross",  "natural", "straight_join", "group", "order",
+    "limit", "having", "union", "set",       "values", "value",
+    "select", "partition", "using", "lock",  "for",    "window",
+    "use",   "force",  "ignore", "default",  "as",     "into"};
+
+// Tokens splits query into lower cased words and single punctuation
+// characters, dropping literals and comments
+std::vector<std::string> Tokens(const std::string& query) {
+    std::vector<std::string> tokens;
+    std::size_t i = 0;
+    std::size_t n = query.size();
+    while (i < n) {
+        char c = query[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            i++;
+        } else if (c == '\'' || c == '"') {
+            for (i++; i < n && query[i] != c; i++) {
+                if (query[i] == '\\') {
+                    i++;
+                }
+            }
+            i++;
+            tokens.emplace_back("'");
+        } else if (c == '#' || (c == '-' && query.compare(i, 2, "--") == 0)) {
+            i = query.find('\n', i);
+            i = i == std::string::npos ? n : i;
+        } else if (c == '/' && query.compare(i, 2, "/*") == 0) {
+            i = query.find("*/", i + 2);
+            i = i == std::string::npos ? n : i + 2;
+        } else if (c == '`') {
+            std::size_t end = query.find('`', i + 1);
+            end = end == std::string::npos ? n : end;
+            std::string word = query.substr(i + 1, end - i - 1);
+            std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+            tokens.push_back(std::move(word));
+            i = end + 1;
+        } else if (std::isalnum(static_cast<unsigned char>(c)) || c == '_' ||
+                   c == '$') {
+            std::size_t start = i;
+            while (i < n && (std::isalnum(static_cast<unsigned char>(
+                                 query[i])) ||
+                             query[i] == '_' || query[i] == '$')) {
+                i++;
+            }
+            std::string word = query.substr(start, i - start);
+            std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+            tokens.push_back(std::move(word));
+        } else {
+            tokens.emplace_back(1, c);
+            i++;
+        }
+    }
+    return tokens;
+}
+
+bool IsWord(const std::string& token) {
+    return !token.empty() && token != "'" &&
+           (std::isalnum(static_cast<unsigned char>(token[0])) ||
+            token[0] == '_' || token[0] == '$' || token.size() > 1);
+}
+
+// modifiers between INSERT or REPLACE and the table
+const std::unordered_set<std::string> kInsertModifiers = {
+    "low_priority", "delayed", "high_priority", "ignore"};
+
+// Tables returns the tables named after FROM, JOIN, INTO, UPDATE, TABLE
+// and INSERT or REPLACE, whose INTO is optional. It errs on the side of
+// finding too many, a function like EXTRACT(YEAR FROM d) names a table d.
+std::vector<std::string> Tables(const std::string& query) {
+    std::vector<std::string> tokens = Tokens(query);
+    std::vector<std::string> tables;
+    for (std::size_t i = 0; i < tokens.size(); i++) {
+        const std::string& t = tokens[i];
+        std::size_t j = i + 1;
+        if (t == "insert" || t == "replace") {
+            while (j < tokens.size() && kInsertModifiers.count(tokens[j])) {
+                j++;
+            }
+            if (j < tokens.size() && tokens[j] == "into") {
+                j++;
+            }
+        } else if (t == "into") {
+            // LOAD DATA ... INTO TABLE t
+            if (j < tokens.size() && tokens[j] == "table") {
+                j++;
+            }
+        } else if (t != "from" && t != "join" && t != "update" &&
+                   t != "table") {
+            continue;
+        }
+        while (j < tokens.size() && IsWord(tokens[j]) &&
+               kAfterTable.count(tokens[j]) == 0) {
+            std::string table = tokens[j++];
+            // schema.table
+            while (j + 1 < tokens.size() && tokens[j] == "." &&
+                   IsWord(tokens[j + 1])) {
+                table = tokens[j + 1];
+                j += 2;
+            }
+            tables.push_back(std::move(table));
+            if (j < tokens.size() && tokens[j] == "as") {
+                j++;
+            }
+            if (j < tokens.size() && IsWord(tokens[j]) &&
+                kAfterTable.count(tokens[j]) == 0) {
+                j++;
+            }
+            if (j >= tokens.size() || tokens[j] != ",") {
+                break;
+            }
+            j++;
+        }
+        i = j - 1;
+    }
+    return tables;
+}
+
+template <typename T>
+void AppendRaw(std::string& key, const T& v) {
+    key.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+void AppendKey(std::string& key, const std::string& v) {
+    AppendRaw(key, v.size());
+    key.append(v);
+}
+
+void AppendKey(std::string& key, const std::tm& v) {
+    int fields[] = {v.tm_year, v.tm_mon, v.tm_mday,
+                    v.tm_hour, v.tm_min, v.tm_sec};
+    AppendRaw(key, fields);
+}
+
+void AppendKey(std::string& key, const driver::TimePoint& v) {
+    AppendRaw(key, v.time_since_epoch().count());
+}
+
+template <typename T>
+void AppendKey(std::string& key, const T& v) {
+    AppendRaw(key, v);
+}
+
+template <typename T>
+void AppendKey(std::string& key, const driver::NullValue<T>& v) {
+    key.push_back(v ? 1 : 0);
+    if (v) {
+        AppendKey(key, *v);
+    }
+}
+
+std::string Key(const std::string& query,
+                const std::vector<driver::Value>& args) {
+    std::string key = query;
+    key.push_back('\0');
+    for (const driver::Value& arg : args) {
+        key.push_back(static_cast<char>(arg.index()));
+        std::visit([&key](auto&& v) { AppendKey(key, v); }, arg);
+    }
+    return key;
+}
+
+using ResultFuture = std::shared_future<std::shared_ptr<const BufferedResult>>;
+
+// QueryCache holds the cached results, shared with the interceptor that
+// sees the writes
+class QueryCache {
+   public:
+    explicit QueryCache(const QueryCacheOptions& opts);
+    // Plan returns the indexes of the declared tables a query reads, false
+    // when it reads another table or none
+    bool Plan(const std::string& query, std::vector<std::size_t>* tables);
+    // Get returns the result cached for key, or the one of run
+    std::shared_ptr<const BufferedResult> Get(
+        const std::vector<std::size_t>& tables, const std::string& key,
+        const std::function<Rows()>& run);
+    // Written invalidates the declared tables written by query
+    void Written(const std::string& query);
+    void Invalidate(const std::string& table);
+    void Clear();
+    QueryCacheStats Stats();
+
+   private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const BufferedResult> result;
+        std::vector<std::size_t> tables;
+        Clock::time_point expires_at;
+        std::size_t bytes;
+    };
+    using EntryList = std::list<Entry>;
+
+    void InvalidateLocked(std::size_t table);
+    void EraseLocked(EntryList::iterator it);
+    void InsertLocked(Entry entry);
+
+    const QueryCacheOptions opts_;
+    std::unordered_map<std::string, std::size_t> table_index_;
+
+    std::mutex mu_;
+    // most recently used first
+    EntryList lru_;
+    std::unordered_map<std::string_view, EntryList::iterator> entries_;
+    // per declared table, the entries reading it and a count of writes
+    std::vector<std::unordered_set<Entry*>> readers_;
+    std::vector<uint64_t> generations_;
+    std::unordered_map<std::string, ResultFuture> flights_;
+    // query text to the declared tables read, -1 marking uncached ones
+    std::unordered_map<std::string, std::vector<std::size_t>> plans_;
+    QueryCacheStats stats_;
+};
+
+const std::size_t kMaxPlans = 4096;
+const std::size_t kNotCached = std::size_t(-1);
+
+QueryCache::QueryCache(const QueryCacheOptions& opts) : opts_(opts) {
+    for (std::string table : opts_.tables) {
+        std::transform(table.begin(), table.end(), table.begin(), ::tolower);
+        table_index_.emplace(table, table_index_.size());
+    }
+    readers_.resize(table_index_.size());
+    generations_.resize(table_index_.size());
+}
+
+bool QueryCache::Plan(const std::string& query,
+                      std::vector<std::size_t>* tables) {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = plans_.find(query);
+        if (it != plans_.end()) {
+            *tables = it->second;
+            return tables->empty() || (*tables)[0] != kNotCached;
+        }
+    }
+    std::vector<std::size_t> plan;
+    for (const std::string& table : Tables(query)) {
+        auto it = table_index_.find(table);
+        if (it == table_index_.end()) {
+            plan.assign(1, kNotCached);
+            break;
+        }
+        if (std::find(plan.begin(), plan.end(), it->second) == plan.end()) {
+            plan.push_back(it->second);
+        }
+    }
+    if (plan.empty()) {
+        // SELECT NOW() and the like
+        plan.assign(1, kNotCached);
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    if (plans_.size() >= kMaxPlans) {
+        plans_.clear();
+    }
+    plans_.emplace(query, plan);
+    *tables = plan;
+    return plan[0] != kNotCached;
+}
+
+std::shared_ptr<const BufferedResult> QueryCache::Get(
+    const std::vector<std::size_t>& tables, const std::string& key,
+    const std::function<Rows()>& run) {
+    std::promise<std::shared_ptr<const BufferedResult>> promise;
+    std::vector<uint64_t> generations;
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            if (it->second->expires_at > Clock::now()) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                stats_.hits++;
+                return it->second->result;
+            }
+            EraseLocked(it->second);
+        }
+        auto flight = flights_.find(key);
+        if (flight != flights_.end()) {
+            ResultFuture future = flight->second;
+            stats_.shared++;
+            lock.unlock();
+            return future.get();
+        }
+        stats_.misses++;
+        flights_.emplace(key, promise.get_future().share());
+        for (std::size_t t : tables) {
+            generations.push_back(generations_[t]);
+        }
+    }
+
+    std::shared_ptr<const BufferedResult> result;
+    try {
+        Rows rows = run();
+        result = Buffer(*rows);
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            flights_.erase(key);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        flights_.erase(key);
+        bool fresh = true;
+        for (std::size_t i = 0; i < tables.size(); i++) {
+            // a write ran along the query, its result may predate it
+            fresh = fresh && generations_[tables[i]] == generations[i];
+        }
+        Entry entry;
+        entry.bytes = result->Bytes() + key.size();
+        if (fresh && opts_.ttl > std::chrono::milliseconds::zero() &&
+            entry.bytes <= opts_.max_entry_bytes &&
+            entry.bytes <= opts_.max_bytes) {
+            entry.key = key;
+            entry.result = result;
+            entry.tables = tables;
+            entry.expires_at = Clock::now() + opts_.ttl;
+            InsertLocked(std::move(entry));
+        }
+    }
+    promise.set_value(result);
+    return result;
+}
+
+void QueryCache::InsertLocked(Entry entry) {
+    while (!lru_.empty() && stats_.bytes + entry.bytes > opts_.max_bytes) {
+        EraseLocked(std::prev(lru_.end()));
+        stats_.evictions++;
+    }
+    lru_.push_front(std::move(entry));
+    Entry& e = lru_.front();
+    entries_.emplace(e.key, lru_.begin());
+    for (std::size_t t : e.tables) {
+        readers_[t].insert(&e);
+    }
+    stats_.bytes += e.bytes;
+    stats_.entries++;
+}
+
+void QueryCache::EraseLocked(EntryList::iterator it) {
+    for (std::size_t t : it->tables) {
+        readers_[t].erase(&*it);
+    }
+    stats_.bytes -= it->bytes;
+    stats_.entries--;
+    entries_.erase(it->key);
+    lru_.erase(it);
+}
+
+void QueryCache::InvalidateLocked(std::size_t table) {
+    generations_[table]++;
+    std::unordered_set<Entry*> readers;
+    readers.swap(readers_[table]);
+    for (Entry* e : readers) {
+        auto it = entries_.find(e->key);
+        EraseLocked(it->second);
+        stats_.invalidations++;
+    }
+}
+
+void QueryCache::Written(const std::string& query) {
+    std::vector<std::string> tables = Tables(query);
+    std::lock_guard<std::mutex> lock(mu_);
+    for (const std::string& table : tables) {
+        auto it = table_index_.find(table);
+        if (it != table_index_.end()) {
+            InvalidateLocked(it->second);
+        }
+    }
+}
+
+void QueryCache::Invalidate(const std::string& table) {
+    std::string name = table;
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    auto it = table_index_.find(name);
+    if (it == table_index_.end()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    InvalidateLocked(it->second);
+}
+
+void QueryCache::Clear() {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (std::size_t t = 0; t < generations_.size(); t++) {
+        generations_[t]++;
+    }
+    while (!lru_.empty()) {
+        EraseLocked(lru_.begin());
+    }
+}
+
+QueryCacheStats QueryCache::Stats() {
+    std::lock_guard<std::mutex> lock(mu_);
+    return stats_;
+}
+
+// WriteObserver invalidates the tables written by the statements of the
+// cached database, failed ones included as they may have written some
+class WriteObserver : public Interceptor {
+   public:
+    explicit WriteObserver(std::weak_ptr<QueryCache> cache)
+        : cache_(std::move(cache)) {}
+    void After(const Event& e) override {
+        if (e.op != Op::kExec && e.op != Op::kExecMany) {
+            return;
+        }
+        if (std::shared_ptr<QueryCache> cache = cache_.lock()) {
+            cache->Written(e.query);
+        }
+    }
+
+   private:
+    std::weak_ptr<QueryCache> cache_;
+};
+
+}  // namespace
+
+class CachedDatabaseImpl : public CachedDatabase {
+   public:
+    CachedDatabaseImpl(DB db, const QueryCacheOptions& opts)
+        : db_(db), cache_(std::make_shared<QueryCache>(opts)) {
+        db_->AddInterceptor(std::make_shared<WriteObserver>(cache_));
+    }
+    void Invalidate(const std::string& table) override {
+        cache_->Invalidate(table);
+    }
+    void Clear() override { cache_->Clear(); }
+    QueryCacheStats CacheStats() override { return cache_->Stats(); }
+    std::shared_ptr<Connection> Conn() override { return db_->Conn(); }
+    Tx Begin() override { return db_->Begin(); }
+    std::shared_ptr<Pipeline> NewPipeline() override {
+        return db_->NewPipeline();
+    }
+    void Ping() override { db_->Ping(); }
+    void Close() override { db_->Close(); }
+    std::shared_ptr<driver::Driver> Driver() override { return db_->Driver(); }
+    void SetMaxOpenConns(int n) override { db_->SetMaxOpenConns(n); }
+    void SetMaxIdleConns(int n) override { db_->SetMaxIdleConns(n); }
+    void SetConnMaxLifetime(std::chrono::milliseconds d) override {
+        db_->SetConnMaxLifetime(d);
+    }
+    void SetConnMaxIdleTime(std::chrono::milliseconds d) override {
+        db_->SetConnMaxIdleTime(d);
+    }
+    void SetConnWaitTimeout(std::chrono::milliseconds d) override {
+        db_->SetConnWaitTimeout(d);
+    }
+    void SetStmtCacheSize(int n) override { db_->SetStmtCacheSize(n); }
+    void SetMinIdleConns(int n) override { db_->SetMinIdleConns(n); }
+    void SetHealthCheckPeriod(std::chrono::milliseconds d) override {
+        db_->SetHealthCheckPeriod(d);
+    }
+    void SetThreadAffinity(bool on) override { db_->SetThreadAffinity(on); }
+    void SetSharding(bool on) override { db_->SetSharding(on); }
+    DBStats Stats() override { return db_->Stats(); }
+    void SetPhaseMetrics(bool on) override { db_->SetPhaseMetrics(on); }
+    MetricsSnapshot Metrics() override { return db_->Metrics(); }
+    void AddInterceptor(std::shared_ptr<Interceptor> interceptor) override {
+        db_->AddInterceptor(interceptor);
+    }
+    Stmt Prepare(const std::string& query) override {
+        return db_->Prepare(query);
+    }
+
+   protected:
+    Result DoExec(const std::string& query,
+                  const std::vector<driver::Value>& args) override {
+        return db_->DoExec(query, args);
+    }
+    Rows DoQuery(const std::string& query,
+                 const std::vector<driver::Value>& args,
+                 const driver::QueryOptions& opts) override {
+        std::vector<std::size_t> tables;
+        if (!cache_->Plan(query, &tables)) {
+            return db_->DoQuery(query, args, opts);
+        }
+        return std::make_shared<BufferedRows>(
+            cache_->Get(tables, Key(query, args),
+                        [&] { return db_->DoQuery(query, args, opts); }));
+    }
+    std::future<Result> DoExecAsync(
+        const std::string& query,
+        const std::vector<driver::Value>& args) override {
+        return db_->DoExecAsync(query, args);
+    }
+    std::future<Rows> DoQueryAsync(
+        const std::string& query,
+        const std::vector<driver::Value>& args) override {
+        return db_->DoQueryAsync(query, args);
+    }
+
+   private:
+    DB db_;
+    std::shared_ptr<QueryCache> cache_;
+};
+
+std::shared_ptr<CachedDatabase> OpenCached(DB db, QueryCacheOptions opts) {
+    return std::make_shared<CachedDatabaseImpl>(db, opts);
+}
+
+}  // namespace sqlcc
@@ -0,0 +1,472 @@
+#include "sqlcc/replicated.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace sqlcc {
+
+using Clock = std::chrono::steady_clock;
+
+static bool DefaultIsReplicaError(const std::exception_ptr& error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (const Exception& e) {
+        // client side errors of MySQL and pool timeouts, the server errors
+        // would fail on the primary just as well
+        return (e.code >= 2000 && e.code < 3000) || e.code == 408;
+    } catch (...) {
+        return true;
+    }
+}
+
+class Replica {
+   public:
+    Replica(DB db, ReplicaOptions opts)
+        : db(db),
+          opts_(std::move(opts)),
+          in_flight_(0),
+          latency_ns_(0),
+          ejected_until_(0),
+          lagging_(false),
+          lag_ms_(-1),
+          error_rate_(0),
+          requests_(0) {}
+
+    // Available reports whether the replica takes queries at now
+    bool Available(int64_t now) const {
+        return !lagging_.load(std::memory_order_relaxed) &&
+               ejected_until_.load(std::memory_order_relaxed) <= now;
+    }
+    // Score is the expected cost of one more query, lower is better. A
+    // replica without samples scores lowest so that it gets some.
+    double Score() const {
+        return double(latency_ns_.load(std::memory_order_relaxed) + 1) *
+               (in_flight_.load(std::memory_order_relaxed) + 1);
+    }
+    bool IsReplicaError(const std::exception_ptr& error) const {
+        return opts_.is_replica_error(error);
+    }
+    void Start() { in_flight_.fetch_add(1, std::memory_order_relaxed); }
+    void Done() { in_flight_.fetch_sub(1, std::memory_order_relaxed); }
+    // Observe accounts one query, error tells whether it failed with a
+    // replica error
+    void Observe(Clock::duration elapsed, bool error) {
+        std::lock_guard<std::mutex> lock(mu_);
+        requests_++;
+        error_rate_ += opts_.ewma_alpha * ((error ? 1.0 : 0.0) - error_rate_);
+        if (!error) {
+            int64_t ns =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                    .count();
+            int64_t avg = latency_ns_.load(std::memory_order_relaxed);
+            latency_ns_.store(
+                avg == 0 ? ns : int64_t(avg + opts_.ewma_alpha * (ns - avg)),
+                std::memory_order_relaxed);
+        }
+        if (error && requests_ >= opts_.min_requests &&
+            error_rate_ > opts_.max_error_rate) {
+            Clock::duration until = Clock::now().time_since_epoch() +
+                                    opts_.ejection_time;
+            ejected_until_.store(until.count(), std::memory_order_relaxed);
+        }
+    }
+    void SetLag(std::chrono::milliseconds lag, bool known) {
+        lag_ms_.store(known ? lag.count() : -1, std::memory_order_relaxed);
+        lagging_.store(!known || lag > opts_.max_replication_lag,
+                       std::memory_order_relaxed);
+    }
+    ReplicaStatus Status() const {
+        ReplicaStatus s;
+        s.latency = std::chrono::nanoseconds(
+            latency_ns_.load(std::memory_order_relaxed));
+        s.in_flight = in_flight_.load(std::memory_order_relaxed);
+        s.lag = std::chrono::milliseconds(
+            lag_ms_.load(std::memory_order_relaxed));
+        s.lagging = lagging_.load(std::memory_order_relaxed);
+        s.ejected = ejected_until_.load(std::memory_order_relaxed) >
+                    Clock::now().time_since_epoch().count();
+        std::lock_guard<std::mutex> lock(mu_);
+        s.error_rate = error_rate_;
+        s.requests = requests_;
+        return s;
+    }
+
+    const DB db;
+
+   private:
+    const ReplicaOptions opts_;
+    std::atomic<int> in_flight_;
+    std::atomic<int64_t> latency_ns_;
+    // steady clock ticks
+    std::atomic<int64_t> ejected_until_;
+    std::atomic<bool> lagging_;
+    std::atomic<int64_t> lag_ms_;
+    mutable std::mutex mu_;
+    double error_rate_;
+    uint64_t requests_;
+};
+
+// ReplicaRows ends a query routed to a replica once its rows are done,
+// errors while reading count against the replica too. It shares the
+// replica, so rows may outlive the replicated database.
+class ReplicaRows : public SQLRows {
+   public:
+    ReplicaRows(Rows rows, std::shared_ptr<Replica> replica)
+        : rows_(std::move(rows)), replica_(std::move(replica)) {}
+    ~ReplicaRows() { Done(nullptr); }
+    const std::vector<std::string>& Columns() const override {
+        return rows_->Columns();
+    }
+    bool Next() override {
+        try {
+            if (rows_->Next()) {
+                return true;
+            }
+        } catch (...) {
+            Done(std::current_exception());
+            throw;
+        }
+        Done(nullptr);
+        return false;
+    }
+    void Close() override {
+        rows_->Close();
+        Done(nullptr);
+    }
+    int64_t RowCount() override { return rows_->RowCount(); }
+    void Seek(uint64_t row) override { rows_->Seek(row); }
+    std::size_t NextBatch(driver::Batch& batch, std::size_t n) override {
+        try {
+            std::size_t fetched = rows_->NextBatch(batch, n);
+            if (fetched == 0) {
+                Done(nullptr);
+            }
+            return fetched;
+        } catch (...) {
+            Done(std::current_exception());
+            throw;
+        }
+    }
+    void ScanCells(std::vector<driver::Cell>& cells) override {
+        rows_->ScanCells(cells);
+    }
+    std::size_t ReadColumn(std::size_t idx, uint64_t offset, char* buf,
+                           std::size_t size) override {
+        return rows_->ReadColumn(idx, offset, buf, size);
+    }
+
+   protected:
+    void DoScan(std::vector<driver::Value>& dest) override {
+        rows_->DoScan(dest);
+    }
+    void DoScanTyped(const driver::ScanType* types, void* const* dest,
+                     std::size_t size) override {
+        rows_->DoScanTyped(types, dest, size);
+    }
+
+   private:
+    void Done(const std::exception_ptr& error) {
+        if (!replica_) {
+            return;
+        }
+        replica_->Done();
+        if (error) {
+            replica_->Observe(Clock::duration::zero(),
+                              replica_->IsReplicaError(error));
+        }
+        replica_.reset();
+    }
+
+    Rows rows_;
+    std::shared_ptr<Replica> replica_;
+};
+
+class ReplicatedDatabaseImpl : public ReplicatedDatabase {
+   public:
+    ReplicatedDatabaseImpl(DB primary, std::vector<DB> replicas,
+                           ReplicaOptions opts);
+    ~ReplicatedDatabaseImpl();
+    std::vector<ReplicaStatus> Replicas() override;
+    Stmt Prepare(const std::string& query) override {
+        return primary_->Prepare(query);
+    }
+    std::shared_ptr<Connection> Conn() override { return primary_->Conn(); }
+    Tx Begin() override { return primary_->Begin(); }
+    std::shared_ptr<Pipeline> NewPipeline() override {
+        return primary_->NewPipeline();
+    }
+    void Ping() override;
+    void Close() override;
+    std::shared_ptr<driver::Driver> Driver() override {
+        return primary_->Driver();
+    }
+    void SetMaxOpenConns(int n) override {
+        ForEach([n](Database& db) { db.SetMaxOpenConns(n); });
+    }
+    void SetMaxIdleConns(int n) override {
+        ForEach([n](Database& db) { db.SetMaxIdleConns(n); });
+    }
+    void SetConnMaxLifetime(std::chrono::milliseconds d) override {
+        ForEach([d](Database& db) { db.SetConnMaxLifetime(d); });
+    }
+    void SetConnMaxIdleTime(std::chrono::milliseconds d) override {
+        ForEach([d](Database& db) { db.SetConnMaxIdleTime(d); });
+    }
+    void SetConnWaitTimeout(std::chrono::milliseconds d) override {
+        ForEach([d](Database& db) { db.SetConnWaitTimeout(d); });
+    }
+    void SetStmtCacheSize(int n) override {
+        ForEach([n](Database& db) { db.SetStmtCacheSize(n); });
+    }
+    void SetMinIdleConns(int n) override {
+        ForEach([n](Database& db) { db.SetMinIdleConns(n); });
+    }
+    void SetHealthCheckPeriod(std::chrono::milliseconds d) override {
+        ForEach([d](Database& db) { db.SetHealthCheckPeriod(d); });
+    }
+    void SetThreadAffinity(bool on) override {
+        ForEach([on](Database& db) { db.SetThreadAffinity(on); });
+    }
+    void SetSharding(bool on) override {
+        ForEach([on](Database& db) { db.SetSharding(on); });
+    }
+    DBStats Stats() override { return primary_->Stats(); }
+    void SetPhaseMetrics(bool on) override {
+        ForEach([on](Database& db) { db.SetPhaseMetrics(on); });
+    }
+    MetricsSnapshot Metrics() override { return primary_->Metrics(); }
+    void AddInterceptor(std::shared_ptr<Interceptor> interceptor) override {
+        ForEach([&](Database& db) { db.AddInterceptor(interceptor); });
+    }
+
+   protected:
+    Result DoExec(const std::string& query,
+                  const std::vector<driver::Value>& args) override {
+        return primary_->DoExec(query, args);
+    }
+    Rows DoQuery(const std::string& query,
+                 const std::vector<driver::Value>& args,
+                 const driver::QueryOptions& opts) override;
+    std::future<Result> DoExecAsync(
+        const std::string& query,
+        const std::vector<driver::Value>& args) override {
+        return primary_->DoExecAsync(query, args);
+    }
+    std::future<Rows> DoQueryAsync(
+        const std::string& query,
+        const std::vector<driver::Value>& args) override;
+
+   private:
+    template <typename F>
+    void ForEach(F f) {
+        f(*primary_);
+        for (auto& r : replicas_) {
+            f(*r->db);
+        }
+    }
+    std::shared_ptr<Replica> Pick();
+    Rows QueryReplica(std::shared_ptr<Replica> r, const std::string& query,
+                      const std::vector<driver::Value>& args,
+                      const driver::QueryOptions& opts);
+    void CheckLag(Replica& r);
+    void LagLoop();
+
+    DB primary_;
+    ReplicaOptions opts_;
+    std::vector<std::shared_ptr<Replica>> replicas_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stop_;
+    std::thread lag_thread_;
+};
+
+ReplicatedDatabaseImpl::ReplicatedDatabaseImpl(DB primary,
+                                               std::vector<DB> replicas,
+                                               ReplicaOptions opts)
+    : primary_(primary), opts_(std::move(opts)), stop_(false) {
+    if (!opts_.is_replica_error) {
+        opts_.is_replica_error = DefaultIsReplicaError;
+    }
+    for (DB& db : replicas) {
+        replicas_.push_back(std::make_shared<Replica>(db, opts_));
+    }
+    if (!opts_.lag_query.empty() && !replicas_.empty()) {
+        lag_thread_ = std::thread(&ReplicatedDatabaseImpl::LagLoop, this);
+    }
+}
+
+ReplicatedDatabaseImpl::~ReplicatedDatabaseImpl() { Close(); }
+
+void ReplicatedDatabaseImpl::Close() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (lag_thread_.joinable()) {
+        lag_thread_.join();
+    }
+    ForEach([](Database& db) { db.Close(); });
+}
+
+void ReplicatedDatabaseImpl::Ping() {
+    ForEach([](Database& db) { db.Ping(); });
+}
+
+std::vector<ReplicaStatus> ReplicatedDatabaseImpl::Replicas() {
+    std::vector<ReplicaStatus> status;
+    for (auto& r : replicas_) {
+        status.push_back(r->Status());
+    }
+    return status;
+}
+
+std::shared_ptr<Replica> ReplicatedDatabaseImpl::Pick() {
+    thread_local std::minstd_rand rng(std::random_device{}());
+    std::size_t n = replicas_.size();
+    if (n == 0) {
+        return nullptr;
+    }
+    int64_t now = Clock::now().time_since_epoch().count();
+    // one snapshot of the available replicas, the lag thread and Observe
+    // may change them meanwhile
+    thread_local std::vector<std::size_t> available;
+    available.clear();
+    for (std::size_t i = 0; i < n; i++) {
+        if (replicas_[i]->Available(now)) {
+            available.push_back(i);
+        }
+    }
+    if (available.empty()) {
+        return nullptr;
+    }
+    // the better of two random ones
+    const std::shared_ptr<Replica>& a =
+        replicas_[available[rng() % available.size()]];
+    const std::shared_ptr<Replica>& b =
+        replicas_[available[rng() % available.size()]];
+    return b->Score() < a->Score() ? b : a;
+}
+
+Rows ReplicatedDatabaseImpl::QueryReplica(
+    std::shared_ptr<Replica> r, const std::string& query,
+    const std::vector<driver::Value>& args, const driver::QueryOptions& opts) {
+    // the rows end the query once they are done
+    r->Start();
+    Clock::time_point start = Clock::now();
+    Rows rows;
+    try {
+        rows = r->db->DoQuery(query, args, opts);
+    } catch (...) {
+        r->Done();
+        r->Observe(Clock::now() - start,
+                   opts_.is_replica_error(std::current_exception()));
+        throw;
+    }
+    r->Observe(Clock::now() - start, false);
+    return std::make_shared<ReplicaRows>(std::move(rows), std::move(r));
+}
+
+Rows ReplicatedDatabaseImpl::DoQuery(const std::string& query,
+                                     const std::vector<driver::Value>& args,
+                                     const driver::QueryOptions& opts) {
+    std::shared_ptr<Replica> r = Pick();
+    if (r == nullptr) {
+        return primary_->DoQuery(query, args, opts);
+    }
+    try {
+        return QueryReplica(std::move(r), query, args, opts);
+    } catch (...) {
+        if (!opts_.is_replica_error(std::current_exception())) {
+            throw;
+        }
+    }
+    return primary_->DoQuery(query, args, opts);
+}
+
+std::future<Rows> ReplicatedDatabaseImpl::DoQueryAsync(
+    const std::string& query, const std::vector<driver::Value>& args) {
+    std::shared_ptr<Replica> r = Pick();
+    if (r == nullptr) {
+        return primary_->DoQueryAsync(query, args);
+    }
+    return r->db->DoQueryAsync(query, args);
+}
+
+// LagSeconds reads the lag of the current row of rows, false when it is
+// null
+static bool LagSeconds(SQLRows& rows, double* seconds) {
+    const std::vector<std::string>& columns = rows.Columns();
+    std::size_t idx = 0;
+    for (std::size_t i = 0; i < columns.size(); i++) {
+        if (columns[i] == "Seconds_Behind_Source" ||
+            columns[i] == "Seconds_Behind_Master") {
+            idx = i;
+            break;
+        }
+    }
+    std::vector<driver::Cell> cells;
+    rows.ScanCells(cells);
+    const driver::Cell& cell = cells.at(idx);
+    if (cell.IsNull()) {
+        return false;
+    }
+    if (cell.type() == driver::Cell::Type::kString) {
+        *seconds = std::strtod(std::string(cell.AsString()).c_str(), nullptr);
+    } else {
+        *seconds = cell.AsDouble();
+    }
+    return true;
+}
+
+// the probe stays out of the latency and error averages, a failing one
+// leaves the lag unknown
+void ReplicatedDatabaseImpl::CheckLag(Replica& r) {
+    double seconds = 0;
+    bool known = false;
+    try {
+        Rows rows = r.db->DoQuery(opts_.lag_query, {}, driver::QueryOptions());
+        if (rows->Next()) {
+            known = LagSeconds(*rows, &seconds);
+        }
+        rows->Close();
+    } catch (...) {
+    }
+    r.SetLag(std::chrono::milliseconds(int64_t(seconds * 1000)), known);
+}
+
+void ReplicatedDatabaseImpl::LagLoop() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!stop_) {
+        lock.unlock();
+        for (auto& r : replicas_) {
+            CheckLag(*r);
+        }
+        lock.lock();
+        cv_.wait_for(lock, opts_.lag_check_interval, [this] { return stop_; });
+    }
+}
+
+std::shared_ptr<ReplicatedDatabase> OpenReplicated(DB primary,
+                                                   std::vector<DB> replicas,
+                                                   ReplicaOptions opts) {
+    return std::make_shared<ReplicatedDatabaseImpl>(
+        primary, std::move(replicas), std::move(opts));
+}
+
+std::shared_ptr<ReplicatedDatabase> OpenReplicated(
+    const std::string& driver_name, const std::string& primary_dsn,
+    const std::vector<std::string>& replica_dsns, ReplicaOptions opts) {
+    std::vector<DB> replicas;
+    for (const std::string& dsn : replica_dsns) {
+        replicas.push_back(Open(driver_name, dsn));
+    }
+    return OpenReplicated(Open(driver_name, primary_dsn), std::move(replicas),
+                          std::move(opts));
+}
+
+}  // namespace sqlcc
@@ -1,5 +1,8 @@
 #include "sqlcc/sqlcc.h"
 
+#include "buffered_rows.h"
+#include "pool.h"
+
 #include <chrono>
 #include <list>
 #include <atomic>
@@ -30,44 +33,85 @@ int64_t ResultImpl::RowsAffected() {
 class RowsImpl: public SQLRows {
 public:
    public:
-    RowsImpl(std::shared_ptr<StatementImpl> stmt, const std::vector<driver::Value>& args);
-    ~RowsImpl() {}
+    RowsImpl(std::shared_ptr<StatementImpl> stmt, const std::vector<driver::Value>& args,
+             const driver::QueryOptions& opts);
+    RowsImpl(std::shared_ptr<StatementImpl> stmt, std::shared_ptr<driver::SQLRows> driver_rows)
+        : stmt_(stmt), driver_rows_(driver_rows) {}
+    ~RowsImpl() { Close(); }
     const std::vector<std::string> &Columns() const override;
     bool Next() override;
+    void Close() override;
+    int64_t RowCount() override;
+    void Seek(uint64_t row) override;
+    std::size_t NextBatch(driver::Batch &batch, std::size_t n) override;
+    void ScanCells(std::vector<driver::Cell> &cells) override;
+    std::size_t ReadColumn(std::size_t idx, uint64_t offset, char *buf, std::size_t size) override;
    protected:
     void DoScan(std::vector<driver::Value> &dest) override;
+    void DoScanTyped(const driver::ScanType *types, void *const *dest, std::size_t size) override;
    private:
+    friend class StatementImpl;
+    driver::SQLRows &DriverRows() const;
     std::shared_ptr<StatementImpl> stmt_;
     std::shared_ptr<driver::SQLRows> driver_rows_;
+    // set for intercepted queries, the chain sees the end of the rows
+    const InterceptorChain* chain_ = nullptr;
+    std::chrono::steady_clock::time_point start_;
+    int64_t rows_read_ = 0;
+    std::exception_ptr error_;
 };
 
 class StatementImpl: public Statement, public std::enable_shared_from_this<StatementImpl> {
 public:
     StatementImpl(std::shared_ptr<ConnectionImpl> conn, const std::string& query);
-    ~StatementImpl() {};
+    ~StatementImpl();
 protected:
     Result DoExec(const std::vector<driver::Value>& args);
-    Rows DoQuery(const std::vector<driver::Value>& args);
+    Rows DoQuery(const std::vector<driver::Value>& args, const driver::QueryOptions& opts) override;
+    Result DoExecMany(const std::vector<std::vector<driver::Value>>& rows) override;
+    std::future<Result> DoExecAsync(const std::vector<driver::Value>& args) override;
+    std::future<Rows> DoQueryAsync(const std::vector<driver::Value>& args) override;
 private:
     friend class RowsImpl;
+    friend class TransactionImpl;
     friend class DatabaseImpl;
     std::shared_ptr<ConnectionImpl> conn_;
+    std::string query_;
     std::shared_ptr<driver::Stmt> dirver_stmt_;
+    // nullptr without interceptors, which is all the fast path checks
+    const InterceptorChain* chain_;
 };
 
 class ConnectionImpl: public Connection, public std::enable_shared_from_this<ConnectionImpl> {
 public:
-    ConnectionImpl(std::shared_ptr<driver::Conn> conn): driver_conn_(conn) {}
-    ~ConnectionImpl() {}
+    ConnectionImpl(std::shared_ptr<ConnPool> pool, std::unique_ptr<PooledConn> pc);
+    ~ConnectionImpl();
     Stmt Prepare(const std::string& query) override;
+    Tx Begin() override;
+    std::shared_ptr<Pipeline> NewPipeline() override;
 protected:
     std::shared_ptr<StatementImpl> DoPrepare(const std::string& query);
+    // PrepareDriverStmt takes the statement from the statement cache,
+    // preparing a new one on miss.
+    std::shared_ptr<driver::Stmt> PrepareDriverStmt(const std::string& query);
+    void ReleaseDriverStmt(const std::string& query, std::shared_ptr<driver::Stmt> stmt);
 private:
     friend class StatementImpl;
+    friend class TransactionImpl;
     friend class DatabaseImpl;
+    std::shared_ptr<ConnPool> pool_;
+    std::unique_ptr<PooledConn> pc_;
     std::shared_ptr<driver::Conn> driver_conn_;
 };
 
+ConnectionImpl::ConnectionImpl(std::shared_ptr<ConnPool> pool, std::unique_ptr<PooledConn> pc)
+    : pool_(pool), pc_(std::move(pc)), driver_conn_(pc_->conn) {}
+
+ConnectionImpl::~ConnectionImpl() {
+    driver_conn_.reset();
+    pool_->Release(std::move(pc_));
+}
+
 Stmt ConnectionImpl::Prepare(const std::string& query) {
     return DoPrepare(query);
 }
@@ -76,61 +120,444 @@ std::shared_ptr<StatementImpl> ConnectionImpl::DoPrepare(const std::string& quer
     return std::make_shared<StatementImpl>(shared_from_this(), query);
 }
 
-StatementImpl::StatementImpl(std::shared_ptr<ConnectionImpl> conn, const std::string& query): conn_(conn) {
-    dirver_stmt_ = conn_->driver_conn_->Prepare(query);
+class TransactionImpl: public Transaction {
+public:
+    TransactionImpl(std::shared_ptr<ConnectionImpl> conn);
+    ~TransactionImpl();
+    void Commit() override;
+    void Rollback() override;
+    Stmt Prepare(const std::string& query) override;
+protected:
+    Result DoExec(const std::string& query, const std::vector<driver::Value>& args) override;
+    Rows DoQuery(const std::string& query, const std::vector<driver::Value>& args,
+                 const driver::QueryOptions& opts) override;
+private:
+    std::shared_ptr<ConnectionImpl> Conn();
+    std::shared_ptr<ConnectionImpl> conn_;
+    std::shared_ptr<driver::Tx> driver_tx_;
+};
+
+TransactionImpl::TransactionImpl(std::shared_ptr<ConnectionImpl> conn): conn_(conn) {
+    driver_tx_ = conn_->driver_conn_->Begin();
+    if (!driver_tx_) {
+        throw Exception(400, "sql: driver does not support transactions");
+    }
+}
+
+TransactionImpl::~TransactionImpl() {
+    if (driver_tx_) {
+        try {
+            driver_tx_->Rollback();
+        } catch (...) {
+        }
+    }
+}
+
+std::shared_ptr<ConnectionImpl> TransactionImpl::Conn() {
+    if (!driver_tx_) {
+        throw Exception(400, "sql: transaction has already been committed or rolled back");
+    }
+    return conn_;
+}
+
+void TransactionImpl::Commit() {
+    // the connection goes back to the pool once the statement finished,
+    // failed or not
+    std::shared_ptr<ConnectionImpl> conn = Conn();
+    std::shared_ptr<driver::Tx> tx = std::move(driver_tx_);
+    conn_.reset();
+    tx->Commit();
+}
+
+void TransactionImpl::Rollback() {
+    std::shared_ptr<ConnectionImpl> conn = Conn();
+    std::shared_ptr<driver::Tx> tx = std::move(driver_tx_);
+    conn_.reset();
+    tx->Rollback();
+}
+
+Stmt TransactionImpl::Prepare(const std::string& query) {
+    return Conn()->DoPrepare(query);
+}
+
+Result TransactionImpl::DoExec(const std::string& query, const std::vector<driver::Value>& args) {
+    return Conn()->DoPrepare(query)->DoExec(args);
+}
+
+Rows TransactionImpl::DoQuery(const std::string& query, const std::vector<driver::Value>& args,
+                              const driver::QueryOptions& opts) {
+    return Conn()->DoPrepare(query)->DoQuery(args, opts);
+}
+
+class PipelineImpl: public Pipeline {
+public:
+    PipelineImpl(std::shared_ptr<ConnectionImpl> conn, std::shared_ptr<driver::Pipeline> pipeline)
+        : conn_(conn), driver_pipeline_(pipeline) {}
+    ~PipelineImpl() {
+        // unread results are drained before the connection goes back
+        driver_pipeline_.reset();
+    }
+    void Send() override;
+    bool Next() override;
+    Result CurrentResult() override;
+    Rows CurrentRows() override;
+protected:
+    void DoAdd(const std::string& query, const std::vector<driver::Value>& args) override;
+private:
+    std::shared_ptr<ConnectionImpl> conn_;
+    std::shared_ptr<driver::Pipeline> driver_pipeline_;
+};
+
+void PipelineImpl::DoAdd(const std::string& query, const std::vector<driver::Value>& args) {
+    driver_pipeline_->Add(query, args);
+}
+
+void PipelineImpl::Send() {
+    driver_pipeline_->Send();
+}
+
+bool PipelineImpl::Next() {
+    return driver_pipeline_->Next();
+}
+
+Result PipelineImpl::CurrentResult() {
+    std::shared_ptr<driver::SQLResult> result = driver_pipeline_->CurrentResult();
+    if (!result) {
+        return nullptr;
+    }
+    return std::make_shared<ResultImpl>(result);
+}
+
+Rows PipelineImpl::CurrentRows() {
+    std::shared_ptr<driver::SQLRows> rows = driver_pipeline_->CurrentRows();
+    if (!rows) {
+        return nullptr;
+    }
+    return std::make_shared<RowsImpl>(nullptr, rows);
+}
+
+std::shared_ptr<Pipeline> ConnectionImpl::NewPipeline() {
+    return std::make_shared<PipelineImpl>(shared_from_this(), driver_conn_->NewPipeline());
+}
+
+Tx ConnectionImpl::Begin() {
+    return std::make_shared<TransactionImpl>(shared_from_this());
+}
+
+// ER_MAX_PREPARED_STMT_COUNT_REACHED
+static const int kErrMaxPreparedStmtCount = 1461;
+
+std::shared_ptr<driver::Stmt> ConnectionImpl::PrepareDriverStmt(const std::string& query) {
+    std::shared_ptr<driver::Stmt> stmt = pc_->stmts.Take(query);
+    if (stmt) {
+        pool_->stmt_cache_hits.fetch_add(1, std::memory_order_relaxed);
+        return stmt;
+    }
+    pool_->stmt_cache_misses.fetch_add(1, std::memory_order_relaxed);
+    for (;;) {
+        try {
+            return driver_conn_->Prepare(query);
+        } catch (const Exception& e) {
+            // the server wide prepared statement limit is reached, give back
+            // half of our cached statements and try again
+            if (e.code != kErrMaxPreparedStmtCount || pc_->stmts.size() == 0) {
+                throw;
+            }
+            std::size_t evicted = pc_->stmts.Evict((pc_->stmts.size() + 1) / 2);
+            pool_->stmt_cache_evictions.fetch_add(evicted, std::memory_order_relaxed);
+        }
+    }
+}
+
+void ConnectionImpl::ReleaseDriverStmt(const std::string& query, std::shared_ptr<driver::Stmt> stmt) {
+    std::size_t evicted = pc_->stmts.Put(query, std::move(stmt));
+    if (evicted) {
+        pool_->stmt_cache_evictions.fetch_add(evicted, std::memory_order_relaxed);
+    }
+}
+
+static const std::vector<driver::Value> kNoArgs;
+
+// Intercept runs call between the hooks of chain, call returns the rows
+// affected or -1. The error of call is rethrown after the hooks.
+template <typename F>
+static void Intercept(const InterceptorChain& chain, Event& e, F&& call) {
+    e.start = std::chrono::steady_clock::now();
+    for (const std::shared_ptr<Interceptor>& interceptor : chain) {
+        interceptor->Before(e);
+    }
+    try {
+        e.rows = call();
+    } catch (...) {
+        e.error = std::current_exception();
+    }
+    e.elapsed = std::chrono::steady_clock::now() - e.start;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        (*it)->After(e);
+    }
+    if (e.error) {
+        std::rethrow_exception(e.error);
+    }
+}
+
+StatementImpl::StatementImpl(std::shared_ptr<ConnectionImpl> conn, const std::string& query)
+    : conn_(conn), query_(query), chain_(conn_->pool_->Interceptors()) {
+    if (!chain_) {
+        dirver_stmt_ = conn_->PrepareDriverStmt(query_);
+        return;
+    }
+    Event e(Op::kPrepare, query_, kNoArgs);
+    Intercept(*chain_, e, [this] {
+        dirver_stmt_ = conn_->PrepareDriverStmt(query_);
+        return int64_t(-1);
+    });
+}
+
+StatementImpl::~StatementImpl() {
+    conn_->ReleaseDriverStmt(query_, std::move(dirver_stmt_));
 }
 
 Result StatementImpl::DoExec(const std::vector<driver::Value>& args) {
-    std::shared_ptr<driver::SQLResult> result = dirver_stmt_->Exec(args);
+    std::shared_ptr<driver::SQLResult> result;
+    if (!chain_) {
+        result = dirver_stmt_->Exec(args);
+    } else {
+        Event e(Op::kExec, query_, args);
+        Intercept(*chain_, e, [&] {
+            result = dirver_stmt_->Exec(args);
+            return result->RowsAffected();
+        });
+    }
+    return std::make_shared<ResultImpl>(result);
+}
+
+Result StatementImpl::DoExecMany(const std::vector<std::vector<driver::Value>>& rows) {
+    std::shared_ptr<driver::SQLResult> result;
+    if (!chain_) {
+        result = dirver_stmt_->ExecBatch(rows);
+    } else {
+        Event e(Op::kExecMany, query_, kNoArgs);
+        Intercept(*chain_, e, [&] {
+            result = dirver_stmt_->ExecBatch(rows);
+            return result->RowsAffected();
+        });
+    }
     return std::make_shared<ResultImpl>(result);
 }
 
-Rows StatementImpl::DoQuery(const std::vector<driver::Value>& args) {
-    return std::make_shared<RowsImpl>(shared_from_this(), args);
+Rows StatementImpl::DoQuery(const std::vector<driver::Value>& args, const driver::QueryOptions& opts) {
+    std::shared_ptr<RowsImpl> rows;
+    if (!chain_) {
+        rows = std::make_shared<RowsImpl>(shared_from_this(), args, opts);
+    } else {
+        Event e(Op::kQuery, query_, args);
+        Intercept(*chain_, e, [&] {
+            rows = std::make_shared<RowsImpl>(shared_from_this(), args, opts);
+            return int64_t(-1);
+        });
+        rows->chain_ = chain_;
+        rows->start_ = e.start;
+    }
+    // a buffered result is copied out of the driver so the connection goes
+    // back to the pool right away, the rows stay open until closed
+    if (rows->RowCount() >= 0) {
+        return std::make_shared<BufferedRows>(Buffer(*rows));
+    }
+    return rows;
+}
+
+std::future<Result> StatementImpl::DoExecAsync(const std::vector<driver::Value>& args) {
+    auto promise = std::make_shared<std::promise<Result>>();
+    std::future<Result> future = promise->get_future();
+    std::shared_ptr<StatementImpl> self = shared_from_this();
+    try {
+        dirver_stmt_->ExecAsync(args, [self, promise](std::shared_ptr<driver::SQLResult> result,
+                                                     std::exception_ptr error) mutable {
+            // give the connection back before anyone waiting sees the result
+            self.reset();
+            if (error) {
+                promise->set_exception(error);
+            } else {
+                promise->set_value(std::make_shared<ResultImpl>(result));
+            }
+        });
+    } catch (...) {
+        promise->set_exception(std::current_exception());
+    }
+    return future;
+}
+
+std::future<Rows> StatementImpl::DoQueryAsync(const std::vector<driver::Value>& args) {
+    auto promise = std::make_shared<std::promise<Rows>>();
+    std::future<Rows> future = promise->get_future();
+    std::shared_ptr<StatementImpl> self = shared_from_this();
+    try {
+        dirver_stmt_->QueryAsync(args, [self, promise](std::shared_ptr<driver::SQLRows> rows,
+                                                      std::exception_ptr error) mutable {
+            if (error) {
+                self.reset();
+                promise->set_exception(error);
+            } else {
+                promise->set_value(std::make_shared<RowsImpl>(std::move(self), rows));
+            }
+        });
+    } catch (...) {
+        promise->set_exception(std::current_exception());
+    }
+    return future;
+}
+
+RowsImpl::RowsImpl(std::shared_ptr<StatementImpl> stmt, const std::vector<driver::Value>& args,
+                   const driver::QueryOptions& opts): stmt_(stmt) {
+    driver_rows_ = stmt->dirver_stmt_->QueryWith(args, opts);
 }
 
-RowsImpl::RowsImpl(std::shared_ptr<StatementImpl> stmt, const std::vector<driver::Value>& args): stmt_(stmt) {
-    driver_rows_ = stmt->dirver_stmt_->Query(args);
+driver::SQLRows& RowsImpl::DriverRows() const {
+    if (!driver_rows_) {
+        throw Exception(400, "sql: Rows are closed");
+    }
+    return *driver_rows_;
 }
 
 const std::vector<std::string>& RowsImpl::Columns() const {
-    return driver_rows_->Columns();
+    return DriverRows().Columns();
 }
 
 bool RowsImpl::Next() {
-    return driver_rows_->Next();
+    if (!driver_rows_) {
+        return false;
+    }
+    bool more;
+    try {
+        more = driver_rows_->Next();
+    } catch (...) {
+        error_ = std::current_exception();
+        throw;
+    }
+    if (!more) {
+        Close();
+        return false;
+    }
+    rows_read_++;
+    return true;
+}
+
+void RowsImpl::Close() {
+    // the driver rows go first, they use the statement
+    driver_rows_.reset();
+    if (chain_) {
+        Event e(Op::kRows, stmt_->query_, kNoArgs);
+        e.start = start_;
+        e.elapsed = std::chrono::steady_clock::now() - start_;
+        e.rows = rows_read_;
+        e.error = error_;
+        const InterceptorChain* chain = chain_;
+        chain_ = nullptr;
+        for (auto it = chain->rbegin(); it != chain->rend(); ++it) {
+            (*it)->After(e);
+        }
+    }
+    stmt_.reset();
+}
+
+int64_t RowsImpl::RowCount() {
+    return DriverRows().RowCount();
+}
+
+void RowsImpl::Seek(uint64_t row) {
+    DriverRows().Seek(row);
+}
+
+std::size_t RowsImpl::NextBatch(driver::Batch &batch, std::size_t n) {
+    if (!driver_rows_) {
+        batch.rows = 0;
+        return 0;
+    }
+    std::size_t rows = driver_rows_->NextBatch(batch, n);
+    if (rows == 0) {
+        Close();
+    }
+    return rows;
+}
+
+void RowsImpl::ScanCells(std::vector<driver::Cell> &cells) {
+    driver::SQLRows &rows = DriverRows();
+    cells.resize(rows.Columns().size());
+    rows.ScanCells(cells.data(), cells.size());
+}
+
+std::size_t RowsImpl::ReadColumn(std::size_t idx, uint64_t offset, char *buf, std::size_t size) {
+    return DriverRows().ReadColumn(idx, offset, buf, size);
 }
 
 void RowsImpl::DoScan(std::vector<driver::Value> &dest) {
-    return driver_rows_->Scan(dest);
+    return DriverRows().Scan(dest);
+}
+
+void RowsImpl::DoScanTyped(const driver::ScanType *types, void *const *dest, std::size_t size) {
+    return DriverRows().ScanTyped(types, dest, size);
 }
 
 class DatabaseImpl: public Database {
 public:
-    DatabaseImpl(std::shared_ptr<driver::Driver> driver, const std::string& dsn);
-    ~DatabaseImpl() {}
+    DatabaseImpl(std::shared_ptr<driver::Connector> connector);
+    ~DatabaseImpl();
     Stmt Prepare(const std::string& query) override;
     std::shared_ptr<Connection> Conn() override;
+    Tx Begin() override;
+    std::shared_ptr<Pipeline> NewPipeline() override;
     void Ping() override;
+    void Close() override;
     std::shared_ptr<driver::Driver> Driver() override;
+    void SetMaxOpenConns(int n) override;
+    void SetMaxIdleConns(int n) override;
+    void SetConnMaxLifetime(std::chrono::milliseconds d) override;
+    void SetConnMaxIdleTime(std::chrono::milliseconds d) override;
+    void SetConnWaitTimeout(std::chrono::milliseconds d) override;
+    void SetStmtCacheSize(int n) override;
+    void SetMinIdleConns(int n) override;
+    void SetHealthCheckPeriod(std::chrono::milliseconds d) override;
+    void SetThreadAffinity(bool on) override;
+    void SetSharding(bool on) override;
+    DBStats Stats() override;
+    void SetPhaseMetrics(bool on) override;
+    MetricsSnapshot Metrics() override;
+    void AddInterceptor(std::shared_ptr<Interceptor> interceptor) override;
 protected:
     std::shared_ptr<ConnectionImpl> GetConn();
     Result DoExec(const std::string& query, const std::vector<driver::Value>& args) override;
-    Rows DoQuery(const std::string& query, const std::vector<driver::Value>& args) override;
+    Rows DoQuery(const std::string& query, const std::vector<driver::Value>& args,
+                 const driver::QueryOptions& opts) override;
+    std::future<Result> DoExecAsync(const std::string& query,
+                                    const std::vector<driver::Value>& args) override;
+    std::future<Rows> DoQueryAsync(const std::string& query,
+                                   const std::vector<driver::Value>& args) override;
 private:
-    std::shared_ptr<driver::Driver> driver_;
-    std::string dsn_;
+    std::shared_ptr<driver::Connector> connector_;
+    std::shared_ptr<ConnPool> pool_;
 };
 
-DatabaseImpl::DatabaseImpl(std::shared_ptr<driver::Driver> driver, const std::string& dsn): driver_(driver), dsn_(dsn) {}
+DatabaseImpl::DatabaseImpl(std::shared_ptr<driver::Connector> connector)
+    : connector_(connector), pool_(std::make_shared<ConnPool>(connector)) {}
+
+DatabaseImpl::~DatabaseImpl() {
+    pool_->Close();
+}
 
 std::shared_ptr<Connection> DatabaseImpl::Conn() {
     return GetConn();
 }
 
+Tx DatabaseImpl::Begin() {
+    return GetConn()->Begin();
+}
+
+std::shared_ptr<Pipeline> DatabaseImpl::NewPipeline() {
+    return GetConn()->NewPipeline();
+}
+
 std::shared_ptr<ConnectionImpl> DatabaseImpl::GetConn() {
-    std::shared_ptr<driver::Conn> conn = driver_->Open(dsn_);
-    return std::make_shared<ConnectionImpl>(conn);
+    return std::make_shared<ConnectionImpl>(pool_, pool_->Acquire());
 }
 
 Stmt DatabaseImpl::Prepare(const std::string& query) {
@@ -141,21 +568,96 @@ Result DatabaseImpl::DoExec(const std::string& query, const std::vector<driver::
     return GetConn()->DoPrepare(query)->DoExec(args);
 }
 
-Rows DatabaseImpl::DoQuery(const std::string& query, const std::vector<driver::Value>& args) {
-    return GetConn()->DoPrepare(query)->DoQuery(args);
+Rows DatabaseImpl::DoQuery(const std::string& query, const std::vector<driver::Value>& args,
+                           const driver::QueryOptions& opts) {
+    return GetConn()->DoPrepare(query)->DoQuery(args, opts);
+}
+
+std::future<Result> DatabaseImpl::DoExecAsync(const std::string& query,
+                                              const std::vector<driver::Value>& args) {
+    return GetConn()->DoPrepare(query)->DoExecAsync(args);
+}
+
+std::future<Rows> DatabaseImpl::DoQueryAsync(const std::string& query,
+                                             const std::vector<driver::Value>& args) {
+    return GetConn()->DoPrepare(query)->DoQueryAsync(args);
 }
 
 void DatabaseImpl::Ping() {
-    driver_->Open(dsn_);
+    GetConn()->driver_conn_->Ping();
+}
+
+void DatabaseImpl::Close() {
+    pool_->Close();
+}
+
+void DatabaseImpl::SetMaxOpenConns(int n) {
+    pool_->SetMaxOpenConns(n);
+}
+
+void DatabaseImpl::SetMaxIdleConns(int n) {
+    pool_->SetMaxIdleConns(n);
+}
+
+void DatabaseImpl::SetConnMaxLifetime(std::chrono::milliseconds d) {
+    pool_->SetConnMaxLifetime(d);
+}
+
+void DatabaseImpl::SetConnMaxIdleTime(std::chrono::milliseconds d) {
+    pool_->SetConnMaxIdleTime(d);
+}
+
+void DatabaseImpl::SetConnWaitTimeout(std::chrono::milliseconds d) {
+    pool_->SetWaitTimeout(d);
+}
+
+void DatabaseImpl::SetStmtCacheSize(int n) {
+    pool_->SetStmtCacheSize(n);
+}
+
+void DatabaseImpl::SetMinIdleConns(int n) {
+    pool_->SetMinIdleConns(n);
+}
+
+void DatabaseImpl::SetHealthCheckPeriod(std::chrono::milliseconds d) {
+    pool_->SetHealthCheckPeriod(d);
+}
+
+void DatabaseImpl::SetThreadAffinity(bool on) {
+    pool_->SetThreadAffinity(on);
+}
+
+void DatabaseImpl::SetSharding(bool on) {
+    pool_->SetSharding(on);
+}
+
+DBStats DatabaseImpl::Stats() {
+    return pool_->Stats();
+}
+
+void DatabaseImpl::SetPhaseMetrics(bool on) {
+    pool_->SetPhaseMetrics(on);
+}
+
+MetricsSnapshot DatabaseImpl::Metrics() {
+    return pool_->Snapshot();
+}
+
+void DatabaseImpl::AddInterceptor(std::shared_ptr<Interceptor> interceptor) {
+    pool_->AddInterceptor(std::move(interceptor));
 }
 
 std::shared_ptr<driver::Driver> DatabaseImpl::Driver() {
-    return driver_;
+    return connector_->Driver();
 }
 
 DB Open(const std::string &driver_name, const std::string &dsn) {
     std::shared_ptr<driver::Driver> driver = driver::GetDriver(driver_name);
-    return std::make_shared<DatabaseImpl>(driver, dsn);
+    return OpenDB(driver->OpenConnector(dsn));
+}
+
+DB OpenDB(std::shared_ptr<driver::Connector> connector) {
+    return std::make_shared<DatabaseImpl>(connector);
 }
 
 } // namespace sqlcc
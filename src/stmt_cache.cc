@@ -0,0 +1,55 @@
+#include "stmt_cache.h"
+
+namespace sqlcc {
+
+StmtCache::StmtCache(std::size_t capacity) : capacity_(capacity) {}
+
+StmtCache::~StmtCache() {
+    index_.clear();
+    lru_.clear();
+}
+
+std::shared_ptr<driver::Stmt> StmtCache::Take(const std::string& query) {
+    auto it = index_.find(query);
+    if (it == index_.end()) {
+        return nullptr;
+    }
+    std::shared_ptr<driver::Stmt> stmt = std::move(it->second->second);
+    lru_.erase(it->second);
+    index_.erase(it);
+    return stmt;
+}
+
+std::size_t StmtCache::Put(const std::string& query,
+                           std::shared_ptr<driver::Stmt> stmt) {
+    if (capacity_ == 0 || index_.count(query) != 0) {
+        // a second statement for the same query was in use at the same time,
+        // keep the cached one
+        return 0;
+    }
+    lru_.emplace_front(query, std::move(stmt));
+    index_.emplace(lru_.front().first, lru_.begin());
+    if (lru_.size() > capacity_) {
+        return Evict(lru_.size() - capacity_);
+    }
+    return 0;
+}
+
+std::size_t StmtCache::Evict(std::size_t n) {
+    std::size_t evicted = 0;
+    while (evicted < n && !lru_.empty()) {
+        index_.erase(lru_.back().first);
+        lru_.pop_back();
+        evicted++;
+    }
+    return evicted;
+}
+
+void StmtCache::SetCapacity(std::size_t capacity) {
+    capacity_ = capacity;
+    if (lru_.size() > capacity_) {
+        Evict(lru_.size() - capacity_);
+    }
+}
+
+}  // namespace sqlcc
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "sqlcc/driver/driver.h"
+
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace sqlcc {
+
+// StmtCache is a LRU of prepared driver statements keyed by query text. It
+// belongs to a single driver connection and is not thread safe.
+//
+// A statement is taken out of the cache while it is in use and put back when
+// released, so the same driver statement is never handed out twice.
+class StmtCache {
+public:
+    explicit StmtCache(std::size_t capacity = 0);
+    ~StmtCache();
+    // Take removes the statement prepared for query from the cache, returns
+    // nullptr on miss.
+    std::shared_ptr<driver::Stmt> Take(const std::string& query);
+    // Put returns a statement to the cache, returns the number of statements
+    // evicted to make room for it.
+    std::size_t Put(const std::string& query,
+                    std::shared_ptr<driver::Stmt> stmt);
+    // Evict closes up to n least recently used statements, returns the number
+    // of statements closed.
+    std::size_t Evict(std::size_t n);
+    void SetCapacity(std::size_t capacity);
+    std::size_t size() const { return lru_.size(); }
+
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<driver::Stmt>>;
+    // most recently used at the front
+    std::list<Entry> lru_;
+    // keys are views of the query stored in lru_
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+    std::size_t capacity_;
+};
+
+}  // namespace sqlcc
@@ -1,4 +1,8 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
 #include <sstream>
 #include <thread>
 #include <chrono>
@@ -7,6 +11,19 @@
 
 #include "driver/mysql/driver.h"
 #include "driver/mysql/dsn.h"
+#include "driver/mysql/exception.h"
+#include "driver/mysql/stmt.h"
+
+static std::atomic<int64_t> allocations{0};
+
+void* operator new(std::size_t size) {
+    allocations++;
+    void* ptr = std::malloc(size);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
 
 namespace sqlcc {
 namespace driver {
@@ -37,6 +54,16 @@ TEST(DSN, WithQuery) {
     EXPECT_EQ("utf-8", cfg.charset);
 }
 
+TEST(DSN, ResultMode) {
+    Config cfg = ParseDSN("root:toor@tcp(127.0.0.1:3306)/testdb");
+    EXPECT_EQ(ResultMode::kStream, cfg.result_mode);
+    cfg = ParseDSN("root:toor@tcp(127.0.0.1:3306)/testdb?result_mode=cursor&prefetch_rows=512");
+    EXPECT_EQ(ResultMode::kCursor, cfg.result_mode);
+    EXPECT_EQ(512u, cfg.prefetch_rows);
+    EXPECT_THROW(ParseDSN("root:toor@tcp(127.0.0.1:3306)/testdb?result_mode=x"),
+                 std::invalid_argument);
+}
+
 TEST(DSN, ToString) {
     std::string dsn = "root:toor@tcp(10.10.2.3:4455)/testdb";
     Config cfg = ParseDSN(dsn);
@@ -45,11 +72,32 @@ TEST(DSN, ToString) {
     EXPECT_EQ(dsn, buf.str());
 }
 
+TEST(Connector, ParseOnce) {
+    auto driver = std::make_shared<MySQLDriver>();
+    EXPECT_THROW(driver->OpenConnector("root:toor@tcp(127.0.0.1:3306)/testdb?result_mode=x"),
+                 std::invalid_argument);
+    auto connector = driver->OpenConnector("root:toor@tcp(127.0.0.1:3306)/testdb");
+    EXPECT_EQ(driver, connector->Driver());
+    for (int i = 0; i < 2; i++) {
+        auto conn = connector->Connect();
+        auto rows = conn->Prepare("select 1")->Query({});
+        EXPECT_TRUE(rows->Next());
+    }
+}
+
 class MySQLDriverTest: public testing::Test {
 protected:
     MySQLDriver driver;
 };
 
+TEST_F(MySQLDriverTest, OpenConnector) {
+    // the fixture driver is not owned by a shared_ptr
+    auto connector = driver.OpenConnector("root:toor@tcp(127.0.0.1:3306)/testdb");
+    EXPECT_EQ(&driver, connector->Driver().get());
+    auto rows = connector->Connect()->Prepare("select 1")->Query({});
+    EXPECT_TRUE(rows->Next());
+}
+
 TEST_F(MySQLDriverTest, Exec) {
     //std::time_t t = std::time(nullptr);
     //std::tm tm = *std::localtime(&t);
@@ -75,6 +123,248 @@ TEST_F(MySQLDriverTest, Query) {
     }
 }
 
+TEST_F(MySQLDriverTest, Time) {
+    auto conn = driver.Open("root:toor@tcp(127.0.0.1:3306)/testdb");
+    TimePoint at(std::chrono::microseconds(1709214307123456));
+    auto stmt = conn->Prepare(
+        "select cast(? as datetime(6)), cast(? as datetime(3)), "
+        "date('2024-03-01'), time('-10:30:00'), cast(null as datetime)");
+    auto rows = stmt->Query({at, at});
+    ASSERT_TRUE(rows->Next());
+    TimePoint point;
+    std::string text;
+    std::tm date;
+    std::string time;
+    NullTimePoint null_point;
+    const ScanType types[] = {ScanType::kTimePoint, ScanType::kString,
+                              ScanType::kTm, ScanType::kString,
+                              ScanType::kNullTimePoint};
+    void *const dest[] = {&point, &text, &date, &time, &null_point};
+    rows->ScanTyped(types, dest, 5);
+    EXPECT_EQ(at, point);
+    EXPECT_EQ("2024-02-29 13:45:07.123", text);
+    EXPECT_EQ(124, date.tm_year);
+    EXPECT_EQ(2, date.tm_mon);
+    EXPECT_EQ(1, date.tm_mday);
+    EXPECT_EQ("-10:30:00", time);
+    EXPECT_TRUE(null_point == nullptr);
+
+    std::vector<Value> values = {std::string(), TimePoint(), std::tm(),
+                                 std::string(), NullTimePoint()};
+    rows->Scan(values);
+    EXPECT_EQ("2024-02-29 13:45:07.123456", std::get<std::string>(values[0]));
+    EXPECT_EQ(TimePoint(std::chrono::microseconds(1709214307123000)),
+              std::get<TimePoint>(values[1]));
+}
+
+TEST_F(MySQLDriverTest, ScanTyped) {
+    auto conn = driver.Open("root:toor@tcp(127.0.0.1:3306)/testdb");
+    auto stmt = conn->Prepare(
+        "select 1, -128, 32767, -2147483648, -9223372036854775807, 255, "
+        "65535, 4294967295, cast(18446744073709551615 as unsigned), 2, "
+        "1.5e0");
+    auto rows = stmt->Query({});
+    ASSERT_TRUE(rows->Next());
+    bool b;
+    int8_t i8;
+    int16_t i16;
+    int32_t i32;
+    int64_t i64;
+    uint8_t u8;
+    uint16_t u16;
+    uint32_t u32;
+    uint64_t u64;
+    float f;
+    double d;
+    const ScanType types[] = {
+        ScanType::kBool,   ScanType::kInt8,   ScanType::kInt16,
+        ScanType::kInt32,  ScanType::kInt64,  ScanType::kUInt8,
+        ScanType::kUInt16, ScanType::kUInt32, ScanType::kUInt64,
+        ScanType::kFloat,  ScanType::kDouble};
+    void *const dest[] = {&b,   &i8,  &i16, &i32, &i64, &u8,
+                          &u16, &u32, &u64, &f,   &d};
+    rows->ScanTyped(types, dest, 11);
+    EXPECT_TRUE(b);
+    EXPECT_EQ(-128, i8);
+    EXPECT_EQ(32767, i16);
+    EXPECT_EQ(INT32_MIN, i32);
+    EXPECT_EQ(-INT64_MAX, i64);
+    EXPECT_EQ(255, u8);
+    EXPECT_EQ(65535, u16);
+    EXPECT_EQ(UINT32_MAX, u32);
+    EXPECT_EQ(UINT64_MAX, u64);
+    EXPECT_EQ(2.0f, f);
+    EXPECT_EQ(1.5, d);
+
+    // each integer column into a type too narrow for it
+    const ScanType narrow[] = {
+        ScanType::kBool,   ScanType::kUInt8,  ScanType::kInt8,
+        ScanType::kInt16,  ScanType::kInt32,  ScanType::kInt8,
+        ScanType::kInt16,  ScanType::kInt32,  ScanType::kInt64,
+        ScanType::kFloat,  ScanType::kDouble};
+    void *const narrow_dest[] = {&b,   &u8,  &i8,  &i16, &i32, &i8,
+                                 &i16, &i32, &i64, &f,   &d};
+    for (int i = 1; i < 9; i++) {
+        ScanType one[11];
+        std::copy(std::begin(types), std::end(types), one);
+        one[i] = narrow[i];
+        void *one_dest[11];
+        std::copy(std::begin(dest), std::end(dest), one_dest);
+        one_dest[i] = narrow_dest[i];
+        EXPECT_THROW(rows->ScanTyped(one, one_dest, 11), Exception) << i;
+    }
+
+    stmt = conn->Prepare(
+        "select 'text', '2024-02-29 13:45:07', '2024-02-29 13:45:07', null, "
+        "-1, cast(null as unsigned), 1.5e0, null, "
+        "cast('2024-02-29 13:45:07' as datetime), cast(null as datetime)");
+    rows = stmt->Query({});
+    ASSERT_TRUE(rows->Next());
+    std::string text;
+    std::tm tm;
+    TimePoint point;
+    int64_t not_null;
+    NullInt64 null_i64;
+    NullUInt64 null_u64;
+    NullDouble null_d;
+    NullString null_text;
+    NullTm null_tm;
+    NullTimePoint null_point;
+    const ScanType more[] = {
+        ScanType::kString,     ScanType::kTm,          ScanType::kTimePoint,
+        ScanType::kNullString, ScanType::kNullInt64,   ScanType::kNullUInt64,
+        ScanType::kNullDouble, ScanType::kNullString,  ScanType::kNullTm,
+        ScanType::kNullTimePoint};
+    void *const more_dest[] = {&text,   &tm,        &point,     &null_text,
+                               &null_i64, &null_u64, &null_d, &null_text,
+                               &null_tm,  &null_point};
+    rows->ScanTyped(more, more_dest, 10);
+    EXPECT_EQ("text", text);
+    EXPECT_EQ(124, tm.tm_year);
+    EXPECT_EQ(13, tm.tm_hour);
+    EXPECT_EQ(TimePoint(std::chrono::seconds(1709214307)), point);
+    ASSERT_TRUE(null_i64);
+    EXPECT_EQ(-1, *null_i64);
+    EXPECT_FALSE(null_u64);
+    ASSERT_TRUE(null_d);
+    EXPECT_EQ(1.5, *null_d);
+    EXPECT_FALSE(null_text);
+    ASSERT_TRUE(null_tm);
+    EXPECT_EQ(45, (*null_tm).tm_min);
+    EXPECT_FALSE(null_point);
+
+    // null into a type that can't hold it
+    const ScanType not_null_types[] = {
+        ScanType::kString,    ScanType::kTm,         ScanType::kTimePoint,
+        ScanType::kNullString, ScanType::kNullInt64, ScanType::kInt64,
+        ScanType::kNullDouble, ScanType::kNullString, ScanType::kNullTm,
+        ScanType::kNullTimePoint};
+    void *const not_null_dest[] = {&text,     &tm,        &point,  &null_text,
+                                   &null_i64, &not_null, &null_d, &null_text,
+                                   &null_tm,  &null_point};
+    EXPECT_THROW(rows->ScanTyped(not_null_types, not_null_dest, 10),
+                 Exception);
+    // -1 has no unsigned value
+    const ScanType negative[] = {
+        ScanType::kString,    ScanType::kTm,          ScanType::kTimePoint,
+        ScanType::kNullString, ScanType::kNullUInt64, ScanType::kNullUInt64,
+        ScanType::kNullDouble, ScanType::kNullString,  ScanType::kNullTm,
+        ScanType::kNullTimePoint};
+    void *const negative_dest[] = {&text,     &tm,       &point,  &null_text,
+                                   &null_u64, &null_u64, &null_d, &null_text,
+                                   &null_tm,  &null_point};
+    EXPECT_THROW(rows->ScanTyped(negative, negative_dest, 10), Exception);
+}
+
+TEST_F(MySQLDriverTest, NextBatch) {
+    auto conn = driver.Open("root:toor@tcp(127.0.0.1:3306)/testdb");
+    auto stmt = conn->Prepare("select id, username, age from table2");
+    auto rows = stmt->Query({});
+    Batch batch;
+    std::size_t total = 0;
+    while (std::size_t n = rows->NextBatch(batch, 64)) {
+        ASSERT_EQ(3u, batch.columns.size());
+        EXPECT_EQ(Column::Type::kInt64, batch.columns[0].type);
+        EXPECT_EQ(Column::Type::kString, batch.columns[1].type);
+        EXPECT_EQ(n, batch.columns[0].ints.size());
+        EXPECT_EQ(n + 1, batch.columns[1].offsets.size());
+        total += n;
+    }
+    EXPECT_LT(0u, total);
+}
+
+TEST_F(MySQLDriverTest, QueryBuffered) {
+    auto conn = driver.Open("root:toor@tcp(127.0.0.1:3306)/testdb");
+    auto stmt = conn->Prepare("select id from table2");
+    QueryOptions opts;
+    opts.mode = ResultMode::kBuffered;
+    auto rows = stmt->QueryWith({}, opts);
+    int64_t count = rows->RowCount();
+    int64_t n = 0;
+    while (rows->Next()) {
+        n++;
+    }
+    EXPECT_EQ(count, n);
+    if (count > 0) {
+        rows->Seek(0);
+        EXPECT_TRUE(rows->Next());
+    }
+}
+
+TEST_F(MySQLDriverTest, QueryAgain) {
+    auto conn = driver.Open("root:toor@tcp(127.0.0.1:3306)/testdb");
+    auto stmt = conn->Prepare(
+        "select cast(? as signed) union all select cast(? as signed)");
+    QueryOptions opts;
+    opts.mode = ResultMode::kBuffered;
+    auto old_rows = stmt->QueryWith({int64_t(1), int64_t(2)}, opts);
+    auto rows = stmt->QueryWith({int64_t(3), int64_t(4)}, opts);
+    // dropping the older rows leaves the result of the newer ones alone
+    old_rows.reset();
+    std::vector<int64_t> values;
+    while (rows->Next()) {
+        int64_t v;
+        const ScanType types[] = {ScanType::kInt64};
+        void *const dest[] = {&v};
+        rows->ScanTyped(types, dest, 1);
+        values.push_back(v);
+    }
+    EXPECT_EQ((std::vector<int64_t>{3, 4}), values);
+}
+
+TEST_F(MySQLDriverTest, QueryCursor) {
+    auto conn = driver.Open("root:toor@tcp(127.0.0.1:3306)/testdb");
+    auto stmt = conn->Prepare("select id from table2");
+    QueryOptions opts;
+    opts.mode = ResultMode::kCursor;
+    opts.prefetch_rows = 16;
+    auto rows = stmt->QueryWith({}, opts);
+    EXPECT_EQ(-1, rows->RowCount());
+    EXPECT_THROW(rows->Seek(0), sqlcc::Exception);
+    while (rows->Next()) {
+    }
+}
+
+TEST_F(MySQLDriverTest, ExecNoAllocation) {
+    auto conn = driver.Open("root:toor@tcp(127.0.0.1:3306)/testdb");
+    auto stmt = std::dynamic_pointer_cast<MySQLStmt>(
+        conn->Prepare("insert into table2 (username, age) values(?, ?)"));
+    ASSERT_NE(nullptr, stmt);
+    std::vector<Value> args = {std::string("alloc"), int64_t(0)};
+    stmt->Exec(args);
+    int64_t before = allocations.load();
+    for (int64_t i = 1; i <= 100; i++) {
+        std::get<int64_t>(args[1]) = i;
+        EXPECT_EQ(1, stmt->Exec(args)->RowsAffected());
+    }
+    EXPECT_EQ(before, allocations.load());
+    // a result still held is left alone
+    auto held = stmt->Exec(args);
+    int64_t id = held->LastInsertID();
+    stmt->Exec(args);
+    EXPECT_EQ(id, held->LastInsertID());
+}
+
 } // namespace mysql
 } // namespace driver
 } // namespace sqlcc
@@ -1,5 +1,14 @@
 #include <gtest/gtest.h>
 
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+#include "sqlcc/column_reader.h"
+#include "sqlcc/group_commit.h"
+#include "sqlcc/query_cache.h"
+#include "sqlcc/replicated.h"
 #include "sqlcc/sqlcc.h"
 
 namespace sqlcc {
@@ -22,4 +31,576 @@ TEST(sqlccTest, sqlccTest) {
     }
 }
 
+TEST(sqlccTest, Pool) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    db->SetMaxOpenConns(1);
+    db->SetConnWaitTimeout(std::chrono::milliseconds(100));
+    for (int i = 0; i < 10; i++) {
+        db->exec("insert into table2 (username, age) values(?, ?)", "pool", i);
+    }
+    DBStats stats = db->Stats();
+    EXPECT_EQ(1, stats.open_connections);
+    EXPECT_EQ(1, stats.idle);
+    {
+        Rows rows = db->query("select id from table2");
+        EXPECT_EQ(1, db->Stats().in_use);
+        EXPECT_THROW(db->query("select id from table2"), Exception);
+    }
+    EXPECT_EQ(0, db->Stats().in_use);
+}
+
+TEST(sqlccTest, StmtCache) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    for (int i = 0; i < 10; i++) {
+        Rows rows = db->query("select id from table2 where age = ?", i);
+        while (rows->Next()) {
+        }
+    }
+    DBStats stats = db->Stats();
+    EXPECT_EQ(1, stats.stmt_cache_misses);
+    EXPECT_EQ(9, stats.stmt_cache_hits);
+}
+
+TEST(sqlccTest, Metrics) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    db->SetPhaseMetrics(true);
+    db->exec("insert into table2 (username, age) values(?, ?)", "metrics", 1);
+    {
+        Rows rows = db->query("select id, username from table2");
+        while (rows->Next()) {
+            int64_t id;
+            std::string username;
+            rows->scan(&id, &username);
+        }
+    }
+    MetricsSnapshot metrics = db->Metrics();
+    EXPECT_EQ(1u, metrics.conn_opens);
+    EXPECT_EQ(1, metrics.idle);
+    EXPECT_EQ(2u, metrics.prepare.count);
+    EXPECT_EQ(2u, metrics.execute.count);
+    EXPECT_GT(metrics.fetch.count, 0u);
+    EXPECT_GT(metrics.bytes_received, 0u);
+    std::string text = PrometheusText(metrics, "db=\"test\"");
+    EXPECT_NE(std::string::npos,
+              text.find("sqlcc_connections_opened_total{db=\"test\"} 1\n"));
+}
+
+TEST(sqlccTest, Interceptor) {
+    struct Recorder : public Interceptor {
+        std::vector<std::string> events;
+        void Before(const Event& e) override {
+            events.push_back("before " + e.query);
+        }
+        void After(const Event& e) override {
+            events.push_back("after " + std::to_string(int(e.op)) + " " +
+                             std::to_string(e.rows) +
+                             (e.error ? " error" : ""));
+        }
+    };
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    auto recorder = std::make_shared<Recorder>();
+    db->AddInterceptor(recorder);
+    db->exec("insert into table2 (username, age) values(?, ?)", "hook", 1);
+    {
+        Rows rows = db->query("select id from table2 limit 2");
+        while (rows->Next()) {
+        }
+    }
+    EXPECT_THROW(db->exec("insert into no_such_table values(1)"), Exception);
+    std::vector<std::string> expected = {
+        "before insert into table2 (username, age) values(?, ?)",
+        "after 0 -1",
+        "before insert into table2 (username, age) values(?, ?)",
+        "after 1 1",
+        "before select id from table2 limit 2",
+        "after 0 -1",
+        "before select id from table2 limit 2",
+        "after 3 -1",
+        "after 4 2",
+        "before insert into no_such_table values(1)",
+        "after 0 -1 error",
+    };
+    EXPECT_EQ(expected, recorder->events);
+}
+
+TEST(sqlccTest, ScanCells) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    Result result = db->exec("insert into table2 (username, age) values(?, ?)", "cells", 7);
+    Rows rows = db->query("select id, username, age, null from table2 where id = ?",
+                          result->LastInsertID());
+    std::vector<driver::Cell> cells;
+    ASSERT_TRUE(rows->Next());
+    rows->ScanCells(cells);
+    ASSERT_EQ(4u, cells.size());
+    EXPECT_EQ(result->LastInsertID(), cells[0].AsInt64());
+    EXPECT_EQ("cells", cells[1].AsString());
+    EXPECT_EQ(7, cells[2].AsInt64());
+    EXPECT_TRUE(cells[3].IsNull());
+    EXPECT_THROW(cells[3].AsString(), Exception);
+    EXPECT_THROW(cells[1].AsInt64(), Exception);
+    // conversions between signedness throw when the value does not fit
+    EXPECT_EQ(7u, driver::Cell::Int64(7).AsUInt64());
+    EXPECT_THROW(driver::Cell::Int64(-1).AsUInt64(), Exception);
+    EXPECT_EQ(INT64_MAX, driver::Cell::UInt64(INT64_MAX).AsInt64());
+    EXPECT_THROW(driver::Cell::UInt64(uint64_t(INT64_MAX) + 1).AsInt64(),
+                 Exception);
+}
+
+TEST(sqlccTest, ReadColumn) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    std::string expected;
+    for (int i = 0; i < 50000; i++) {
+        expected += "ab";
+    }
+    // wider than the column buffers, the value is read from the row
+    Rows rows = db->query("select repeat('ab', 50000), 1");
+    ASSERT_TRUE(rows->Next());
+    char chunk[1000];
+    std::string got;
+    std::size_t n;
+    while ((n = rows->ReadColumn(0, got.size(), chunk, sizeof(chunk))) > 0) {
+        got.append(chunk, n);
+    }
+    EXPECT_EQ(expected, got);
+
+    ColumnReader reader(rows, 0, 4096);
+    std::istream in(&reader);
+    std::ostringstream out;
+    out << in.rdbuf();
+    EXPECT_EQ(expected, out.str());
+
+    std::string value;
+    int64_t one;
+    rows->scan(&value, &one);
+    EXPECT_EQ(expected, value);
+    EXPECT_EQ(1, one);
+    EXPECT_FALSE(rows->Next());
+}
+
+TEST(sqlccTest, BufferedRows) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    driver::QueryOptions opts;
+    opts.mode = driver::ResultMode::kBuffered;
+    Rows rows = db->query(opts, "select id from table2 limit 2");
+    // the connection is back before the rows are read
+    EXPECT_EQ(0, db->Stats().in_use);
+    int64_t count = rows->RowCount();
+    int64_t n = 0;
+    while (rows->Next()) {
+        n++;
+    }
+    EXPECT_EQ(count, n);
+    // exhausted buffered rows stay open
+    rows->Seek(0);
+    EXPECT_EQ(count > 0, rows->Next());
+    rows->Close();
+    EXPECT_FALSE(rows->Next());
+    // they convert and check like the rows of the driver
+    rows = db->query(opts, "select 'x1', repeat('z', 100000)");
+    ASSERT_TRUE(rows->Next());
+    int64_t number;
+    std::string text;
+    EXPECT_THROW(rows->scan(&number, &text), sqlcc::Exception);
+    EXPECT_THROW(rows->scan(&text), sqlcc::Exception);
+    std::string blob;
+    char chunk[4096];
+    std::size_t read;
+    while ((read = rows->ReadColumn(1, blob.size(), chunk, sizeof(chunk))) > 0) {
+        blob.append(chunk, read);
+    }
+    EXPECT_EQ(std::string(100000, 'z'), blob);
+    // narrowing throws as it does on the driver rows
+    rows = db->query(opts, "select 300, -1");
+    ASSERT_TRUE(rows->Next());
+    int8_t small;
+    int16_t wide;
+    uint32_t positive;
+    int32_t negative;
+    EXPECT_THROW(rows->scan(&small, &negative), sqlcc::Exception);
+    EXPECT_THROW(rows->scan(&wide, &positive), sqlcc::Exception);
+    rows->scan(&wide, &negative);
+    EXPECT_EQ(300, wide);
+    EXPECT_EQ(-1, negative);
+}
+
+TEST(sqlccTest, ExecMany) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    std::vector<std::tuple<std::string, int64_t>> rows;
+    for (int64_t i = 0; i < 1000; i++) {
+        rows.emplace_back("bulk" + std::to_string(i), i);
+    }
+    Stmt stmt = db->Prepare("insert into table2 (username, age) values(?, ?)");
+    Result result = stmt->ExecMany(rows);
+    EXPECT_EQ(1000, result->RowsAffected());
+}
+
+TEST(sqlccTest, ExecManyTime) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    auto conn = db->Conn();
+    conn->Prepare("create temporary table exec_many_time (id bigint, at datetime(6))")->Exec();
+    driver::TimePoint base(std::chrono::microseconds(1709214307123456));
+    std::vector<std::tuple<int64_t, driver::TimePoint>> rows;
+    for (int64_t i = 0; i < 100; i++) {
+        rows.emplace_back(i, base + std::chrono::seconds(i));
+    }
+    Stmt stmt = conn->Prepare("insert into exec_many_time (id, at) values(?, ?)");
+    EXPECT_EQ(100, stmt->ExecMany(rows)->RowsAffected());
+    Rows result = conn->Prepare("select id, at from exec_many_time order by id")->Query();
+    int64_t n = 0;
+    while (result->Next()) {
+        int64_t id;
+        driver::TimePoint at;
+        result->scan(&id, &at);
+        EXPECT_EQ(n, id);
+        EXPECT_EQ(base + std::chrono::seconds(n), at);
+        n++;
+    }
+    EXPECT_EQ(100, n);
+}
+
+TEST(sqlccTest, Async) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    std::vector<std::future<Result>> results;
+    for (int i = 0; i < 100; i++) {
+        results.push_back(db->ExecAsync("insert into table2 (username, age) values(?, ?)", "async", i));
+    }
+    for (auto& result : results) {
+        EXPECT_EQ(1, result.get()->RowsAffected());
+    }
+    Rows rows = db->QueryAsync("select id from table2 where username = ?", "async").get();
+    EXPECT_LE(100, rows->RowCount());
+    while (rows->Next()) {
+    }
+    EXPECT_EQ(0, db->Stats().in_use);
+}
+
+TEST(sqlccTest, Transaction) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    {
+        Tx tx = db->Begin();
+        tx->exec("insert into table2 (username, age) values(?, ?)", "tx", 1);
+        tx->Rollback();
+        EXPECT_THROW(tx->Commit(), Exception);
+    }
+    Tx tx = db->Begin();
+    Result result = tx->exec("insert into table2 (username, age) values(?, ?)", "tx", 2);
+    tx->Commit();
+    Rows rows = db->query("select age from table2 where id = ?", result->LastInsertID());
+    ASSERT_TRUE(rows->Next());
+    int64_t age;
+    rows->scan(&age);
+    EXPECT_EQ(2, age);
+}
+
+TEST(sqlccTest, GroupCommit) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    GroupCommitter committer(db);
+    std::vector<std::future<void>> done;
+    for (int i = 0; i < 100; i++) {
+        done.push_back(committer.Submit([i](Transaction& tx) {
+            tx.exec("insert into table2 (username, age) values(?, ?)", "group", i);
+            if (i == 50) {
+                throw std::runtime_error("unit failed");
+            }
+        }));
+    }
+    for (int i = 0; i < 100; i++) {
+        if (i == 50) {
+            EXPECT_THROW(done[i].get(), std::runtime_error);
+        } else {
+            EXPECT_NO_THROW(done[i].get());
+        }
+    }
+}
+
+TEST(sqlccTest, Pipeline) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    std::shared_ptr<Pipeline> pipeline = db->NewPipeline();
+    pipeline->Add("insert into table2 (username, age) values(?, ?)", "pipe'line", 1);
+    pipeline->Add("select username, age from table2 where id = last_insert_id()");
+    pipeline->Add("select nothing from no_such_table");
+    pipeline->Add("insert into table2 (username, age) values(?, ?)", "never", 2);
+    pipeline->Send();
+
+    ASSERT_TRUE(pipeline->Next());
+    ASSERT_NE(nullptr, pipeline->CurrentResult());
+    EXPECT_EQ(1, pipeline->CurrentResult()->RowsAffected());
+    ASSERT_TRUE(pipeline->Next());
+    Rows rows = pipeline->CurrentRows();
+    ASSERT_NE(nullptr, rows);
+    ASSERT_TRUE(rows->Next());
+    std::string username;
+    int64_t age;
+    rows->scan(&username, &age);
+    EXPECT_EQ("pipe'line", username);
+    EXPECT_EQ(1, age);
+    EXPECT_THROW(pipeline->Next(), Exception);
+    EXPECT_FALSE(pipeline->Next());
+}
+
+TEST(sqlccTest, PipelineLiterals) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    auto conn = db->Conn();
+    std::shared_ptr<Pipeline> pipeline = conn->NewPipeline();
+    EXPECT_THROW(pipeline->Add("select ?", std::numeric_limits<double>::infinity()),
+                 Exception);
+    EXPECT_THROW(pipeline->Add("select ?", std::nan("")), Exception);
+    // an unterminated quote or comment would swallow the next statement
+    EXPECT_THROW(pipeline->Add("select 'a"), Exception);
+    EXPECT_THROW(pipeline->Add("select 1 /* a"), Exception);
+    // a backslash ends no string under NO_BACKSLASH_ESCAPES
+    pipeline->Add("set session sql_mode = concat(@@sql_mode, ',NO_BACKSLASH_ESCAPES')");
+    pipeline->Send();
+    while (pipeline->Next()) {
+    }
+    pipeline->Add("select 'a\\', ?", 7);
+    pipeline->Send();
+    ASSERT_TRUE(pipeline->Next());
+    Rows rows = pipeline->CurrentRows();
+    ASSERT_TRUE(rows->Next());
+    std::string text;
+    int64_t value;
+    rows->scan(&text, &value);
+    EXPECT_EQ("a\\", text);
+    EXPECT_EQ(7, value);
+    EXPECT_FALSE(pipeline->Next());
+}
+
+TEST(sqlccTest, Replicated) {
+    const std::string dsn = "root:toor@tcp(127.0.0.1:3306)/testdb";
+    ReplicaOptions opts;
+    opts.min_requests = 3;
+    // nothing listens on port 1, the replica fails every query
+    auto db = OpenReplicated("mysql", dsn,
+                             {dsn, "root:toor@tcp(127.0.0.1:1)/testdb"}, opts);
+    db->exec("insert into table2 (username, age) values(?, ?)", "replicated", 1);
+    for (int i = 0; i < 50; i++) {
+        Rows rows = db->query("select id, username, age from table2");
+        EXPECT_TRUE(rows->Next());
+    }
+    std::vector<ReplicaStatus> replicas = db->Replicas();
+    ASSERT_EQ(2u, replicas.size());
+    EXPECT_FALSE(replicas[0].ejected);
+    EXPECT_EQ(0, replicas[0].in_flight);
+    EXPECT_GT(replicas[0].latency.count(), 0);
+    EXPECT_TRUE(replicas[1].ejected);
+    db->Close();
+}
+
+TEST(sqlccTest, ReplicatedRows) {
+    const std::string dsn = "root:toor@tcp(127.0.0.1:3306)/testdb";
+    DB replica = sqlcc::Open("mysql", dsn);
+    auto db = OpenReplicated(sqlcc::Open("mysql", dsn), {replica});
+    Rows rows = db->query("select id from table2");
+    EXPECT_EQ(1, db->Replicas()[0].in_flight);
+    // rows opened on the replica itself are not counted
+    Rows direct = replica->query("select id from table2");
+    direct->Close();
+    EXPECT_EQ(1, db->Replicas()[0].in_flight);
+    rows->Close();
+    EXPECT_EQ(0, db->Replicas()[0].in_flight);
+    // rows may outlive the replicated database
+    rows = db->query("select id from table2");
+    db.reset();
+    while (rows->Next()) {
+    }
+}
+
+TEST(sqlccTest, HealthCheck) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    EXPECT_NO_THROW(db->Ping());
+    db->SetMaxIdleConns(4);
+    db->SetMinIdleConns(3);
+    db->SetHealthCheckPeriod(std::chrono::milliseconds(20));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    DBStats stats = db->Stats();
+    EXPECT_EQ(3, stats.idle);
+    EXPECT_EQ(0, stats.invalid_closed);
+    // expired connections are replaced without a query
+    db->SetConnMaxLifetime(std::chrono::milliseconds(50));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    stats = db->Stats();
+    EXPECT_GE(stats.max_lifetime_closed, 3);
+    EXPECT_EQ(3, stats.idle);
+    db->Close();
+}
+
+TEST(sqlccTest, ThreadAffinity) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    db->SetThreadAffinity(true);
+    db->SetMaxOpenConns(2);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([db] {
+            for (int i = 0; i < 50; i++) {
+                Rows rows = db->query("select id from table2 limit 1");
+                while (rows->Next()) {
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    DBStats stats = db->Stats();
+    EXPECT_LE(stats.open_connections, 2);
+    EXPECT_EQ(0, stats.in_use);
+    EXPECT_GT(stats.stmt_cache_hits, 0);
+    db->SetThreadAffinity(false);
+    EXPECT_EQ(0, db->Stats().in_use);
+}
+
+TEST(sqlccTest, Sharding) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    db->SetSharding(true);
+    db->SetMaxIdleConns(8);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([db] {
+            for (int i = 0; i < 50; i++) {
+                db->exec("select 1");
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    DBStats stats = db->Stats();
+    EXPECT_LE(stats.open_connections, 8);
+    EXPECT_EQ(stats.open_connections, stats.idle);
+    db->SetSharding(false);
+    EXPECT_EQ(0, db->Stats().in_use);
+}
+
+TEST(sqlccTest, ShardingSingleConn) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    db->SetSharding(true);
+    db->SetMaxOpenConns(1);
+    // a waiter missing a parked connection fails with a timeout instead of
+    // hanging the test
+    db->SetConnWaitTimeout(std::chrono::seconds(10));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; t++) {
+        threads.emplace_back([db] {
+            for (int i = 0; i < 200; i++) {
+                EXPECT_NO_THROW(db->exec("select 1"));
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(1, db->Stats().open_connections);
+    EXPECT_EQ(0, db->Stats().in_use);
+}
+
+TEST(sqlccTest, QueryCache) {
+    QueryCacheOptions opts;
+    opts.tables = {"table2"};
+    auto db = OpenCached(
+        sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb"), opts);
+    Result result = db->exec("insert into table2 (username, age) values(?, ?)",
+                             "cached", 1);
+    int64_t id = result->LastInsertID();
+    auto age = [&] {
+        Rows rows = db->query("select age from table2 where id = ?", id);
+        int64_t age = -1;
+        while (rows->Next()) {
+            rows->scan(&age);
+        }
+        return age;
+    };
+    EXPECT_EQ(1, age());
+    EXPECT_EQ(1, age());
+    EXPECT_EQ(1u, db->CacheStats().hits);
+    // the write drops the cached result
+    db->exec("update table2 set age = ? where id = ?", 2, id);
+    EXPECT_EQ(2, age());
+    EXPECT_EQ(1u, db->CacheStats().invalidations);
+    // so do INSERT and REPLACE without INTO
+    EXPECT_EQ(2, age());
+    db->exec("insert table2 (username, age) values(?, ?)", "cached", 1);
+    EXPECT_EQ(2u, db->CacheStats().invalidations);
+    EXPECT_EQ(2, age());
+    db->exec("replace low_priority table2 (id, username, age) values(?, ?, ?)",
+             id, "cached", 3);
+    EXPECT_EQ(3u, db->CacheStats().invalidations);
+    EXPECT_EQ(3, age());
+    // queries on undeclared tables or none are not cached
+    db->query("select now()");
+    db->query("select 1 from information_schema.tables limit 1");
+    EXPECT_EQ(4u, db->CacheStats().misses);
+}
+
+struct User {
+    int64_t id = 0;
+    std::string name;
+    int age = 0;
+    driver::NullString email;
+};
+
+template <>
+struct RowMapping<User> {
+    static constexpr auto Fields() {
+        return std::make_tuple(MapField("id", &User::id),
+                               MapField("username", &User::name),
+                               MapField("age", &User::age),
+                               MapField("email", &User::email));
+    }
+};
+
+TEST(sqlccTest, QueryAll) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    Result result = db->exec("insert into table2 (username, age) values(?, ?)",
+                             "mapped", 42);
+    int64_t id = result->LastInsertID();
+    std::vector<User> users = db->QueryAll<User>(
+        "select id, username, age from table2 where id = ?", id);
+    ASSERT_EQ(1u, users.size());
+    EXPECT_EQ(id, users[0].id);
+    EXPECT_EQ("mapped", users[0].name);
+    EXPECT_EQ(42, users[0].age);
+    // fields without a column keep their default
+    EXPECT_FALSE(users[0].email);
+    // names are matched ignoring case
+    users = db->QueryAll<User>("select ID, AGE from table2 where id = ?", id);
+    ASSERT_EQ(1u, users.size());
+    EXPECT_EQ(42, users[0].age);
+    EXPECT_THROW(db->QueryAll<User>("select id, 1 as other from table2"),
+                 sqlcc::Exception);
+}
+
+struct UserAge {
+    double id = 0;
+    int64_t age = 0;
+};
+
+template <>
+struct RowMapping<UserAge> {
+    static constexpr auto Fields() {
+        return std::make_tuple(MapField("id", &UserAge::id),
+                               MapField("age", &UserAge::age));
+    }
+};
+
+TEST(sqlccTest, QueryAllMappings) {
+    DB db = sqlcc::Open("mysql", "root:toor@tcp(127.0.0.1:3306)/testdb");
+    db->SetMaxOpenConns(1);
+    Result result = db->exec("insert into table2 (username, age) values(?, ?)",
+                             "mapped", 42);
+    int64_t id = result->LastInsertID();
+    // the same statement scanned into other field types each time
+    const std::string query = "select id, age from table2 where id = ?";
+    for (int i = 0; i < 10; i++) {
+        std::vector<User> users = db->QueryAll<User>(query, id);
+        ASSERT_EQ(1u, users.size());
+        EXPECT_EQ(id, users[0].id);
+        EXPECT_EQ(42, users[0].age);
+        std::vector<UserAge> ages = db->QueryAll<UserAge>(query, id);
+        ASSERT_EQ(1u, ages.size());
+        EXPECT_EQ(double(id), ages[0].id);
+        EXPECT_EQ(42, ages[0].age);
+    }
+}
+
 } // namespace sqlcc